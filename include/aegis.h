@@ -0,0 +1,106 @@
+#ifndef AEGIS_H
+#define AEGIS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rocca.h"
+
+// AEGIS-128L and AEGIS-256 as specified in
+// draft-irtf-cfrg-aegis-aead, built on the same AES round
+// primitives as Rocca. Only 128-bit tags are supported.
+//
+// The API is identical to |rocca_seal| and |rocca_open|; see
+// rocca.h for the full contract.
+
+enum {
+    // AEGIS128L_KEY_SIZE is the size in bytes of an AEGIS-128L
+    // key.
+    AEGIS128L_KEY_SIZE = 16,
+    // AEGIS128L_NONCE_SIZE is the size in bytes of an
+    // AEGIS-128L nonce.
+    AEGIS128L_NONCE_SIZE = 16,
+    // AEGIS128L_TAG_SIZE is the size in bytes of an AEGIS-128L
+    // tag.
+    AEGIS128L_TAG_SIZE = 16,
+    // AEGIS128L_OVERHEAD is the size difference in bytes
+    // between a plaintext and its ciphertext.
+    AEGIS128L_OVERHEAD = AEGIS128L_TAG_SIZE,
+
+    // AEGIS256_KEY_SIZE is the size in bytes of an AEGIS-256
+    // key.
+    AEGIS256_KEY_SIZE = 32,
+    // AEGIS256_NONCE_SIZE is the size in bytes of an AEGIS-256
+    // nonce.
+    AEGIS256_NONCE_SIZE = 32,
+    // AEGIS256_TAG_SIZE is the size in bytes of an AEGIS-256
+    // tag.
+    AEGIS256_TAG_SIZE = 16,
+    // AEGIS256_OVERHEAD is the size difference in bytes between
+    // a plaintext and its ciphertext.
+    AEGIS256_OVERHEAD = AEGIS256_TAG_SIZE,
+};
+
+// aegis128l_seal encrypts and authenticates |plaintext_len|
+// bytes from |plaintext|, authenticates |additional_data_len|
+// bytes from |additional_data|, and writes the result to |dst|.
+//
+// It returns true on success and false otherwise.
+//
+// |dst_len| must be at least |plaintext_len| +
+// |AEGIS128L_OVERHEAD| bytes long. It is a catastrophic error
+// to EVER repeat a (|nonce|, |key|) pair.
+ROCCA_API bool aegis128l_seal(uint8_t* dst,
+                              size_t dst_len,
+                              const uint8_t key[AEGIS128L_KEY_SIZE],
+                              size_t key_len,
+                              const uint8_t nonce[AEGIS128L_NONCE_SIZE],
+                              size_t nonce_len,
+                              const uint8_t* plaintext,
+                              size_t plaintext_len,
+                              const uint8_t* additional_data,
+                              size_t additional_data_len);
+
+// aegis128l_open decrypts and authenticates |ciphertext_len|
+// bytes from |ciphertext|, authenticates |additional_data_len|
+// bytes from |additional_data|, and writes the result to |dst|.
+//
+// It returns true on success and false otherwise. If it returns
+// false, |dst_len| bytes of |dst| will be filled with zeros.
+ROCCA_API bool aegis128l_open(uint8_t* dst,
+                              size_t dst_len,
+                              const uint8_t key[AEGIS128L_KEY_SIZE],
+                              size_t key_len,
+                              const uint8_t nonce[AEGIS128L_NONCE_SIZE],
+                              size_t nonce_len,
+                              const uint8_t* ciphertext,
+                              size_t ciphertext_len,
+                              const uint8_t* additional_data,
+                              size_t additional_data_len);
+
+// aegis256_seal is |aegis128l_seal| for AEGIS-256.
+ROCCA_API bool aegis256_seal(uint8_t* dst,
+                             size_t dst_len,
+                             const uint8_t key[AEGIS256_KEY_SIZE],
+                             size_t key_len,
+                             const uint8_t nonce[AEGIS256_NONCE_SIZE],
+                             size_t nonce_len,
+                             const uint8_t* plaintext,
+                             size_t plaintext_len,
+                             const uint8_t* additional_data,
+                             size_t additional_data_len);
+
+// aegis256_open is |aegis128l_open| for AEGIS-256.
+ROCCA_API bool aegis256_open(uint8_t* dst,
+                             size_t dst_len,
+                             const uint8_t key[AEGIS256_KEY_SIZE],
+                             size_t key_len,
+                             const uint8_t nonce[AEGIS256_NONCE_SIZE],
+                             size_t nonce_len,
+                             const uint8_t* ciphertext,
+                             size_t ciphertext_len,
+                             const uint8_t* additional_data,
+                             size_t additional_data_len);
+
+#endif // AEGIS_H
@@ -5,6 +5,21 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+// ROCCA_API marks the public API. The shared library is built
+// with hidden visibility, so only these symbols are exported.
+// Defining ROCCA_STATIC together with ROCCA_IMPLEMENTATION when
+// using the single-header build gives them internal linkage
+// instead.
+#ifndef ROCCA_API
+#if defined(ROCCA_STATIC)
+#define ROCCA_API static inline
+#elif defined(__GNUC__)
+#define ROCCA_API __attribute__((visibility("default")))
+#else
+#define ROCCA_API
+#endif // defined(ROCCA_STATIC)
+#endif // ROCCA_API
+
 enum {
     // ROCCA_KEY_SIZE is the size in bytes of a Rocca key.
     ROCCA_KEY_SIZE = 32,
@@ -15,8 +30,38 @@ enum {
     // ROCCA_OVERHEAD is the size difference in bytes between
     // a plaintext and its ciphertext.
     ROCCA_OVERHEAD = ROCCA_TAG_SIZE,
+    // ROCCA_S_KEY_SIZE is the size in bytes of a Rocca-S key.
+    ROCCA_S_KEY_SIZE = 32,
+    // ROCCA_S_NONCE_SIZE is the size in bytes of a Rocca-S
+    // nonce.
+    ROCCA_S_NONCE_SIZE = 16,
+    // ROCCA_S_TAG_SIZE is the size in bytes of a Rocca-S tag.
+    ROCCA_S_TAG_SIZE = 32,
+    // ROCCA_S_OVERHEAD is the size difference in bytes between
+    // a plaintext and its Rocca-S ciphertext.
+    ROCCA_S_OVERHEAD = ROCCA_S_TAG_SIZE,
+    // ROCCA_CTX_EXPORT_SIZE is the size in bytes of a serialized
+    // |rocca_ctx|. See |rocca_ctx_export|.
+    ROCCA_CTX_EXPORT_SIZE = 184,
+    // ROCCA_FILE_HEADER_SIZE is the size in bytes of the header
+    // of an encrypted file. See |rocca_file_writer|.
+    ROCCA_FILE_HEADER_SIZE = 64,
+    // ROCCA_FILE_MAX_SEGMENT_SIZE is the largest segment size
+    // accepted by |rocca_file_writer_new|.
+    ROCCA_FILE_MAX_SEGMENT_SIZE = 16 * 1024 * 1024,
+    // ROCCA_PAGE_MAX_SIZE is the largest page size accepted by
+    // |rocca_page_cipher_new|.
+    ROCCA_PAGE_MAX_SIZE = 64 * 1024,
 };
 
+// rocca_ctx is an incremental (streaming) Rocca context.
+//
+// Its contents are private. It must be initialized with
+// |rocca_seal_init| or |rocca_open_init| before use.
+typedef struct rocca_ctx {
+    _Alignas(16) uint8_t opaque[192];
+} rocca_ctx;
+
 // rocca_seal encrypts and authenticates |plaintext_len| bytes
 // from |plaintext|, authenticates |additional_data_len| bytes
 // from |additional_data|, and writes the result to |dst|.
@@ -45,16 +90,16 @@ enum {
 //
 // |rocca_seal| never returns partial output: if it returns
 // false, |dst_len| bytes of |dst| will be filled with zeros.
-bool rocca_seal(uint8_t* dst,
-                size_t dst_len,
-                const uint8_t key[ROCCA_KEY_SIZE],
-                size_t key_len,
-                const uint8_t nonce[ROCCA_NONCE_SIZE],
-                size_t nonce_len,
-                const uint8_t* plaintext,
-                size_t plaintext_len,
-                const uint8_t* additional_data,
-                size_t additional_data_len);
+ROCCA_API bool rocca_seal(uint8_t* dst,
+                          size_t dst_len,
+                          const uint8_t key[ROCCA_KEY_SIZE],
+                          size_t key_len,
+                          const uint8_t nonce[ROCCA_NONCE_SIZE],
+                          size_t nonce_len,
+                          const uint8_t* plaintext,
+                          size_t plaintext_len,
+                          const uint8_t* additional_data,
+                          size_t additional_data_len);
 
 // rocca_open decrypts and authenticates |ciphertext_len| bytes
 // from |ciphertext|, authenticates |additional_data_len| bytes
@@ -76,15 +121,741 @@ bool rocca_seal(uint8_t* dst,
 //
 // |rocca_open| never returns partial output: if it returns
 // false, |dst_len| bytes of |dst| will be filled with zeros.
-bool rocca_open(uint8_t* dst,
-                size_t dst_len,
-                const uint8_t key[ROCCA_KEY_SIZE],
-                size_t key_len,
-                const uint8_t nonce[ROCCA_NONCE_SIZE],
-                size_t nonce_len,
-                const uint8_t* ciphertext,
-                size_t ciphertext_len,
-                const uint8_t* additional_data,
-                size_t additional_data_len);
+ROCCA_API bool rocca_open(uint8_t* dst,
+                          size_t dst_len,
+                          const uint8_t key[ROCCA_KEY_SIZE],
+                          size_t key_len,
+                          const uint8_t nonce[ROCCA_NONCE_SIZE],
+                          size_t nonce_len,
+                          const uint8_t* ciphertext,
+                          size_t ciphertext_len,
+                          const uint8_t* additional_data,
+                          size_t additional_data_len);
+
+// rocca_s_seal is |rocca_seal| for Rocca-S, the variant with
+// a 256-bit tag from draft-nakano-rocca-s.
+//
+// |dst_len| must be at least |plaintext_len| +
+// |ROCCA_S_OVERHEAD| bytes long. Otherwise, the requirements
+// are the same as |rocca_seal|.
+ROCCA_API bool rocca_s_seal(uint8_t* dst,
+                            size_t dst_len,
+                            const uint8_t key[ROCCA_S_KEY_SIZE],
+                            size_t key_len,
+                            const uint8_t nonce[ROCCA_S_NONCE_SIZE],
+                            size_t nonce_len,
+                            const uint8_t* plaintext,
+                            size_t plaintext_len,
+                            const uint8_t* additional_data,
+                            size_t additional_data_len);
+
+// rocca_s_open is |rocca_open| for Rocca-S.
+//
+// |ciphertext_len| must be at least |ROCCA_S_OVERHEAD| bytes
+// long. Otherwise, the requirements are the same as
+// |rocca_open|.
+ROCCA_API bool rocca_s_open(uint8_t* dst,
+                            size_t dst_len,
+                            const uint8_t key[ROCCA_S_KEY_SIZE],
+                            size_t key_len,
+                            const uint8_t nonce[ROCCA_S_NONCE_SIZE],
+                            size_t nonce_len,
+                            const uint8_t* ciphertext,
+                            size_t ciphertext_len,
+                            const uint8_t* additional_data,
+                            size_t additional_data_len);
+
+// rocca_seal_init initializes |ctx| for incremental sealing
+// with the (|key|, |nonce|) pair.
+//
+// It returns true on success and false otherwise.
+//
+// The requirements for |key| and |nonce| are the same as
+// |rocca_seal|. In particular, it is a catastrophic error to
+// EVER repeat a (|nonce|, |key|) pair.
+//
+// A message sealed incrementally is identical to one sealed
+// with |rocca_seal|: the ciphertext is the concatenation of
+// each |rocca_seal_update| output followed by the tag written
+// by |rocca_seal_final|.
+ROCCA_API bool rocca_seal_init(rocca_ctx* ctx,
+                               const uint8_t key[ROCCA_KEY_SIZE],
+                               size_t key_len,
+                               const uint8_t nonce[ROCCA_NONCE_SIZE],
+                               size_t nonce_len);
+
+// rocca_open_init initializes |ctx| for incremental opening
+// with the (|key|, |nonce|) pair.
+//
+// It returns true on success and false otherwise.
+ROCCA_API bool rocca_open_init(rocca_ctx* ctx,
+                               const uint8_t key[ROCCA_KEY_SIZE],
+                               size_t key_len,
+                               const uint8_t nonce[ROCCA_NONCE_SIZE],
+                               size_t nonce_len);
+
+// rocca_update_ad authenticates |additional_data_len| bytes
+// from |additional_data|.
+//
+// It returns true on success and false otherwise.
+//
+// All additional data must be provided before the first call
+// to |rocca_seal_update| or |rocca_open_update|.
+ROCCA_API bool rocca_update_ad(rocca_ctx* ctx,
+                               const uint8_t* additional_data,
+                               size_t additional_data_len);
+
+// rocca_seal_update encrypts |plaintext_len| bytes from
+// |plaintext| and writes exactly |plaintext_len| bytes to |dst|.
+//
+// It returns true on success and false otherwise.
+//
+// |dst_len| must be at least |plaintext_len| bytes long. |dst|
+// and |plaintext| may overlap exactly.
+ROCCA_API bool rocca_seal_update(rocca_ctx* ctx,
+                                 uint8_t* dst,
+                                 size_t dst_len,
+                                 const uint8_t* plaintext,
+                                 size_t plaintext_len);
+
+// rocca_seal_final writes the authentication tag to |tag| and
+// wipes |ctx|.
+//
+// It returns true on success and false otherwise.
+//
+// |tag_len| must be exactly |ROCCA_TAG_SIZE| bytes long.
+ROCCA_API bool rocca_seal_final(rocca_ctx* ctx, uint8_t* tag, size_t tag_len);
+
+// rocca_open_update decrypts |ciphertext_len| bytes from
+// |ciphertext| and writes exactly |ciphertext_len| bytes to
+// |dst|. |ciphertext| must not include the tag.
+//
+// It returns true on success and false otherwise.
+//
+// |dst_len| must be at least |ciphertext_len| bytes long. |dst|
+// and |ciphertext| may overlap exactly.
+//
+// The output is NOT authenticated until |rocca_open_final|
+// returns true. Do not act on it before then.
+ROCCA_API bool rocca_open_update(rocca_ctx* ctx,
+                                 uint8_t* dst,
+                                 size_t dst_len,
+                                 const uint8_t* ciphertext,
+                                 size_t ciphertext_len);
+
+// rocca_open_final verifies |tag| and wipes |ctx|.
+//
+// It returns true if the ciphertext is authentic and false
+// otherwise. If it returns false, all output written by
+// |rocca_open_update| must be discarded.
+ROCCA_API bool rocca_open_final(rocca_ctx* ctx,
+                                const uint8_t* tag,
+                                size_t tag_len);
+
+// rocca_ctx_export serializes |ctx| to |dst| so that the stream
+// can later be resumed with |rocca_ctx_import|, possibly by
+// a different process.
+//
+// It returns true on success and false otherwise.
+//
+// |dst_len| must be at least |ROCCA_CTX_EXPORT_SIZE| bytes
+// long. The blob is versioned but NOT encrypted or
+// authenticated: it is derived from the key and must be
+// protected like the key itself.
+//
+// A sealing snapshot must be resumed AT MOST once. Importing
+// the same snapshot twice and sealing different data from
+// either copy reuses the keystream exactly like repeating
+// a (nonce, key) pair, which is catastrophic. Callers that
+// checkpoint a sealing stream must discard (or overwrite) the
+// old snapshot as soon as any output past the checkpoint has
+// been released.
+ROCCA_API bool rocca_ctx_export(const rocca_ctx* ctx,
+                                uint8_t* dst,
+                                size_t dst_len);
+
+// rocca_ctx_import restores |ctx| from a blob created by
+// |rocca_ctx_export|.
+//
+// It returns true on success and false if |src| is not a valid
+// snapshot. See |rocca_ctx_export| for the nonce reuse
+// caveats.
+ROCCA_API bool rocca_ctx_import(rocca_ctx* ctx,
+                                const uint8_t* src,
+                                size_t src_len);
+
+// rocca_state_pool precomputes initialized Rocca states for
+// a sequence of counter nonces, taking |rocca_init| off the
+// critical path of |rocca_state_pool_seal| and
+// |rocca_state_pool_open|.
+//
+// The nonce for the i-th message (starting at zero) is the
+// initial nonce plus i, treating the nonce as a 128-bit
+// big-endian integer.
+//
+// Each precomputed state is used for exactly one message and is
+// wiped as soon as it is taken. A pool must only be used in one
+// direction: either sealing or opening.
+//
+// All functions are safe to call concurrently.
+typedef struct rocca_state_pool rocca_state_pool;
+
+// rocca_state_pool_new creates a pool that holds up to
+// |capacity| precomputed states for |key|, starting at |nonce|.
+//
+// It returns NULL if the arguments are invalid or memory cannot
+// be allocated. The pool starts empty: see
+// |rocca_state_pool_fill| and |rocca_state_pool_start|.
+ROCCA_API rocca_state_pool* rocca_state_pool_new(
+    const uint8_t key[ROCCA_KEY_SIZE],
+    size_t key_len,
+    const uint8_t nonce[ROCCA_NONCE_SIZE],
+    size_t nonce_len,
+    size_t capacity);
+
+// rocca_state_pool_free stops the background thread, if any,
+// wipes every precomputed state and the key, and frees |pool|.
+ROCCA_API void rocca_state_pool_free(rocca_state_pool* pool);
+
+// rocca_state_pool_fill precomputes up to |max| states and
+// returns the number of states added.
+//
+// It is intended to be called during idle cycles, or from
+// a thread owned by the caller.
+ROCCA_API size_t rocca_state_pool_fill(rocca_state_pool* pool, size_t max);
+
+// rocca_state_pool_start starts a background thread that keeps
+// |pool| full. It is stopped by |rocca_state_pool_free|.
+//
+// It returns true on success and false otherwise.
+ROCCA_API bool rocca_state_pool_start(rocca_state_pool* pool);
+
+// rocca_state_pool_seal is |rocca_seal| with the next nonce in
+// the sequence, which is written to |nonce|.
+//
+// If no precomputed state is ready, the state is computed
+// inline. Either way, the nonce is never used again.
+ROCCA_API bool rocca_state_pool_seal(rocca_state_pool* pool,
+                                     uint8_t nonce[ROCCA_NONCE_SIZE],
+                                     uint8_t* dst,
+                                     size_t dst_len,
+                                     const uint8_t* plaintext,
+                                     size_t plaintext_len,
+                                     const uint8_t* additional_data,
+                                     size_t additional_data_len);
+
+// rocca_state_pool_open is |rocca_open| with |nonce|.
+//
+// If |nonce| is the next nonce in the sequence, or is less than
+// |capacity| nonces ahead of it because messages were lost or
+// reordered, the precomputed state for |nonce| (if any) is used.
+// Only if the ciphertext is authentic is that state consumed and
+// the states for the nonces before it wiped, and the sequence
+// then continues after |nonce|. Otherwise, including for
+// a forgery, the pool is not modified.
+ROCCA_API bool rocca_state_pool_open(rocca_state_pool* pool,
+                                     const uint8_t nonce[ROCCA_NONCE_SIZE],
+                                     size_t nonce_len,
+                                     uint8_t* dst,
+                                     size_t dst_len,
+                                     const uint8_t* ciphertext,
+                                     size_t ciphertext_len,
+                                     const uint8_t* additional_data,
+                                     size_t additional_data_len);
+
+// rocca_buf_pool hands out fixed-size buffers for |rocca_seal|
+// and |rocca_open| so that high-rate callers do not allocate
+// per message.
+//
+// Every buffer starts on a |ROCCA_BUF_ALIGN| byte boundary and
+// has room for a message of up to the |max_len| passed to
+// |rocca_buf_pool_new| plus the largest tag in this package,
+// so a ciphertext can be sealed in place.
+//
+// Free buffers are kept on 16 locked free lists. Each thread is
+// assigned one of them round-robin and steals from the others
+// when its own is empty, so threads rarely contend with each
+// other. Buffers are wiped when they are returned to the pool.
+//
+// All functions are safe to call concurrently.
+typedef struct rocca_buf_pool rocca_buf_pool;
+
+enum {
+    // ROCCA_BUF_ALIGN is the alignment in bytes of every buffer
+    // handed out by a |rocca_buf_pool|.
+    ROCCA_BUF_ALIGN = 64,
+    // ROCCA_BUF_HUGETLB asks |rocca_buf_pool_new| to back the
+    // pool with huge pages. If they are not available, the pool
+    // falls back to regular pages.
+    ROCCA_BUF_HUGETLB = 1 << 0,
+};
+
+// rocca_buf_pool_new creates a pool of |count| buffers, each
+// large enough for a |max_len| byte message and its tag.
+// |flags| is zero or |ROCCA_BUF_HUGETLB|.
+//
+// It returns NULL if the arguments are invalid or memory cannot
+// be allocated.
+ROCCA_API rocca_buf_pool* rocca_buf_pool_new(size_t max_len,
+                                             size_t count,
+                                             unsigned flags);
+
+// rocca_buf_pool_free wipes every buffer and frees |pool|. Any
+// buffers still in use become invalid.
+ROCCA_API void rocca_buf_pool_free(rocca_buf_pool* pool);
+
+// rocca_buf_pool_buf_size returns the size in bytes of each
+// buffer in |pool|, which is at least |max_len| +
+// |ROCCA_S_OVERHEAD|.
+ROCCA_API size_t rocca_buf_pool_buf_size(const rocca_buf_pool* pool);
+
+// rocca_buf_get takes a buffer from |pool|. Its contents are
+// all zeros.
+//
+// It returns NULL if every buffer is in use.
+ROCCA_API uint8_t* rocca_buf_get(rocca_buf_pool* pool);
+
+// rocca_buf_put wipes |buf| and returns it to |pool|.
+//
+// It returns false if |buf| was not obtained from |pool|.
+// Returning the same buffer twice is undefined.
+ROCCA_API bool rocca_buf_put(rocca_buf_pool* pool, uint8_t* buf);
+
+// rocca_session_table holds the keys, nonce counters and
+// statistics of many sessions in structure-of-arrays form, so
+// that sealing a batch of messages for different sessions
+// touches a few dense, cache-aligned arrays instead of one
+// scattered struct per session.
+//
+// Sessions are identified by a dense index in [0, capacity)
+// chosen by the caller. Each session has a base nonce; the
+// nonce for its i-th message (starting at zero) is the base
+// plus i, treating the nonce as a 128-bit big-endian integer.
+//
+// A table is NOT safe for concurrent use. Servers should shard
+// sessions across one table per thread.
+typedef struct rocca_session_table rocca_session_table;
+
+// rocca_session_table_new creates a table for |capacity|
+// sessions, all initially unset.
+//
+// It returns NULL if |capacity| is zero or memory cannot be
+// allocated.
+ROCCA_API rocca_session_table* rocca_session_table_new(size_t capacity);
+
+// rocca_session_table_free wipes every key and frees |table|.
+ROCCA_API void rocca_session_table_free(rocca_session_table* table);
+
+// rocca_session_set installs |key| and the base |nonce| for
+// session |id| and resets its counter and statistics.
+//
+// It returns true on success and false otherwise.
+ROCCA_API bool rocca_session_set(rocca_session_table* table,
+                                 size_t id,
+                                 const uint8_t key[ROCCA_KEY_SIZE],
+                                 size_t key_len,
+                                 const uint8_t nonce[ROCCA_NONCE_SIZE],
+                                 size_t nonce_len);
+
+// rocca_session_clear wipes session |id|.
+ROCCA_API void rocca_session_clear(rocca_session_table* table, size_t id);
+
+// rocca_session_stats reports the number of messages and
+// plaintext bytes sealed for session |id|.
+//
+// It returns false if |id| is not set.
+ROCCA_API bool rocca_session_stats(const rocca_session_table* table,
+                                   size_t id,
+                                   uint64_t* messages,
+                                   uint64_t* bytes);
+
+// rocca_session_msg is one message in a call to
+// |rocca_session_seal_batch|.
+typedef struct rocca_session_msg {
+    // session is the session to seal the message for.
+    size_t session;
+    // dst, plaintext and additional_data are as for
+    // |rocca_seal|.
+    uint8_t* dst;
+    size_t dst_len;
+    const uint8_t* plaintext;
+    size_t plaintext_len;
+    const uint8_t* additional_data;
+    size_t additional_data_len;
+    // nonce is set to the nonce used to seal the message.
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+    // ok is set to true if the message was sealed. Otherwise,
+    // |dst_len| bytes of |dst| are filled with zeros and the
+    // session's counter is not advanced.
+    bool ok;
+} rocca_session_msg;
+
+// rocca_session_seal_batch seals each of the |n| messages in
+// |msgs| with the next nonce of its session and returns the
+// number of messages sealed.
+//
+// Messages for the same session are assigned nonces in the
+// order in which they appear in |msgs|. Messages for different
+// sessions are sealed several at a time.
+ROCCA_API size_t rocca_session_seal_batch(rocca_session_table* table,
+                                          rocca_session_msg* msgs,
+                                          size_t n);
+
+// rocca_recipient is one recipient in a call to
+// |rocca_seal_fanout|.
+typedef struct rocca_recipient {
+    // key and nonce are as for |rocca_seal|.
+    const uint8_t* key;
+    size_t key_len;
+    const uint8_t* nonce;
+    size_t nonce_len;
+    // dst receives the recipient's ciphertext and tag, as for
+    // |rocca_seal|.
+    uint8_t* dst;
+    size_t dst_len;
+} rocca_recipient;
+
+// rocca_seal_fanout seals the same |plaintext| and
+// |additional_data| for each of the |n| recipients in
+// |recipients|. The result is identical to calling |rocca_seal|
+// once per recipient, but each block of input is read from
+// memory once and then encrypted for every recipient.
+//
+// It returns true on success and false otherwise. If any
+// recipient is invalid, nothing is sealed and the |dst| of every
+// recipient is filled with zeros.
+//
+// As with |rocca_seal|, each (|nonce|, |key|) pair must be
+// unique. The |dst| buffers must not overlap |plaintext|,
+// |additional_data| or each other.
+ROCCA_API bool rocca_seal_fanout(const rocca_recipient* recipients,
+                                 size_t n,
+                                 const uint8_t* plaintext,
+                                 size_t plaintext_len,
+                                 const uint8_t* additional_data,
+                                 size_t additional_data_len);
+
+// rocca_file_writer writes an encrypted file that can be read
+// at random offsets with |rocca_file|.
+//
+// The plaintext is split into segments of a fixed size, each
+// sealed on its own with a nonce derived from the file's base
+// nonce and the segment's index. A header records the segment
+// size, base nonce and plaintext length and is authenticated
+// too, so segments cannot be reordered, dropped, or moved
+// between files.
+//
+// A file with n segments uses the nonces base through
+// base + n - 1 and base + 2^64 - 1 (treating the nonce as
+// a 128-bit big-endian integer). The base nonce should be
+// chosen at random for each file so that these ranges never
+// overlap under the same key.
+typedef struct rocca_file_writer rocca_file_writer;
+
+// rocca_file_writer_new creates a writer for |fd|, which must be
+// open for writing and support pwrite(2). The file is written
+// from offset zero; |fd| is not closed by the writer.
+//
+// |segment_size| is between 1 and |ROCCA_FILE_MAX_SEGMENT_SIZE|
+// bytes. Smaller segments make small reads cheaper, larger
+// segments reduce the |ROCCA_OVERHEAD| bytes added per segment.
+//
+// It returns NULL if the arguments are invalid or memory cannot
+// be allocated.
+ROCCA_API rocca_file_writer* rocca_file_writer_new(
+    int fd,
+    const uint8_t key[ROCCA_KEY_SIZE],
+    size_t key_len,
+    const uint8_t nonce[ROCCA_NONCE_SIZE],
+    size_t nonce_len,
+    size_t segment_size);
+
+// rocca_file_writer_free wipes and frees |w|. A file that was
+// not finished with |rocca_file_writer_finish| is not valid.
+ROCCA_API void rocca_file_writer_free(rocca_file_writer* w);
+
+// rocca_file_write appends |len| bytes from |data| to the file.
+//
+// It returns true on success and false otherwise. After
+// a failure, the writer can only be freed.
+ROCCA_API bool rocca_file_write(rocca_file_writer* w,
+                                const uint8_t* data,
+                                size_t len);
+
+// rocca_file_writer_finish writes the final segment and the
+// header.
+//
+// It returns true on success and false otherwise. Either way,
+// the writer can only be freed afterward.
+ROCCA_API bool rocca_file_writer_finish(rocca_file_writer* w);
+
+// rocca_file reads a file written by |rocca_file_writer|.
+//
+// Each read decrypts and verifies only the segments that cover
+// the requested range, so its cost depends on the length of the
+// range and not on its offset. Recently decrypted segments are
+// kept in an LRU cache.
+//
+// A rocca_file is NOT safe for concurrent use. Readers on
+// different threads should each open their own.
+typedef struct rocca_file rocca_file;
+
+// rocca_file_open verifies the header of the file open on |fd|
+// and returns a reader for it. |fd| must support pread(2) and is
+// not closed by the reader.
+//
+// |cache_segments| is the number of decrypted segments to keep
+// in the cache, and may be zero.
+//
+// It returns NULL if the header is not authentic, the arguments
+// are invalid, or memory cannot be allocated.
+ROCCA_API rocca_file* rocca_file_open(int fd,
+                                      const uint8_t key[ROCCA_KEY_SIZE],
+                                      size_t key_len,
+                                      size_t cache_segments);
+
+// rocca_file_close wipes the cache and frees |f|.
+ROCCA_API void rocca_file_close(rocca_file* f);
+
+// rocca_file_size returns the length in bytes of the plaintext.
+ROCCA_API uint64_t rocca_file_size(const rocca_file* f);
+
+// rocca_file_pread decrypts up to |dst_len| bytes of plaintext
+// starting at |offset| into |dst| and sets |*n| to the number
+// of bytes read, which is only short at the end of the file.
+//
+// It returns true on success and false otherwise. If any segment
+// in the range cannot be read or is not authentic, |dst_len|
+// bytes of |dst| are filled with zeros.
+ROCCA_API bool rocca_file_pread(rocca_file* f,
+                                uint8_t* dst,
+                                size_t dst_len,
+                                uint64_t offset,
+                                size_t* n);
+
+// rocca_page_cipher encrypts fixed-size database pages in place.
+//
+// A page is split into a header, a payload and a trailer:
+//
+//    header (header_len bytes) | payload | tag (ROCCA_TAG_SIZE)
+//
+// The header is authenticated but left in the clear, so that
+// a storage engine can keep the page number and LSN there. The
+// payload is encrypted in place and the tag is written to the
+// trailer, so no copy of the page is needed.
+//
+// The nonce is the page number followed by the LSN, each as
+// a little-endian uint64. It is a catastrophic error to seal two
+// different pages with the same page number and LSN under the
+// same key: the LSN must increase every time a page is written,
+// and page numbers must be unique across every file sharing the
+// key.
+//
+// A rocca_page_cipher is safe for concurrent use.
+typedef struct rocca_page_cipher rocca_page_cipher;
+
+// rocca_page_cipher_new creates a cipher for |page_size| byte
+// pages with a |header_len| byte cleartext header.
+//
+// |page_size| is at most |ROCCA_PAGE_MAX_SIZE| and must leave
+// room for the header and the tag.
+//
+// It returns NULL if the arguments are invalid or memory cannot
+// be allocated.
+ROCCA_API rocca_page_cipher* rocca_page_cipher_new(
+    const uint8_t key[ROCCA_KEY_SIZE],
+    size_t key_len,
+    size_t page_size,
+    size_t header_len);
+
+// rocca_page_cipher_free wipes the key and frees |c|.
+ROCCA_API void rocca_page_cipher_free(rocca_page_cipher* c);
+
+// rocca_page is one page in a call to |rocca_page_seal_batch| or
+// |rocca_page_open_batch|.
+typedef struct rocca_page {
+    // data is the page, which is modified in place.
+    uint8_t* data;
+    // page_no and lsn determine the nonce.
+    uint64_t page_no;
+    uint64_t lsn;
+    // ok is set to true if the page was sealed or opened.
+    bool ok;
+} rocca_page;
+
+// rocca_page_seal_batch encrypts and authenticates each of the
+// |n| pages in |pages| in place, writing the tags to the page
+// trailers, and returns the number of pages sealed.
+//
+// Several pages are sealed at a time with their states
+// interleaved, which is faster than sealing them one by one.
+ROCCA_API size_t rocca_page_seal_batch(const rocca_page_cipher* c,
+                                       rocca_page* pages,
+                                       size_t n);
+
+// rocca_page_open_batch decrypts and verifies each of the |n|
+// pages in |pages| in place and returns the number of pages that
+// are authentic.
+//
+// Pages that are not authentic are filled with zeros.
+ROCCA_API size_t rocca_page_open_batch(const rocca_page_cipher* c,
+                                       rocca_page* pages,
+                                       size_t n);
+
+// rocca_page_seal is |rocca_page_seal_batch| for one page.
+ROCCA_API bool rocca_page_seal(const rocca_page_cipher* c,
+                               uint8_t* page,
+                               uint64_t page_no,
+                               uint64_t lsn);
+
+// rocca_page_open is |rocca_page_open_batch| for one page.
+ROCCA_API bool rocca_page_open(const rocca_page_cipher* c,
+                               uint8_t* page,
+                               uint64_t page_no,
+                               uint64_t lsn);
+
+// rocca_page_verify reports whether the sealed |page| is
+// authentic without decrypting it in place, for example to
+// scrub pages on disk or check them before a backup.
+ROCCA_API bool rocca_page_verify(const rocca_page_cipher* c,
+                                 const uint8_t* page,
+                                 uint64_t page_no,
+                                 uint64_t lsn);
+
+// rocca_sealer seals an ordered stream of messages under one
+// key, one message at a time.
+//
+// |rocca_init| and |rocca_mac| are each a chain of 20 dependent
+// rounds, so sealing short messages back to back leaves the AES
+// units mostly idle. A rocca_sealer keeps the last message it
+// was given open and, if |rocca_tuning.sealer_interleave| is
+// set, finishes it while initializing the next one, so that the
+// two chains overlap. Messages are finished in the order in
+// which they are pushed.
+//
+// A rocca_sealer is NOT safe for concurrent use.
+typedef struct rocca_sealer rocca_sealer;
+
+// rocca_sealer_new creates a sealer for |key|.
+//
+// It returns NULL if the arguments are invalid or memory cannot
+// be allocated.
+ROCCA_API rocca_sealer* rocca_sealer_new(const uint8_t key[ROCCA_KEY_SIZE],
+                                         size_t key_len);
+
+// rocca_sealer_free wipes the key and any pending state and
+// frees |p|. A message that is still pending is left unfinished
+// and its tag is never written.
+ROCCA_API void rocca_sealer_free(rocca_sealer* p);
+
+// rocca_sealer_msg is one message passed to
+// |rocca_sealer_push|.
+typedef struct rocca_sealer_msg {
+    // nonce, dst, plaintext and additional_data are as for
+    // |rocca_seal|.
+    const uint8_t* nonce;
+    size_t nonce_len;
+    uint8_t* dst;
+    size_t dst_len;
+    const uint8_t* plaintext;
+    size_t plaintext_len;
+    const uint8_t* additional_data;
+    size_t additional_data_len;
+    // ok is set to true when the message is returned sealed.
+    // Otherwise, |dst_len| bytes of |dst| are filled with zeros.
+    bool ok;
+} rocca_sealer_msg;
+
+// rocca_sealer_push starts sealing |msg|, finishes the message
+// pushed before it and returns that message. It returns NULL if
+// there was no such message.
+//
+// The ciphertext of |msg| is written straight away, but its tag
+// is only written when |msg| is returned by the next call to
+// |rocca_sealer_push| or |rocca_sealer_flush|. Until then, |msg|
+// and its |dst| must stay valid. Its |plaintext| and
+// |additional_data| are no longer needed once this returns.
+//
+// An invalid message is still returned in order, with |ok| set
+// to false.
+ROCCA_API rocca_sealer_msg* rocca_sealer_push(rocca_sealer* p,
+                                              rocca_sealer_msg* msg);
+
+// rocca_sealer_flush finishes and returns the pending message,
+// or NULL if there is none.
+ROCCA_API rocca_sealer_msg* rocca_sealer_flush(rocca_sealer* p);
+
+// rocca_tuning holds the performance settings of the batch
+// APIs. Every setting produces the same output; only the speed
+// differs, and which setting is fastest depends on the host.
+//
+// The library starts with defaults that suit most hosts.
+// |rocca_autotune| measures the alternatives on the running host
+// instead.
+typedef struct rocca_tuning {
+    // backend names the implementation of the AES round that the
+    // library was compiled for. It is chosen at compile time and
+    // is ignored by |rocca_tuning_set|.
+    const char* backend;
+    // lanes is the number of messages whose states
+    // |rocca_session_seal_batch|, |rocca_seal_fanout|,
+    // |rocca_page_seal_batch| and |rocca_page_open_batch|
+    // interleave, between 1 and |ROCCA_TUNING_MAX_LANES|.
+    unsigned lanes;
+    // fanout_chunk is the number of bytes of input that
+    // |rocca_seal_fanout| feeds every recipient before moving on.
+    // It is a multiple of 32 between |ROCCA_TUNING_MIN_CHUNK| and
+    // |ROCCA_TUNING_MAX_CHUNK|.
+    size_t fanout_chunk;
+    // sealer_interleave is whether |rocca_sealer| finishes each
+    // message while initializing the next one. The two states
+    // do not fit in the registers of every host at once, so it is
+    // off by default. A sealer uses the setting in effect when it
+    // is created.
+    bool sealer_interleave;
+} rocca_tuning;
+
+enum {
+    // ROCCA_TUNING_MAX_LANES is the largest |lanes| in
+    // a |rocca_tuning|.
+    ROCCA_TUNING_MAX_LANES = 4,
+    // ROCCA_TUNING_MIN_CHUNK and ROCCA_TUNING_MAX_CHUNK bound
+    // |fanout_chunk| in a |rocca_tuning|.
+    ROCCA_TUNING_MIN_CHUNK = 1024,
+    ROCCA_TUNING_MAX_CHUNK = 1024 * 1024,
+};
+
+// rocca_tuning_get writes the current tuning to |tuning|.
+ROCCA_API void rocca_tuning_get(rocca_tuning* tuning);
+
+// rocca_tuning_set replaces the current tuning with |tuning|.
+//
+// It returns true on success and false if any setting is out of
+// range, in which case nothing is changed. It is safe to call
+// while other threads use the library: each setting is picked up
+// by the next call that uses it.
+ROCCA_API bool rocca_tuning_set(const rocca_tuning* tuning);
+
+// rocca_autotune picks the fastest tuning for the running host,
+// installs it with |rocca_tuning_set| and, unless |tuning| is
+// NULL, writes it to |tuning|.
+//
+// If |cache_path| is not NULL, the tuning is looked up in that
+// file first, keyed by the CPU model and |backend|. On a hit,
+// nothing is measured. Otherwise, each alternative is measured
+// for a few milliseconds and the result is added to the file, so
+// the file can be shared by hosts with different CPUs.
+//
+// It returns true on success and false if the measurements could
+// not run or the cache could not be written. In the first case
+// the tuning is unchanged; in the second it is still installed.
+//
+// The alternatives are measured on the calling thread only.
+// Other threads keep the current tuning until the result is
+// installed.
+//
+// It is intended to be called once at startup. The measurements
+// are less reliable if other threads are busy at the same time.
+ROCCA_API bool rocca_autotune(const char* cache_path, rocca_tuning* tuning);
 
 #endif // ROCCA_H
@@ -0,0 +1,138 @@
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/provider.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rocca.h"
+
+enum {
+    TEST_PASS = 0,
+    TEST_FAIL = 1,
+};
+
+// evp_seal seals |pt| with the provider, feeding the additional
+// data and plaintext in |chunk| byte pieces.
+static int evp_seal(EVP_CIPHER* cipher,
+                    const uint8_t* key,
+                    const uint8_t* nonce,
+                    const uint8_t* ad,
+                    size_t ad_len,
+                    const uint8_t* pt,
+                    size_t pt_len,
+                    size_t chunk,
+                    uint8_t* dst) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    int ok = ctx != NULL && EVP_EncryptInit_ex2(ctx, cipher, key, nonce, NULL);
+    int outl = 0;
+    for (size_t i = 0; ok && i < ad_len; i += chunk) {
+        size_t n = ad_len - i < chunk ? ad_len - i : chunk;
+        ok       = EVP_EncryptUpdate(ctx, NULL, &outl, &ad[i], (int)n);
+    }
+    for (size_t i = 0; ok && i < pt_len; i += chunk) {
+        size_t n = pt_len - i < chunk ? pt_len - i : chunk;
+        ok       = EVP_EncryptUpdate(ctx, &dst[i], &outl, &pt[i], (int)n) &&
+             (size_t)outl == n;
+    }
+    ok = ok && EVP_EncryptFinal_ex(ctx, &dst[pt_len], &outl) && outl == 0;
+    ok = ok && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, ROCCA_TAG_SIZE,
+                                   &dst[pt_len]);
+    EVP_CIPHER_CTX_free(ctx);
+    return ok;
+}
+
+static int evp_open(EVP_CIPHER* cipher,
+                    const uint8_t* key,
+                    const uint8_t* nonce,
+                    const uint8_t* ad,
+                    size_t ad_len,
+                    const uint8_t* ct,
+                    size_t ct_len,
+                    uint8_t* dst) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    size_t pt_len       = ct_len - ROCCA_TAG_SIZE;
+    int outl            = 0;
+    int ok = ctx != NULL && EVP_DecryptInit_ex2(ctx, cipher, key, nonce, NULL);
+    ok     = ok && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG,
+                                       ROCCA_TAG_SIZE, (void*)&ct[pt_len]);
+    ok     = ok && EVP_DecryptUpdate(ctx, NULL, &outl, ad, (int)ad_len);
+    ok     = ok && EVP_DecryptUpdate(ctx, dst, &outl, ct, (int)pt_len);
+    ok     = ok && EVP_DecryptFinal_ex(ctx, &dst[pt_len], &outl);
+    EVP_CIPHER_CTX_free(ctx);
+    return ok;
+}
+
+int main(void) {
+    OSSL_PROVIDER_set_default_search_path(NULL, ".");
+    OSSL_PROVIDER* prov = OSSL_PROVIDER_load(NULL, "rocca");
+    if (prov == NULL) {
+        fprintf(stderr, "unable to load the rocca provider\n");
+        return EXIT_FAILURE;
+    }
+    EVP_CIPHER* cipher = EVP_CIPHER_fetch(NULL, "ROCCA", NULL);
+    if (cipher == NULL) {
+        fprintf(stderr, "unable to fetch ROCCA\n");
+        return EXIT_FAILURE;
+    }
+    if (EVP_CIPHER_get_key_length(cipher) != ROCCA_KEY_SIZE ||
+        EVP_CIPHER_get_iv_length(cipher) != ROCCA_NONCE_SIZE ||
+        (EVP_CIPHER_get_flags(cipher) & EVP_CIPH_FLAG_AEAD_CIPHER) == 0) {
+        fprintf(stderr, "bad cipher parameters\n");
+        return EXIT_FAILURE;
+    }
+
+    uint8_t key[ROCCA_KEY_SIZE];
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+    uint8_t ad[77];
+    uint8_t pt[300];
+    for (size_t i = 0; i < sizeof(key); i++) {
+        key[i] = (uint8_t)(i * 7);
+    }
+    for (size_t i = 0; i < sizeof(nonce); i++) {
+        nonce[i] = (uint8_t)(i * 13);
+    }
+    for (size_t i = 0; i < sizeof(ad); i++) {
+        ad[i] = (uint8_t)(i * 3);
+    }
+    for (size_t i = 0; i < sizeof(pt); i++) {
+        pt[i] = (uint8_t)i;
+    }
+
+    int result                   = TEST_PASS;
+    static const size_t chunks[] = {1, 5, 32, 33, 1000};
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        uint8_t want[sizeof(pt) + ROCCA_OVERHEAD];
+        uint8_t got[sizeof(pt) + ROCCA_OVERHEAD];
+        uint8_t out[sizeof(pt) + ROCCA_OVERHEAD];
+        if (!rocca_seal(want, sizeof(want), key, sizeof(key), nonce,
+                        sizeof(nonce), pt, sizeof(pt), ad, sizeof(ad)) ||
+            !evp_seal(cipher, key, nonce, ad, sizeof(ad), pt, sizeof(pt),
+                      chunks[c], got) ||
+            memcmp(want, got, sizeof(want)) != 0) {
+            fprintf(stderr, "chunk %zu: EVP seal mismatch\n", chunks[c]);
+            result = TEST_FAIL;
+            continue;
+        }
+        if (!evp_open(cipher, key, nonce, ad, sizeof(ad), got, sizeof(got),
+                      out) ||
+            memcmp(out, pt, sizeof(pt)) != 0) {
+            fprintf(stderr, "chunk %zu: EVP open failed\n", chunks[c]);
+            result = TEST_FAIL;
+            continue;
+        }
+        got[sizeof(got) - 1] ^= 1;
+        if (evp_open(cipher, key, nonce, ad, sizeof(ad), got, sizeof(got),
+                     out)) {
+            fprintf(stderr, "chunk %zu: EVP open accepted a bad tag\n",
+                    chunks[c]);
+            result = TEST_FAIL;
+        }
+    }
+
+    EVP_CIPHER_free(cipher);
+    OSSL_PROVIDER_unload(prov);
+    fprintf(stderr, result == TEST_PASS ? "--- PASS provider\n"
+                                        : "--- FAIL provider\n");
+    return result == TEST_PASS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,441 @@
+// rocca_provider is an OpenSSL 3 provider that exposes Rocca as
+// the AEAD cipher "ROCCA" through the EVP interface.
+//
+// It is loaded with, for example:
+//
+//    openssl list -provider-path provider -provider rocca -cipher-algorithms
+//
+// or from openssl.cnf. Additional data is passed to
+// EVP_CipherUpdate with a NULL output buffer, and the tag is
+// set and retrieved with EVP_CTRL_AEAD_SET_TAG and
+// EVP_CTRL_AEAD_GET_TAG (or the "tag" parameter), exactly as
+// with AES-GCM.
+
+#include <openssl/core.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/params.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rocca.h"
+
+typedef struct prov_ctx {
+    rocca_ctx stream;
+    uint8_t key[ROCCA_KEY_SIZE];
+    uint8_t iv[ROCCA_NONCE_SIZE];
+    uint8_t tag[ROCCA_TAG_SIZE];
+    bool have_key;
+    bool have_iv;
+    // started is true once |stream| has been initialized with
+    // the key and IV.
+    bool started;
+    // have_tag is true once the tag has been computed (sealing)
+    // or provided by the caller (opening).
+    bool have_tag;
+    int enc;
+} prov_ctx;
+
+static void* prov_newctx(void* provctx) {
+    (void)provctx;
+    return OPENSSL_zalloc(sizeof(prov_ctx));
+}
+
+static void prov_freectx(void* vctx) {
+    OPENSSL_clear_free(vctx, sizeof(prov_ctx));
+}
+
+static void* prov_dupctx(void* vctx) {
+    prov_ctx* dup = OPENSSL_malloc(sizeof(prov_ctx));
+    if (dup != NULL) {
+        memcpy(dup, vctx, sizeof(prov_ctx));
+    }
+    return dup;
+}
+
+static int prov_init(void* vctx,
+                     const unsigned char* key,
+                     size_t keylen,
+                     const unsigned char* iv,
+                     size_t ivlen,
+                     const OSSL_PARAM params[],
+                     int enc);
+
+static int prov_set_ctx_params(void* vctx, const OSSL_PARAM params[]);
+
+static int prov_encrypt_init(void* vctx,
+                             const unsigned char* key,
+                             size_t keylen,
+                             const unsigned char* iv,
+                             size_t ivlen,
+                             const OSSL_PARAM params[]) {
+    return prov_init(vctx, key, keylen, iv, ivlen, params, 1);
+}
+
+static int prov_decrypt_init(void* vctx,
+                             const unsigned char* key,
+                             size_t keylen,
+                             const unsigned char* iv,
+                             size_t ivlen,
+                             const OSSL_PARAM params[]) {
+    return prov_init(vctx, key, keylen, iv, ivlen, params, 0);
+}
+
+// prov_init records the key and IV. Either may be provided in
+// a separate call; the stream starts once both are known.
+static int prov_init(void* vctx,
+                     const unsigned char* key,
+                     size_t keylen,
+                     const unsigned char* iv,
+                     size_t ivlen,
+                     const OSSL_PARAM params[],
+                     int enc) {
+    prov_ctx* ctx = vctx;
+    if (key != NULL) {
+        if (keylen != ROCCA_KEY_SIZE) {
+            return 0;
+        }
+        memcpy(ctx->key, key, ROCCA_KEY_SIZE);
+        ctx->have_key = true;
+    }
+    if (iv != NULL) {
+        if (ivlen != ROCCA_NONCE_SIZE) {
+            return 0;
+        }
+        memcpy(ctx->iv, iv, ROCCA_NONCE_SIZE);
+        ctx->have_iv = true;
+    }
+    ctx->enc      = enc;
+    ctx->started  = false;
+    ctx->have_tag = false;
+    OPENSSL_cleanse(&ctx->stream, sizeof(ctx->stream));
+    return prov_set_ctx_params(vctx, params);
+}
+
+static bool prov_start(prov_ctx* ctx) {
+    if (ctx->started) {
+        return true;
+    }
+    if (!ctx->have_key || !ctx->have_iv) {
+        return false;
+    }
+    bool ok;
+    if (ctx->enc) {
+        ok = rocca_seal_init(&ctx->stream, ctx->key, sizeof(ctx->key),
+                             ctx->iv, sizeof(ctx->iv));
+    } else {
+        ok = rocca_open_init(&ctx->stream, ctx->key, sizeof(ctx->key),
+                             ctx->iv, sizeof(ctx->iv));
+    }
+    ctx->started = ok;
+    return ok;
+}
+
+static int prov_update(void* vctx,
+                       unsigned char* out,
+                       size_t* outl,
+                       size_t outsize,
+                       const unsigned char* in,
+                       size_t inl) {
+    prov_ctx* ctx = vctx;
+    if (!prov_start(ctx)) {
+        return 0;
+    }
+    *outl = 0;
+    if (inl == 0) {
+        return 1;
+    }
+    // A NULL output buffer means that |in| is additional data.
+    if (out == NULL) {
+        return rocca_update_ad(&ctx->stream, in, inl);
+    }
+    if (outsize < inl) {
+        return 0;
+    }
+    bool ok;
+    if (ctx->enc) {
+        ok = rocca_seal_update(&ctx->stream, out, outsize, in, inl);
+    } else {
+        ok = rocca_open_update(&ctx->stream, out, outsize, in, inl);
+    }
+    if (!ok) {
+        return 0;
+    }
+    *outl = inl;
+    return 1;
+}
+
+static int prov_final(void* vctx,
+                      unsigned char* out,
+                      size_t* outl,
+                      size_t outsize) {
+    (void)out;
+    (void)outsize;
+    prov_ctx* ctx = vctx;
+    *outl         = 0;
+    if (!prov_start(ctx)) {
+        return 0;
+    }
+    ctx->started = false;
+    if (ctx->enc) {
+        ctx->have_tag =
+            rocca_seal_final(&ctx->stream, ctx->tag, sizeof(ctx->tag));
+        return ctx->have_tag;
+    }
+    if (!ctx->have_tag) {
+        OPENSSL_cleanse(&ctx->stream, sizeof(ctx->stream));
+        return 0;
+    }
+    return rocca_open_final(&ctx->stream, ctx->tag, sizeof(ctx->tag));
+}
+
+// prov_cipher implements EVP_Cipher: a NULL input finalizes
+// the message.
+static int prov_cipher(void* vctx,
+                       unsigned char* out,
+                       size_t* outl,
+                       size_t outsize,
+                       const unsigned char* in,
+                       size_t inl) {
+    if (in == NULL) {
+        return prov_final(vctx, out, outl, outsize);
+    }
+    return prov_update(vctx, out, outl, outsize, in, inl);
+}
+
+static int prov_get_params(OSSL_PARAM params[]) {
+    OSSL_PARAM* p;
+
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_MODE);
+    if (p != NULL && !OSSL_PARAM_set_uint(p, EVP_CIPH_STREAM_CIPHER)) {
+        return 0;
+    }
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_KEYLEN);
+    if (p != NULL && !OSSL_PARAM_set_size_t(p, ROCCA_KEY_SIZE)) {
+        return 0;
+    }
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_IVLEN);
+    if (p != NULL && !OSSL_PARAM_set_size_t(p, ROCCA_NONCE_SIZE)) {
+        return 0;
+    }
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_BLOCK_SIZE);
+    if (p != NULL && !OSSL_PARAM_set_size_t(p, 1)) {
+        return 0;
+    }
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_AEAD);
+    if (p != NULL && !OSSL_PARAM_set_int(p, 1)) {
+        return 0;
+    }
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_CUSTOM_IV);
+    if (p != NULL && !OSSL_PARAM_set_int(p, 0)) {
+        return 0;
+    }
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_CTS);
+    if (p != NULL && !OSSL_PARAM_set_int(p, 0)) {
+        return 0;
+    }
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_TLS1_MULTIBLOCK);
+    if (p != NULL && !OSSL_PARAM_set_int(p, 0)) {
+        return 0;
+    }
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_HAS_RAND_KEY);
+    if (p != NULL && !OSSL_PARAM_set_int(p, 0)) {
+        return 0;
+    }
+    return 1;
+}
+
+static const OSSL_PARAM* prov_gettable_params(void* provctx) {
+    (void)provctx;
+    static const OSSL_PARAM params[] = {
+        OSSL_PARAM_uint(OSSL_CIPHER_PARAM_MODE, NULL),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, NULL),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_IVLEN, NULL),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_BLOCK_SIZE, NULL),
+        OSSL_PARAM_int(OSSL_CIPHER_PARAM_AEAD, NULL),
+        OSSL_PARAM_int(OSSL_CIPHER_PARAM_CUSTOM_IV, NULL),
+        OSSL_PARAM_int(OSSL_CIPHER_PARAM_CTS, NULL),
+        OSSL_PARAM_int(OSSL_CIPHER_PARAM_TLS1_MULTIBLOCK, NULL),
+        OSSL_PARAM_int(OSSL_CIPHER_PARAM_HAS_RAND_KEY, NULL),
+        OSSL_PARAM_END,
+    };
+    return params;
+}
+
+static int prov_get_ctx_params(void* vctx, OSSL_PARAM params[]) {
+    prov_ctx* ctx = vctx;
+    OSSL_PARAM* p;
+
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_KEYLEN);
+    if (p != NULL && !OSSL_PARAM_set_size_t(p, ROCCA_KEY_SIZE)) {
+        return 0;
+    }
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_IVLEN);
+    if (p != NULL && !OSSL_PARAM_set_size_t(p, ROCCA_NONCE_SIZE)) {
+        return 0;
+    }
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_AEAD_TAGLEN);
+    if (p != NULL && !OSSL_PARAM_set_size_t(p, ROCCA_TAG_SIZE)) {
+        return 0;
+    }
+    p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_AEAD_TAG);
+    if (p != NULL) {
+        // The tag is only available after sealing.
+        if (!ctx->enc || !ctx->have_tag || p->data_size != ROCCA_TAG_SIZE ||
+            !OSSL_PARAM_set_octet_string(p, ctx->tag, ROCCA_TAG_SIZE)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static const OSSL_PARAM* prov_gettable_ctx_params(void* cctx, void* provctx) {
+    (void)cctx;
+    (void)provctx;
+    static const OSSL_PARAM params[] = {
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, NULL),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_IVLEN, NULL),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_AEAD_TAGLEN, NULL),
+        OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG, NULL, 0),
+        OSSL_PARAM_END,
+    };
+    return params;
+}
+
+static int prov_set_ctx_params(void* vctx, const OSSL_PARAM params[]) {
+    prov_ctx* ctx = vctx;
+    const OSSL_PARAM* p;
+
+    p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_AEAD_TAG);
+    if (p != NULL) {
+        if (p->data_type != OSSL_PARAM_OCTET_STRING ||
+            p->data_size != ROCCA_TAG_SIZE) {
+            return 0;
+        }
+        // Sealing only accepts the tag length; opening needs the
+        // expected tag.
+        if (p->data != NULL) {
+            if (ctx->enc) {
+                return 0;
+            }
+            memcpy(ctx->tag, p->data, ROCCA_TAG_SIZE);
+            ctx->have_tag = true;
+        }
+    }
+    p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_AEAD_IVLEN);
+    if (p != NULL) {
+        size_t ivlen;
+        if (!OSSL_PARAM_get_size_t(p, &ivlen) || ivlen != ROCCA_NONCE_SIZE) {
+            return 0;
+        }
+    }
+    p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_KEYLEN);
+    if (p != NULL) {
+        size_t keylen;
+        if (!OSSL_PARAM_get_size_t(p, &keylen) || keylen != ROCCA_KEY_SIZE) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static const OSSL_PARAM* prov_settable_ctx_params(void* cctx, void* provctx) {
+    (void)cctx;
+    (void)provctx;
+    static const OSSL_PARAM params[] = {
+        OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG, NULL, 0),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_AEAD_IVLEN, NULL),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, NULL),
+        OSSL_PARAM_END,
+    };
+    return params;
+}
+
+typedef void (*prov_fn)(void);
+
+static const OSSL_DISPATCH prov_cipher_functions[] = {
+    {OSSL_FUNC_CIPHER_NEWCTX, (prov_fn)prov_newctx},
+    {OSSL_FUNC_CIPHER_FREECTX, (prov_fn)prov_freectx},
+    {OSSL_FUNC_CIPHER_DUPCTX, (prov_fn)prov_dupctx},
+    {OSSL_FUNC_CIPHER_ENCRYPT_INIT, (prov_fn)prov_encrypt_init},
+    {OSSL_FUNC_CIPHER_DECRYPT_INIT, (prov_fn)prov_decrypt_init},
+    {OSSL_FUNC_CIPHER_UPDATE, (prov_fn)prov_update},
+    {OSSL_FUNC_CIPHER_FINAL, (prov_fn)prov_final},
+    {OSSL_FUNC_CIPHER_CIPHER, (prov_fn)prov_cipher},
+    {OSSL_FUNC_CIPHER_GET_PARAMS, (prov_fn)prov_get_params},
+    {OSSL_FUNC_CIPHER_GETTABLE_PARAMS, (prov_fn)prov_gettable_params},
+    {OSSL_FUNC_CIPHER_GET_CTX_PARAMS, (prov_fn)prov_get_ctx_params},
+    {OSSL_FUNC_CIPHER_GETTABLE_CTX_PARAMS,
+     (prov_fn)prov_gettable_ctx_params},
+    {OSSL_FUNC_CIPHER_SET_CTX_PARAMS, (prov_fn)prov_set_ctx_params},
+    {OSSL_FUNC_CIPHER_SETTABLE_CTX_PARAMS,
+     (prov_fn)prov_settable_ctx_params},
+    {0, NULL},
+};
+
+static const OSSL_ALGORITHM prov_ciphers[] = {
+    {"ROCCA", "provider=rocca", prov_cipher_functions, "Rocca AEAD"},
+    {NULL, NULL, NULL, NULL},
+};
+
+static const OSSL_ALGORITHM* prov_query(void* provctx,
+                                        int operation_id,
+                                        int* no_cache) {
+    (void)provctx;
+    *no_cache = 0;
+    if (operation_id == OSSL_OP_CIPHER) {
+        return prov_ciphers;
+    }
+    return NULL;
+}
+
+static int provider_get_params(void* provctx, OSSL_PARAM params[]) {
+    (void)provctx;
+    OSSL_PARAM* p;
+
+    p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_NAME);
+    if (p != NULL && !OSSL_PARAM_set_utf8_ptr(p, "Rocca provider")) {
+        return 0;
+    }
+    p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_STATUS);
+    if (p != NULL && !OSSL_PARAM_set_int(p, 1)) {
+        return 0;
+    }
+    return 1;
+}
+
+static const OSSL_PARAM* provider_gettable_params(void* provctx) {
+    (void)provctx;
+    static const OSSL_PARAM params[] = {
+        OSSL_PARAM_utf8_ptr(OSSL_PROV_PARAM_NAME, NULL, 0),
+        OSSL_PARAM_int(OSSL_PROV_PARAM_STATUS, NULL),
+        OSSL_PARAM_END,
+    };
+    return params;
+}
+
+static void prov_teardown(void* provctx) {
+    (void)provctx;
+}
+
+static const OSSL_DISPATCH prov_provider_functions[] = {
+    {OSSL_FUNC_PROVIDER_TEARDOWN, (prov_fn)prov_teardown},
+    {OSSL_FUNC_PROVIDER_QUERY_OPERATION, (prov_fn)prov_query},
+    {OSSL_FUNC_PROVIDER_GET_PARAMS, (prov_fn)provider_get_params},
+    {OSSL_FUNC_PROVIDER_GETTABLE_PARAMS,
+     (prov_fn)provider_gettable_params},
+    {0, NULL},
+};
+
+OPENSSL_EXPORT int OSSL_provider_init(const OSSL_CORE_HANDLE* handle,
+                                      const OSSL_DISPATCH* in,
+                                      const OSSL_DISPATCH** out,
+                                      void** provctx) {
+    (void)in;
+    *out     = prov_provider_functions;
+    *provctx = (void*)handle;
+    return 1;
+}
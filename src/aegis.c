@@ -0,0 +1,513 @@
+#include "aegis.h"
+
+#include "rocca_impl.h"
+
+// C0: A constant block defined as C0 = 000101020305080d1522375990e97962.
+static const uint8_t C0[16] = {
+    0x00, 0x01, 0x01, 0x02, 0x03, 0x05, 0x08, 0x0d,
+    0x15, 0x22, 0x37, 0x59, 0x90, 0xe9, 0x79, 0x62,
+};
+
+// C1: A constant block defined as C1 = db3d18556dc22ff12011314273b528dd.
+static const uint8_t C1[16] = {
+    0xdb, 0x3d, 0x18, 0x55, 0x6d, 0xc2, 0x2f, 0xf1,
+    0x20, 0x11, 0x31, 0x42, 0x73, 0xb5, 0x28, 0xdd,
+};
+
+enum {
+    // AEGIS128L_BLOCK_SIZE is the size of one AEGIS-128L block.
+    AEGIS128L_BLOCK_SIZE = 32,
+    // AEGIS256_BLOCK_SIZE is the size of one AEGIS-256 block.
+    AEGIS256_BLOCK_SIZE = 16,
+    // AEGIS_FINAL_ROUNDS is the number of state updates
+    // performed by the finalization of both variants.
+    AEGIS_FINAL_ROUNDS = 7,
+};
+
+// aegis_lengths returns LE64(ad_len_bits) || LE64(msg_len_bits).
+static u128 aegis_lengths(uint64_t additional_data_len, uint64_t msg_len) {
+    uint8_t buf[16];
+    put_le64(&buf[0], additional_data_len * 8);
+    put_le64(&buf[8], msg_len * 8);
+    return load_u128(buf);
+}
+
+typedef u128 aegis128l_state[8];
+
+static void aegis128l_update(aegis128l_state s, u128 m0, u128 m1) {
+    u128 t0 = aes_round(s[7], xor_u128(s[0], m0));
+    u128 t1 = aes_round(s[0], s[1]);
+    u128 t2 = aes_round(s[1], s[2]);
+    u128 t3 = aes_round(s[2], s[3]);
+    u128 t4 = aes_round(s[3], xor_u128(s[4], m1));
+    u128 t5 = aes_round(s[4], s[5]);
+    u128 t6 = aes_round(s[5], s[6]);
+    u128 t7 = aes_round(s[6], s[7]);
+
+    s[0] = t0;
+    s[1] = t1;
+    s[2] = t2;
+    s[3] = t3;
+    s[4] = t4;
+    s[5] = t5;
+    s[6] = t6;
+    s[7] = t7;
+}
+
+static void aegis128l_init(aegis128l_state s,
+                           const uint8_t key[AEGIS128L_KEY_SIZE],
+                           const uint8_t nonce[AEGIS128L_NONCE_SIZE]) {
+    u128 c0 = load_u128(C0);
+    u128 c1 = load_u128(C1);
+    u128 k  = load_u128(key);
+    u128 n  = load_u128(nonce);
+    u128 kn = xor_u128(k, n);
+
+    s[0] = kn;
+    s[1] = c1;
+    s[2] = c0;
+    s[3] = c1;
+    s[4] = kn;
+    s[5] = xor_u128(k, c0);
+    s[6] = xor_u128(k, c1);
+    s[7] = xor_u128(k, c0);
+
+    for (int i = 0; i < 10; i++) {
+        aegis128l_update(s, n, k);
+    }
+}
+
+// aegis128l_keystream writes the keystream for the next block
+// to |z0| and |z1|.
+static void aegis128l_keystream(const aegis128l_state s, u128* z0, u128* z1) {
+    // z0 = S6 ^ S1 ^ (S2 & S3)
+    *z0 = xor_u128(xor_u128(s[6], s[1]), and_u128(s[2], s[3]));
+    // z1 = S2 ^ S5 ^ (S6 & S7)
+    *z1 = xor_u128(xor_u128(s[2], s[5]), and_u128(s[6], s[7]));
+}
+
+static void aegis128l_absorb(aegis128l_state s,
+                             const uint8_t* additional_data,
+                             size_t additional_data_len) {
+    size_t nblocks = additional_data_len / AEGIS128L_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        const uint8_t* p = &additional_data[i * AEGIS128L_BLOCK_SIZE];
+        aegis128l_update(s, load_u128(&p[0]), load_u128(&p[16]));
+    }
+    size_t remain = additional_data_len % AEGIS128L_BLOCK_SIZE;
+    if (remain != 0) {
+        uint8_t tmp[AEGIS128L_BLOCK_SIZE] = {0};
+        memcpy(tmp, &additional_data[nblocks * AEGIS128L_BLOCK_SIZE], remain);
+        aegis128l_update(s, load_u128(&tmp[0]), load_u128(&tmp[16]));
+    }
+}
+
+static void aegis128l_enc(aegis128l_state s,
+                          uint8_t dst[AEGIS128L_BLOCK_SIZE],
+                          const uint8_t src[AEGIS128L_BLOCK_SIZE]) {
+    u128 z0, z1;
+    aegis128l_keystream(s, &z0, &z1);
+    u128 m0 = load_u128(&src[0]);
+    u128 m1 = load_u128(&src[16]);
+    store_u128(&dst[0], xor_u128(m0, z0));
+    store_u128(&dst[16], xor_u128(m1, z1));
+    aegis128l_update(s, m0, m1);
+}
+
+static void aegis128l_dec(aegis128l_state s,
+                          uint8_t dst[AEGIS128L_BLOCK_SIZE],
+                          const uint8_t src[AEGIS128L_BLOCK_SIZE]) {
+    u128 z0, z1;
+    aegis128l_keystream(s, &z0, &z1);
+    u128 m0 = xor_u128(load_u128(&src[0]), z0);
+    u128 m1 = xor_u128(load_u128(&src[16]), z1);
+    store_u128(&dst[0], m0);
+    store_u128(&dst[16], m1);
+    aegis128l_update(s, m0, m1);
+}
+
+static u128 aegis128l_mac(aegis128l_state s,
+                          uint64_t additional_data_len,
+                          uint64_t msg_len) {
+    u128 t = xor_u128(s[2], aegis_lengths(additional_data_len, msg_len));
+    for (int i = 0; i < AEGIS_FINAL_ROUNDS; i++) {
+        aegis128l_update(s, t, t);
+    }
+    u128 tag = s[0];
+    for (int i = 1; i < 7; i++) {
+        tag = xor_u128(tag, s[i]);
+    }
+    return tag;
+}
+
+typedef u128 aegis256_state[6];
+
+static void aegis256_update(aegis256_state s, u128 m) {
+    u128 t0 = aes_round(s[5], xor_u128(s[0], m));
+    u128 t1 = aes_round(s[0], s[1]);
+    u128 t2 = aes_round(s[1], s[2]);
+    u128 t3 = aes_round(s[2], s[3]);
+    u128 t4 = aes_round(s[3], s[4]);
+    u128 t5 = aes_round(s[4], s[5]);
+
+    s[0] = t0;
+    s[1] = t1;
+    s[2] = t2;
+    s[3] = t3;
+    s[4] = t4;
+    s[5] = t5;
+}
+
+static void aegis256_init(aegis256_state s,
+                          const uint8_t key[AEGIS256_KEY_SIZE],
+                          const uint8_t nonce[AEGIS256_NONCE_SIZE]) {
+    u128 c0  = load_u128(C0);
+    u128 c1  = load_u128(C1);
+    u128 k0  = load_u128(&key[0]);
+    u128 k1  = load_u128(&key[16]);
+    u128 k0n = xor_u128(k0, load_u128(&nonce[0]));
+    u128 k1n = xor_u128(k1, load_u128(&nonce[16]));
+
+    s[0] = k0n;
+    s[1] = k1n;
+    s[2] = c1;
+    s[3] = c0;
+    s[4] = xor_u128(k0, c0);
+    s[5] = xor_u128(k1, c1);
+
+    for (int i = 0; i < 4; i++) {
+        aegis256_update(s, k0);
+        aegis256_update(s, k1);
+        aegis256_update(s, k0n);
+        aegis256_update(s, k1n);
+    }
+}
+
+// aegis256_keystream returns the keystream for the next block.
+static u128 aegis256_keystream(const aegis256_state s) {
+    // z = S1 ^ S4 ^ S5 ^ (S2 & S3)
+    u128 z = xor_u128(s[1], s[4]);
+    z      = xor_u128(z, s[5]);
+    return xor_u128(z, and_u128(s[2], s[3]));
+}
+
+static void aegis256_absorb(aegis256_state s,
+                            const uint8_t* additional_data,
+                            size_t additional_data_len) {
+    size_t nblocks = additional_data_len / AEGIS256_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        aegis256_update(s,
+                        load_u128(&additional_data[i * AEGIS256_BLOCK_SIZE]));
+    }
+    size_t remain = additional_data_len % AEGIS256_BLOCK_SIZE;
+    if (remain != 0) {
+        uint8_t tmp[AEGIS256_BLOCK_SIZE] = {0};
+        memcpy(tmp, &additional_data[nblocks * AEGIS256_BLOCK_SIZE], remain);
+        aegis256_update(s, load_u128(tmp));
+    }
+}
+
+static void aegis256_enc(aegis256_state s,
+                         uint8_t dst[AEGIS256_BLOCK_SIZE],
+                         const uint8_t src[AEGIS256_BLOCK_SIZE]) {
+    u128 z = aegis256_keystream(s);
+    u128 m = load_u128(src);
+    store_u128(dst, xor_u128(m, z));
+    aegis256_update(s, m);
+}
+
+static void aegis256_dec(aegis256_state s,
+                         uint8_t dst[AEGIS256_BLOCK_SIZE],
+                         const uint8_t src[AEGIS256_BLOCK_SIZE]) {
+    u128 m = xor_u128(load_u128(src), aegis256_keystream(s));
+    store_u128(dst, m);
+    aegis256_update(s, m);
+}
+
+static u128 aegis256_mac(aegis256_state s,
+                         uint64_t additional_data_len,
+                         uint64_t msg_len) {
+    u128 t = xor_u128(s[3], aegis_lengths(additional_data_len, msg_len));
+    for (int i = 0; i < AEGIS_FINAL_ROUNDS; i++) {
+        aegis256_update(s, t);
+    }
+    u128 tag = s[0];
+    for (int i = 1; i < 6; i++) {
+        tag = xor_u128(tag, s[i]);
+    }
+    return tag;
+}
+
+// aegis_seal_args_ok reports whether the arguments to a seal
+// function are valid, zeroing |dst| if they are not.
+static bool aegis_seal_args_ok(uint8_t* dst,
+                               size_t dst_len,
+                               const uint8_t* key,
+                               size_t key_len,
+                               size_t want_key_len,
+                               const uint8_t* nonce,
+                               size_t nonce_len,
+                               size_t want_nonce_len,
+                               const uint8_t* plaintext,
+                               size_t plaintext_len,
+                               const uint8_t* additional_data,
+                               size_t additional_data_len,
+                               size_t overhead) {
+    if (dst == NULL) {
+        return false;
+    }
+    if ((SIZE_MAX - plaintext_len) < overhead ||
+        dst_len < plaintext_len + overhead) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if (key == NULL || key_len != want_key_len) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if (nonce == NULL || nonce_len != want_nonce_len) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if (((plaintext == NULL) != (plaintext_len == 0)) ||
+        ((additional_data == NULL) != (additional_data_len == 0))) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    return true;
+}
+
+// aegis_open_args_ok is |aegis_seal_args_ok| for open
+// functions.
+static bool aegis_open_args_ok(uint8_t* dst,
+                               size_t dst_len,
+                               const uint8_t* key,
+                               size_t key_len,
+                               size_t want_key_len,
+                               const uint8_t* nonce,
+                               size_t nonce_len,
+                               size_t want_nonce_len,
+                               const uint8_t* ciphertext,
+                               size_t ciphertext_len,
+                               const uint8_t* additional_data,
+                               size_t additional_data_len,
+                               size_t overhead) {
+    if (dst == NULL) {
+        return false;
+    }
+    if (ciphertext == NULL || ciphertext_len < overhead ||
+        dst_len < ciphertext_len - overhead) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if (key == NULL || key_len != want_key_len) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if (nonce == NULL || nonce_len != want_nonce_len) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if ((additional_data == NULL) != (additional_data_len == 0)) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    return true;
+}
+
+bool aegis128l_seal(uint8_t* dst,
+                    size_t dst_len,
+                    const uint8_t key[AEGIS128L_KEY_SIZE],
+                    size_t key_len,
+                    const uint8_t nonce[AEGIS128L_NONCE_SIZE],
+                    size_t nonce_len,
+                    const uint8_t* plaintext,
+                    size_t plaintext_len,
+                    const uint8_t* additional_data,
+                    size_t additional_data_len) {
+    if (!aegis_seal_args_ok(dst, dst_len, key, key_len, AEGIS128L_KEY_SIZE,
+                            nonce, nonce_len, AEGIS128L_NONCE_SIZE, plaintext,
+                            plaintext_len, additional_data,
+                            additional_data_len, AEGIS128L_OVERHEAD)) {
+        return false;
+    }
+
+    aegis128l_state s;
+    aegis128l_init(s, key, nonce);
+    aegis128l_absorb(s, additional_data, additional_data_len);
+
+    // Encrypt full blocks.
+    size_t nblocks = plaintext_len / AEGIS128L_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        aegis128l_enc(s, &dst[i * AEGIS128L_BLOCK_SIZE],
+                      &plaintext[i * AEGIS128L_BLOCK_SIZE]);
+    }
+
+    // Encrypt a partial block.
+    size_t remain = plaintext_len % AEGIS128L_BLOCK_SIZE;
+    if (remain != 0) {
+        uint8_t tmp[AEGIS128L_BLOCK_SIZE] = {0};
+        memcpy(tmp, &plaintext[nblocks * AEGIS128L_BLOCK_SIZE], remain);
+        aegis128l_enc(s, tmp, tmp);
+        memcpy(&dst[nblocks * AEGIS128L_BLOCK_SIZE], tmp, remain);
+        memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+    }
+
+    u128 tag = aegis128l_mac(s, additional_data_len, plaintext_len);
+    store_u128(&dst[plaintext_len], tag);
+    memset_s(s, sizeof(s), 0, sizeof(s));
+    return true;
+}
+
+bool aegis128l_open(uint8_t* dst,
+                    size_t dst_len,
+                    const uint8_t key[AEGIS128L_KEY_SIZE],
+                    size_t key_len,
+                    const uint8_t nonce[AEGIS128L_NONCE_SIZE],
+                    size_t nonce_len,
+                    const uint8_t* ciphertext,
+                    size_t ciphertext_len,
+                    const uint8_t* additional_data,
+                    size_t additional_data_len) {
+    if (!aegis_open_args_ok(dst, dst_len, key, key_len, AEGIS128L_KEY_SIZE,
+                            nonce, nonce_len, AEGIS128L_NONCE_SIZE,
+                            ciphertext, ciphertext_len, additional_data,
+                            additional_data_len, AEGIS128L_OVERHEAD)) {
+        return false;
+    }
+
+    ciphertext_len -= AEGIS128L_TAG_SIZE;
+    u128 tag = load_u128(&ciphertext[ciphertext_len]);
+
+    aegis128l_state s;
+    aegis128l_init(s, key, nonce);
+    aegis128l_absorb(s, additional_data, additional_data_len);
+
+    // Decrypt full blocks.
+    size_t nblocks = ciphertext_len / AEGIS128L_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        aegis128l_dec(s, &dst[i * AEGIS128L_BLOCK_SIZE],
+                      &ciphertext[i * AEGIS128L_BLOCK_SIZE]);
+    }
+
+    // Decrypt a partial block. The plaintext is zero padded
+    // before it is absorbed.
+    size_t remain = ciphertext_len % AEGIS128L_BLOCK_SIZE;
+    if (remain != 0) {
+        uint8_t tmp[AEGIS128L_BLOCK_SIZE] = {0};
+        u128 z0, z1;
+        aegis128l_keystream(s, &z0, &z1);
+        memcpy(tmp, &ciphertext[nblocks * AEGIS128L_BLOCK_SIZE], remain);
+        store_u128(&tmp[0], xor_u128(load_u128(&tmp[0]), z0));
+        store_u128(&tmp[16], xor_u128(load_u128(&tmp[16]), z1));
+        memset(&tmp[remain], 0, sizeof(tmp) - remain);
+        memcpy(&dst[nblocks * AEGIS128L_BLOCK_SIZE], tmp, remain);
+        aegis128l_update(s, load_u128(&tmp[0]), load_u128(&tmp[16]));
+        memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+    }
+
+    u128 expectedTag = aegis128l_mac(s, additional_data_len, ciphertext_len);
+    memset_s(s, sizeof(s), 0, sizeof(s));
+    if (!constant_time_compare_u128(tag, expectedTag)) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    return true;
+}
+
+bool aegis256_seal(uint8_t* dst,
+                   size_t dst_len,
+                   const uint8_t key[AEGIS256_KEY_SIZE],
+                   size_t key_len,
+                   const uint8_t nonce[AEGIS256_NONCE_SIZE],
+                   size_t nonce_len,
+                   const uint8_t* plaintext,
+                   size_t plaintext_len,
+                   const uint8_t* additional_data,
+                   size_t additional_data_len) {
+    if (!aegis_seal_args_ok(dst, dst_len, key, key_len, AEGIS256_KEY_SIZE,
+                            nonce, nonce_len, AEGIS256_NONCE_SIZE, plaintext,
+                            plaintext_len, additional_data,
+                            additional_data_len, AEGIS256_OVERHEAD)) {
+        return false;
+    }
+
+    aegis256_state s;
+    aegis256_init(s, key, nonce);
+    aegis256_absorb(s, additional_data, additional_data_len);
+
+    // Encrypt full blocks.
+    size_t nblocks = plaintext_len / AEGIS256_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        aegis256_enc(s, &dst[i * AEGIS256_BLOCK_SIZE],
+                     &plaintext[i * AEGIS256_BLOCK_SIZE]);
+    }
+
+    // Encrypt a partial block.
+    size_t remain = plaintext_len % AEGIS256_BLOCK_SIZE;
+    if (remain != 0) {
+        uint8_t tmp[AEGIS256_BLOCK_SIZE] = {0};
+        memcpy(tmp, &plaintext[nblocks * AEGIS256_BLOCK_SIZE], remain);
+        aegis256_enc(s, tmp, tmp);
+        memcpy(&dst[nblocks * AEGIS256_BLOCK_SIZE], tmp, remain);
+        memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+    }
+
+    u128 tag = aegis256_mac(s, additional_data_len, plaintext_len);
+    store_u128(&dst[plaintext_len], tag);
+    memset_s(s, sizeof(s), 0, sizeof(s));
+    return true;
+}
+
+bool aegis256_open(uint8_t* dst,
+                   size_t dst_len,
+                   const uint8_t key[AEGIS256_KEY_SIZE],
+                   size_t key_len,
+                   const uint8_t nonce[AEGIS256_NONCE_SIZE],
+                   size_t nonce_len,
+                   const uint8_t* ciphertext,
+                   size_t ciphertext_len,
+                   const uint8_t* additional_data,
+                   size_t additional_data_len) {
+    if (!aegis_open_args_ok(dst, dst_len, key, key_len, AEGIS256_KEY_SIZE,
+                            nonce, nonce_len, AEGIS256_NONCE_SIZE, ciphertext,
+                            ciphertext_len, additional_data,
+                            additional_data_len, AEGIS256_OVERHEAD)) {
+        return false;
+    }
+
+    ciphertext_len -= AEGIS256_TAG_SIZE;
+    u128 tag = load_u128(&ciphertext[ciphertext_len]);
+
+    aegis256_state s;
+    aegis256_init(s, key, nonce);
+    aegis256_absorb(s, additional_data, additional_data_len);
+
+    // Decrypt full blocks.
+    size_t nblocks = ciphertext_len / AEGIS256_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        aegis256_dec(s, &dst[i * AEGIS256_BLOCK_SIZE],
+                     &ciphertext[i * AEGIS256_BLOCK_SIZE]);
+    }
+
+    // Decrypt a partial block. The plaintext is zero padded
+    // before it is absorbed.
+    size_t remain = ciphertext_len % AEGIS256_BLOCK_SIZE;
+    if (remain != 0) {
+        uint8_t tmp[AEGIS256_BLOCK_SIZE] = {0};
+        memcpy(tmp, &ciphertext[nblocks * AEGIS256_BLOCK_SIZE], remain);
+        store_u128(tmp, xor_u128(load_u128(tmp), aegis256_keystream(s)));
+        memset(&tmp[remain], 0, sizeof(tmp) - remain);
+        memcpy(&dst[nblocks * AEGIS256_BLOCK_SIZE], tmp, remain);
+        aegis256_update(s, load_u128(tmp));
+        memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+    }
+
+    u128 expectedTag = aegis256_mac(s, additional_data_len, ciphertext_len);
+    memset_s(s, sizeof(s), 0, sizeof(s));
+    if (!constant_time_compare_u128(tag, expectedTag)) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    return true;
+}
@@ -1,190 +1,6 @@
 #include "rocca.h"
 
-#define __STDC_WANT_LIB_EXT1__ 1
-#include <stdint.h>
-#include <stdlib.h>
-#include <string.h>
-
-#if defined(__SSE2__) && defined(__AES__)
-#include "rocca_amd64.h"
-#elif defined(__ARM_NEON) && defined(__ARM_FEATURE_CRYPTO)
-#include "rocca_arm64.h"
-#else
-#error "TODO"
-#endif // defined(__SSE2__) && defined(__AES__)
-
-enum {
-    // ROCCA_ROUNDS is the number of state update rounds performed by
-    // |rocca_init| and |rocca_mac|.
-    ROCCA_ROUNDS = 20,
-    // ROCCA_BLOCK_SIZE is the size of one Rocca block.
-    ROCCA_BLOCK_SIZE = 32,
-};
-
-// Z0: A constant block defined as Z0 = 428a2f98d728ae227137449123ef65cd.
-static const uint8_t Z0[16] = {
-    0xcd, 0x65, 0xef, 0x23, 0x91, 0x44, 0x37, 0x71,
-    0x22, 0xae, 0x28, 0xd7, 0x98, 0x2f, 0x8a, 0x42,
-};
-
-// Z1: A constant block defined as Z1 = b5c0fbcfec4d3b2fe9b5dba58189dbbc.
-static const uint8_t Z1[16] = {
-    0xbc, 0xdb, 0x89, 0x81, 0xa5, 0xdb, 0xb5, 0xe9,
-    0x2f, 0x3b, 0x4d, 0xec, 0xcf, 0xfb, 0xc0, 0xb5,
-};
-
-typedef u128 rocca_state[8];
-
-static void rocca_update(rocca_state s, u128 x0, u128 x1) {
-    u128 t0 = xor_u128(s[7], x0);    // Snew[0] = S[7] ⊕ X0
-    u128 t1 = aes_round(s[0], s[7]); // Snew[1] = AES(S[0], S[7])
-    u128 t2 = xor_u128(s[1], s[6]);  // Snew[2] = S[1] ⊕ S[6]
-    u128 t3 = aes_round(s[2], s[1]); // Snew[3] = AES(S[2], S[1])
-    u128 t4 = xor_u128(s[3], x1);    // Snew[4] = S[3] ⊕ X1
-    u128 t5 = aes_round(s[4], s[3]); // Snew[5] = AES(S[4], S[3])
-    u128 t6 = aes_round(s[5], s[4]); // Snew[6] = AES(S[5], S[4])
-    u128 t7 = xor_u128(s[0], s[6]);  // Snew[7] = S[0] ⊕ S[6]
-
-    s[0] = t0;
-    s[1] = t1;
-    s[2] = t2;
-    s[3] = t3;
-    s[4] = t4;
-    s[5] = t5;
-    s[6] = t6;
-    s[7] = t7;
-}
-
-static void rocca_init(rocca_state s,
-                       const uint8_t key[ROCCA_KEY_SIZE],
-                       const uint8_t nonce[ROCCA_NONCE_SIZE]) {
-    u128 z0 = load_u128(Z0);
-    u128 z1 = load_u128(Z1);
-    u128 k0 = load_u128(&key[0]);
-    u128 k1 = load_u128(&key[ROCCA_KEY_SIZE / 2]);
-    u128 N  = load_u128(nonce);
-
-    // First, (N,K0,K1) is loaded into the state S in the
-    // following way:
-    s[0] = k1;              // S[0] = K1
-    s[1] = N;               // S[1] = N
-    s[2] = z0;              // S[2] = Z0
-    s[3] = z1;              // S[3] = Z1
-    s[4] = xor_u128(N, k1); // S[4] = N ⊕ K1
-    s[5] = zero_u128();     // S[5] = 0
-    s[6] = k0;              // S[6] = K0
-    s[7] = zero_u128();     // S[7] = 0
-
-    // Then, 20 iterations of the round function R(S,Z0,Z1) is
-    // applied to the state S.
-    for (int i = 0; i < ROCCA_ROUNDS; i++) {
-        rocca_update(s, z0, z1);
-    }
-}
-
-static void rocca_enc(rocca_state s,
-                      uint8_t dst[ROCCA_BLOCK_SIZE],
-                      const uint8_t src[ROCCA_BLOCK_SIZE]) {
-    u128 m0 = load_u128(&src[0]);
-    u128 m1 = load_u128(&src[ROCCA_BLOCK_SIZE / 2]);
-
-    // Ci0 = AES(S[1], S[5]) ⊕ M0i
-    u128 c0 = aes_round(s[1], s[5]);
-    c0      = xor_u128(c0, m0);
-
-    // Ci1 = AES(S[0] ⊕ S[4], S[2]) ⊕ M1i
-    u128 c1 = xor_u128(s[0], s[4]);
-    c1      = aes_round(c1, s[2]);
-    c1      = xor_u128(c1, m1);
-
-    store_u128(&dst[0], c0);
-    store_u128(&dst[ROCCA_BLOCK_SIZE / 2], c1);
-
-    // R(S, Mi0, Mi1)
-    rocca_update(s, m0, m1);
-}
-
-static void rocca_dec(rocca_state s,
-                      uint8_t dst[ROCCA_BLOCK_SIZE],
-                      const uint8_t src[ROCCA_BLOCK_SIZE]) {
-    u128 c0 = load_u128(&src[0]);
-    u128 c1 = load_u128(&src[ROCCA_BLOCK_SIZE / 2]);
-
-    u128 m0 = aes_round(s[1], s[5]);
-    m0      = xor_u128(m0, c0);
-
-    u128 m1 = xor_u128(s[0], s[4]);
-    m1      = aes_round(m1, s[2]);
-    m1      = xor_u128(m1, c1);
-
-    store_u128(&dst[0], m0);
-    store_u128(&dst[ROCCA_BLOCK_SIZE / 2], m1);
-
-    rocca_update(s, m0, m1);
-}
-
-static void rocca_dec_partial(rocca_state s,
-                              uint8_t* dst,
-                              size_t dst_len,
-                              const uint8_t src[ROCCA_BLOCK_SIZE]) {
-    u128 c0 = load_u128(&src[0]);
-    u128 c1 = load_u128(&src[ROCCA_BLOCK_SIZE / 2]);
-
-    u128 m0 = aes_round(s[1], s[5]);
-    m0      = xor_u128(m0, c0);
-
-    u128 m1 = xor_u128(s[0], s[4]);
-    m1      = aes_round(m1, s[2]);
-    m1      = xor_u128(m1, c1);
-
-    uint8_t pad[ROCCA_BLOCK_SIZE] = {0};
-    store_u128(&pad[0], m0);
-    store_u128(&pad[ROCCA_BLOCK_SIZE / 2], m1);
-    memset(&pad[dst_len], 0, sizeof(pad) - dst_len);
-    memcpy(dst, pad, dst_len);
-
-    u128 p0 = load_u128(&pad[0]);
-    u128 p1 = load_u128(&pad[ROCCA_BLOCK_SIZE / 2]);
-    rocca_update(s, p0, p1);
-}
-
-static void put_le64(uint8_t* b, uint64_t v) {
-    b[0] = (uint8_t)(v);
-    b[1] = (uint8_t)(v >> 8);
-    b[2] = (uint8_t)(v >> 16);
-    b[3] = (uint8_t)(v >> 24);
-    b[4] = (uint8_t)(v >> 32);
-    b[5] = (uint8_t)(v >> 40);
-    b[6] = (uint8_t)(v >> 48);
-    b[7] = (uint8_t)(v >> 56);
-}
-
-static u128 rocca_mac(rocca_state s,
-                      uint64_t additional_data_len,
-                      uint64_t plaintext_len) {
-    uint8_t buf[16] = {0};
-
-    put_le64(buf, additional_data_len * 8);
-    u128 ad = load_u128(buf);
-
-    put_le64(buf, plaintext_len * 8);
-    u128 pt = load_u128(buf);
-
-    //  for i = 0 to 19 do
-    //    S ← R(S, |AD|, |M|)
-    for (int i = 0; i < ROCCA_ROUNDS; i++) {
-        rocca_update(s, ad, pt);
-    }
-
-    //  T ← 0
-    //  for i = 0 to 7 do
-    //    T ← T ⊕ S[i]
-    u128 tag = s[0];
-    for (int i = 1; i < 8; i++) {
-        tag = xor_u128(tag, s[i]);
-    }
-    return tag;
-}
+#include "rocca_impl.h"
 
 bool rocca_seal(uint8_t* dst,
                 size_t dst_len,
@@ -199,7 +15,8 @@ bool rocca_seal(uint8_t* dst,
     if (dst == NULL) {
         return false;
     }
-    if ((SIZE_MAX - plaintext_len) < ROCCA_OVERHEAD) {
+    if ((SIZE_MAX - plaintext_len) < ROCCA_OVERHEAD ||
+        dst_len < plaintext_len + ROCCA_OVERHEAD) {
         memset_s(dst, dst_len, 0, dst_len);
         return false;
     }
@@ -219,48 +36,9 @@ bool rocca_seal(uint8_t* dst,
 
     rocca_state s = {0};
     rocca_init(s, key, nonce);
-
-    uint8_t tmp[ROCCA_BLOCK_SIZE] = {0};
-
-    // Authenticate full blocks.
-    size_t nblocks = additional_data_len / ROCCA_BLOCK_SIZE;
-    for (size_t i = 0; i < nblocks; i++) {
-        u128 a0 = load_u128(&additional_data[i * ROCCA_BLOCK_SIZE]);
-        u128 a1 = load_u128(
-            &additional_data[i * ROCCA_BLOCK_SIZE + ROCCA_BLOCK_SIZE / 2]);
-        rocca_update(s, a0, a1);
-    }
-
-    // Authenticate a partial block.
-    size_t remain = additional_data_len % ROCCA_BLOCK_SIZE;
-    if (remain != 0) {
-        memset(tmp, 0, sizeof(tmp));
-        memcpy(tmp, additional_data, remain);
-        u128 a0 = load_u128(&tmp[0]);
-        u128 a1 = load_u128(&tmp[ROCCA_BLOCK_SIZE / 2]);
-        rocca_update(s, a0, a1);
-    }
-
-    // Encrypt full blocks.
-    nblocks = plaintext_len / ROCCA_BLOCK_SIZE;
-    for (size_t i = 0; i < nblocks; i++) {
-        rocca_enc(s, &dst[i * ROCCA_BLOCK_SIZE],
-                  &plaintext[i * ROCCA_BLOCK_SIZE]);
-    }
-
-    // Encrypt a partial block.
-    remain = plaintext_len % ROCCA_BLOCK_SIZE;
-    if (remain != 0) {
-        memset(tmp, 0, sizeof(tmp));
-        memcpy(tmp, plaintext, remain);
-        rocca_enc(s, tmp, tmp);
-        memcpy(dst, tmp, remain);
-    }
-
-    u128 tag = rocca_mac(s, additional_data_len, plaintext_len);
-    store_u128(&dst[(nblocks * ROCCA_BLOCK_SIZE) + remain], tag);
-
-    memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+    rocca_seal_state(s, dst, plaintext, plaintext_len, additional_data,
+                     additional_data_len);
+    memset_s(s, sizeof(s), 0, sizeof(s));
 
     return true;
 }
@@ -278,7 +56,8 @@ bool rocca_open(uint8_t* dst,
     if (dst == NULL) {
         return false;
     }
-    if (ciphertext == NULL || ciphertext_len < ROCCA_OVERHEAD) {
+    if (ciphertext == NULL || ciphertext_len < ROCCA_OVERHEAD ||
+        dst_len < ciphertext_len - ROCCA_OVERHEAD) {
         memset_s(dst, dst_len, 0, dst_len);
         return false;
     }
@@ -295,54 +74,424 @@ bool rocca_open(uint8_t* dst,
         return false;
     }
 
-    ciphertext_len -= ROCCA_TAG_SIZE;
-    u128 tag = load_u128(&ciphertext[ciphertext_len]);
-
     rocca_state s = {0};
     rocca_init(s, key, nonce);
+    bool ok = rocca_open_state(s, dst, dst_len, ciphertext, ciphertext_len,
+                               additional_data, additional_data_len);
+    memset_s(s, sizeof(s), 0, sizeof(s));
+
+    return ok;
+}
 
-    uint8_t tmp[ROCCA_BLOCK_SIZE] = {0};
+enum {
+    // ROCCA_CTX_MAGIC identifies a serialized |rocca_ctx|.
+    ROCCA_CTX_MAGIC = 0x58434f52, // "ROCX"
+    // ROCCA_CTX_VERSION is the current serialization version.
+    ROCCA_CTX_VERSION = 1,
+
+    // ROCCA_MODE_SEAL and ROCCA_MODE_OPEN are the directions of
+    // a |rocca_ctx|. Zero means the context is not initialized.
+    ROCCA_MODE_SEAL = 1,
+    ROCCA_MODE_OPEN = 2,
+
+    // ROCCA_PHASE_AD means that additional data is still being
+    // absorbed. ROCCA_PHASE_MSG means that the message is being
+    // encrypted or decrypted.
+    ROCCA_PHASE_AD  = 0,
+    ROCCA_PHASE_MSG = 1,
+
+    // ROCCA_MAX_LEN_SHIFT bounds the number of bytes of
+    // additional data or message so that its length in bits
+    // fits in the 64-bit lengths used by |rocca_mac|.
+    ROCCA_MAX_LEN_SHIFT = 61,
+};
+
+// rocca_stream is the private layout of |rocca_ctx|.
+typedef struct rocca_stream {
+    rocca_state s;
+    // buf holds a partial block of additional data or
+    // plaintext. The state is only updated once a block is
+    // complete.
+    uint8_t buf[ROCCA_BLOCK_SIZE];
+    uint64_t ad_len;
+    uint64_t msg_len;
+    uint8_t buf_len;
+    uint8_t mode;
+    uint8_t phase;
+} rocca_stream;
+
+_Static_assert(sizeof(rocca_stream) <= sizeof(((rocca_ctx*)0)->opaque),
+               "rocca_ctx is too small");
+
+static rocca_stream* ctx_stream(rocca_ctx* ctx) {
+    return (rocca_stream*)ctx->opaque;
+}
+
+static bool len_ok(uint64_t cur, size_t n) {
+    const uint64_t max = ((uint64_t)1 << ROCCA_MAX_LEN_SHIFT) - 1;
+    return n <= max && cur <= max - n;
+}
 
-    // Authenticate full blocks.
-    size_t nblocks = additional_data_len / ROCCA_BLOCK_SIZE;
-    for (size_t i = 0; i < nblocks; i++) {
-        u128 a0 = load_u128(&additional_data[i * ROCCA_BLOCK_SIZE]);
-        u128 a1 = load_u128(
-            &additional_data[i * ROCCA_BLOCK_SIZE + ROCCA_BLOCK_SIZE / 2]);
-        rocca_update(s, a0, a1);
+static bool stream_init(rocca_ctx* ctx,
+                        uint8_t mode,
+                        const uint8_t key[ROCCA_KEY_SIZE],
+                        size_t key_len,
+                        const uint8_t nonce[ROCCA_NONCE_SIZE],
+                        size_t nonce_len) {
+    if (ctx == NULL) {
+        return false;
+    }
+    memset_s(ctx, sizeof(*ctx), 0, sizeof(*ctx));
+    if (key == NULL || key_len != ROCCA_KEY_SIZE) {
+        return false;
     }
+    if (nonce == NULL || nonce_len != ROCCA_NONCE_SIZE) {
+        return false;
+    }
+    rocca_stream* st = ctx_stream(ctx);
+    rocca_init(st->s, key, nonce);
+    st->mode  = mode;
+    st->phase = ROCCA_PHASE_AD;
+    return true;
+}
 
-    // Authenticate a partial block.
-    size_t remain = additional_data_len % ROCCA_BLOCK_SIZE;
-    if (remain != 0) {
-        memset(tmp, 0, sizeof(tmp));
-        memcpy(tmp, additional_data, remain);
-        u128 a0 = load_u128(&tmp[0]);
-        u128 a1 = load_u128(&tmp[ROCCA_BLOCK_SIZE / 2]);
-        rocca_update(s, a0, a1);
+bool rocca_seal_init(rocca_ctx* ctx,
+                     const uint8_t key[ROCCA_KEY_SIZE],
+                     size_t key_len,
+                     const uint8_t nonce[ROCCA_NONCE_SIZE],
+                     size_t nonce_len) {
+    return stream_init(ctx, ROCCA_MODE_SEAL, key, key_len, nonce, nonce_len);
+}
+
+bool rocca_open_init(rocca_ctx* ctx,
+                     const uint8_t key[ROCCA_KEY_SIZE],
+                     size_t key_len,
+                     const uint8_t nonce[ROCCA_NONCE_SIZE],
+                     size_t nonce_len) {
+    return stream_init(ctx, ROCCA_MODE_OPEN, key, key_len, nonce, nonce_len);
+}
+
+bool rocca_update_ad(rocca_ctx* ctx,
+                     const uint8_t* additional_data,
+                     size_t additional_data_len) {
+    if (ctx == NULL) {
+        return false;
+    }
+    rocca_stream* st = ctx_stream(ctx);
+    if (st->mode == 0 || st->phase != ROCCA_PHASE_AD) {
+        return false;
+    }
+    if ((additional_data == NULL) != (additional_data_len == 0)) {
+        return false;
+    }
+    if (!len_ok(st->ad_len, additional_data_len)) {
+        return false;
+    }
+    if (additional_data_len == 0) {
+        // |additional_data| is NULL, which memcpy does not allow
+        // even for zero bytes.
+        return true;
+    }
+    st->ad_len += additional_data_len;
+
+    const uint8_t* p = additional_data;
+    size_t n         = additional_data_len;
+    if (st->buf_len != 0) {
+        size_t m = ROCCA_BLOCK_SIZE - st->buf_len;
+        if (m > n) {
+            m = n;
+        }
+        memcpy(&st->buf[st->buf_len], p, m);
+        st->buf_len += m;
+        p += m;
+        n -= m;
+        if (st->buf_len < ROCCA_BLOCK_SIZE) {
+            return true;
+        }
+        rocca_absorb(st->s, st->buf, ROCCA_BLOCK_SIZE);
+        st->buf_len = 0;
+    }
+    size_t full = n - (n % ROCCA_BLOCK_SIZE);
+    if (full != 0) {
+        rocca_absorb(st->s, p, full);
     }
+    memcpy(st->buf, &p[full], n - full);
+    st->buf_len = n - full;
+    return true;
+}
+
+// stream_begin_msg flushes any partial block of additional data
+// and switches |st| to the message phase.
+static void stream_begin_msg(rocca_stream* st) {
+    if (st->phase != ROCCA_PHASE_AD) {
+        return;
+    }
+    if (st->buf_len != 0) {
+        rocca_absorb(st->s, st->buf, st->buf_len);
+        memset_s(st->buf, sizeof(st->buf), 0, sizeof(st->buf));
+        st->buf_len = 0;
+    }
+    st->phase = ROCCA_PHASE_MSG;
+}
 
-    // Decrypt full blocks.
-    nblocks = ciphertext_len / ROCCA_BLOCK_SIZE;
-    for (size_t i = 0; i < nblocks; i++) {
-        rocca_dec(s, &dst[i * ROCCA_BLOCK_SIZE],
-                  &ciphertext[i * ROCCA_BLOCK_SIZE]);
+// stream_crypt encrypts (|seal| is true) or decrypts |src_len|
+// bytes from |src| into |dst|.
+static void stream_crypt(rocca_stream* st,
+                         uint8_t* dst,
+                         const uint8_t* src,
+                         size_t src_len,
+                         bool seal) {
+    uint8_t ks[ROCCA_BLOCK_SIZE];
+    size_t i = 0;
+
+    // Finish the pending partial block, if any. The keystream
+    // for a block only depends on the state before the block,
+    // so it can be recomputed for every partial write.
+    if (st->buf_len != 0) {
+        rocca_keystream(st->s, ks);
+        while (i < src_len && st->buf_len < ROCCA_BLOCK_SIZE) {
+            uint8_t in = src[i];
+            uint8_t pt = seal ? in : (uint8_t)(in ^ ks[st->buf_len]);
+            dst[i]     = in ^ ks[st->buf_len];
+            st->buf[st->buf_len++] = pt;
+            i++;
+        }
+        if (st->buf_len < ROCCA_BLOCK_SIZE) {
+            memset_s(ks, sizeof(ks), 0, sizeof(ks));
+            return;
+        }
+        u128 p0 = load_u128(&st->buf[0]);
+        u128 p1 = load_u128(&st->buf[ROCCA_BLOCK_SIZE / 2]);
+        rocca_update(st->s, p0, p1);
+        st->buf_len = 0;
     }
 
-    // Decrypt a partial block.
-    remain = ciphertext_len % ROCCA_BLOCK_SIZE;
-    if (remain != 0) {
-        memset(tmp, 0, sizeof(tmp));
-        memcpy(tmp, ciphertext, remain);
-        rocca_dec_partial(s, &dst[nblocks * ROCCA_BLOCK_SIZE], remain, tmp);
+    // Full blocks.
+    for (; src_len - i >= ROCCA_BLOCK_SIZE; i += ROCCA_BLOCK_SIZE) {
+        if (seal) {
+            rocca_enc(st->s, &dst[i], &src[i]);
+        } else {
+            rocca_dec(st->s, &dst[i], &src[i]);
+        }
     }
 
-    memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+    // Start a new partial block.
+    if (i < src_len) {
+        rocca_keystream(st->s, ks);
+        for (; i < src_len; i++) {
+            uint8_t in = src[i];
+            uint8_t pt = seal ? in : (uint8_t)(in ^ ks[st->buf_len]);
+            dst[i]     = in ^ ks[st->buf_len];
+            st->buf[st->buf_len++] = pt;
+        }
+    }
+    memset_s(ks, sizeof(ks), 0, sizeof(ks));
+}
 
-    u128 expectedTag = rocca_mac(s, additional_data_len, ciphertext_len);
-    if (!constant_time_compare_u128(tag, expectedTag)) {
-        memset_s(dst, dst_len, 0, dst_len);
+static bool stream_update(rocca_ctx* ctx,
+                          uint8_t mode,
+                          uint8_t* dst,
+                          size_t dst_len,
+                          const uint8_t* src,
+                          size_t src_len) {
+    if (ctx == NULL) {
+        return false;
+    }
+    rocca_stream* st = ctx_stream(ctx);
+    if (st->mode != mode) {
+        return false;
+    }
+    if ((src == NULL) != (src_len == 0) || dst_len < src_len ||
+        (dst == NULL && src_len != 0)) {
+        return false;
+    }
+    if (!len_ok(st->msg_len, src_len)) {
+        return false;
+    }
+    if (src_len == 0) {
+        return true;
+    }
+    stream_begin_msg(st);
+    st->msg_len += src_len;
+    stream_crypt(st, dst, src, src_len, mode == ROCCA_MODE_SEAL);
+    return true;
+}
+
+bool rocca_seal_update(rocca_ctx* ctx,
+                       uint8_t* dst,
+                       size_t dst_len,
+                       const uint8_t* plaintext,
+                       size_t plaintext_len) {
+    return stream_update(ctx, ROCCA_MODE_SEAL, dst, dst_len, plaintext,
+                         plaintext_len);
+}
+
+bool rocca_open_update(rocca_ctx* ctx,
+                       uint8_t* dst,
+                       size_t dst_len,
+                       const uint8_t* ciphertext,
+                       size_t ciphertext_len) {
+    return stream_update(ctx, ROCCA_MODE_OPEN, dst, dst_len, ciphertext,
+                         ciphertext_len);
+}
+
+// stream_final computes the tag for |ctx| and wipes it.
+static bool stream_final(rocca_ctx* ctx, uint8_t mode, u128* tag) {
+    if (ctx == NULL) {
+        return false;
+    }
+    rocca_stream* st = ctx_stream(ctx);
+    if (st->mode != mode) {
+        return false;
+    }
+    stream_begin_msg(st);
+    if (st->buf_len != 0) {
+        // |buf| is zero past |buf_len|, so this is the same
+        // padding as |rocca_enc| on a partial block.
+        memset(&st->buf[st->buf_len], 0, sizeof(st->buf) - st->buf_len);
+        u128 p0 = load_u128(&st->buf[0]);
+        u128 p1 = load_u128(&st->buf[ROCCA_BLOCK_SIZE / 2]);
+        rocca_update(st->s, p0, p1);
+    }
+    *tag = rocca_mac(st->s, st->ad_len, st->msg_len);
+    memset_s(ctx, sizeof(*ctx), 0, sizeof(*ctx));
+    return true;
+}
+
+bool rocca_seal_final(rocca_ctx* ctx, uint8_t* tag, size_t tag_len) {
+    if (tag == NULL || tag_len != ROCCA_TAG_SIZE) {
+        return false;
+    }
+    u128 t;
+    if (!stream_final(ctx, ROCCA_MODE_SEAL, &t)) {
+        return false;
+    }
+    store_u128(tag, t);
+    return true;
+}
+
+bool rocca_open_final(rocca_ctx* ctx, const uint8_t* tag, size_t tag_len) {
+    if (tag == NULL || tag_len != ROCCA_TAG_SIZE) {
+        if (ctx != NULL) {
+            memset_s(ctx, sizeof(*ctx), 0, sizeof(*ctx));
+        }
         return false;
     }
+    u128 expectedTag;
+    if (!stream_final(ctx, ROCCA_MODE_OPEN, &expectedTag)) {
+        return false;
+    }
+    return constant_time_compare_u128(load_u128(tag), expectedTag);
+}
+
+// The serialized form of a |rocca_ctx| is:
+//
+//    magic     [4]  little-endian ROCCA_CTX_MAGIC
+//    version   [1]  ROCCA_CTX_VERSION
+//    mode      [1]
+//    phase     [1]
+//    buf_len   [1]
+//    ad_len    [8]  little-endian
+//    msg_len   [8]  little-endian
+//    state   [128]  S[0] ... S[7]
+//    buf      [32]
+enum {
+    EXPORT_MAGIC   = 0,
+    EXPORT_VERSION = 4,
+    EXPORT_MODE    = 5,
+    EXPORT_PHASE   = 6,
+    EXPORT_BUF_LEN = 7,
+    EXPORT_AD_LEN  = 8,
+    EXPORT_MSG_LEN = 16,
+    EXPORT_STATE   = 24,
+    EXPORT_BUF     = EXPORT_STATE + 8 * 16,
+    EXPORT_END     = EXPORT_BUF + ROCCA_BLOCK_SIZE,
+};
+
+_Static_assert((int)EXPORT_END == (int)ROCCA_CTX_EXPORT_SIZE,
+               "ROCCA_CTX_EXPORT_SIZE is wrong");
+
+bool rocca_ctx_export(const rocca_ctx* ctx, uint8_t* dst, size_t dst_len) {
+    if (dst == NULL || dst_len < ROCCA_CTX_EXPORT_SIZE) {
+        return false;
+    }
+    memset_s(dst, dst_len, 0, dst_len);
+    if (ctx == NULL) {
+        return false;
+    }
+    const rocca_stream* st = (const rocca_stream*)ctx->opaque;
+    if (st->mode == 0) {
+        return false;
+    }
+
+    uint8_t buf[8];
+    put_le64(buf, ROCCA_CTX_MAGIC);
+    memcpy(&dst[EXPORT_MAGIC], buf, 4);
+    dst[EXPORT_VERSION] = ROCCA_CTX_VERSION;
+    dst[EXPORT_MODE]    = st->mode;
+    dst[EXPORT_PHASE]   = st->phase;
+    dst[EXPORT_BUF_LEN] = st->buf_len;
+    put_le64(&dst[EXPORT_AD_LEN], st->ad_len);
+    put_le64(&dst[EXPORT_MSG_LEN], st->msg_len);
+    for (int i = 0; i < 8; i++) {
+        store_u128(&dst[EXPORT_STATE + i * 16], st->s[i]);
+    }
+    memcpy(&dst[EXPORT_BUF], st->buf, st->buf_len);
+    return true;
+}
+
+bool rocca_ctx_import(rocca_ctx* ctx, const uint8_t* src, size_t src_len) {
+    if (ctx == NULL) {
+        return false;
+    }
+    memset_s(ctx, sizeof(*ctx), 0, sizeof(*ctx));
+    if (src == NULL || src_len < ROCCA_CTX_EXPORT_SIZE) {
+        return false;
+    }
+
+    uint8_t magic[8] = {0};
+    memcpy(magic, &src[EXPORT_MAGIC], 4);
+    if (get_le64(magic) != ROCCA_CTX_MAGIC ||
+        src[EXPORT_VERSION] != ROCCA_CTX_VERSION) {
+        return false;
+    }
+    uint8_t mode     = src[EXPORT_MODE];
+    uint8_t phase    = src[EXPORT_PHASE];
+    uint8_t buf_len  = src[EXPORT_BUF_LEN];
+    uint64_t ad_len  = get_le64(&src[EXPORT_AD_LEN]);
+    uint64_t msg_len = get_le64(&src[EXPORT_MSG_LEN]);
+    if (mode != ROCCA_MODE_SEAL && mode != ROCCA_MODE_OPEN) {
+        return false;
+    }
+    if (phase != ROCCA_PHASE_AD && phase != ROCCA_PHASE_MSG) {
+        return false;
+    }
+    if (!len_ok(ad_len, 0) || !len_ok(msg_len, 0)) {
+        return false;
+    }
+    // The partial block must agree with the running lengths.
+    uint64_t cur = phase == ROCCA_PHASE_AD ? ad_len : msg_len;
+    if (buf_len != cur % ROCCA_BLOCK_SIZE) {
+        return false;
+    }
+    if (phase == ROCCA_PHASE_AD && msg_len != 0) {
+        return false;
+    }
+    for (size_t i = buf_len; i < ROCCA_BLOCK_SIZE; i++) {
+        if (src[EXPORT_BUF + i] != 0) {
+            return false;
+        }
+    }
+
+    rocca_stream* st = ctx_stream(ctx);
+    for (int i = 0; i < 8; i++) {
+        st->s[i] = load_u128(&src[EXPORT_STATE + i * 16]);
+    }
+    memcpy(st->buf, &src[EXPORT_BUF], buf_len);
+    st->ad_len  = ad_len;
+    st->msg_len = msg_len;
+    st->buf_len = buf_len;
+    st->mode    = mode;
+    st->phase   = phase;
     return true;
 }
@@ -23,6 +23,10 @@ static inline u128 xor_u128(u128 a, u128 b) {
     return _mm_xor_si128(a, b);
 }
 
+static inline u128 and_u128(u128 a, u128 b) {
+    return _mm_and_si128(a, b);
+}
+
 static inline u128 zero_u128(void) {
     return _mm_setzero_si128();
 }
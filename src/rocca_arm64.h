@@ -26,6 +26,10 @@ static inline u128 xor_u128(u128 a, u128 b) {
     return veorq_u8(a, b);
 }
 
+static inline u128 and_u128(u128 a, u128 b) {
+    return vandq_u8(a, b);
+}
+
 static inline u128 zero_u128(void) {
     return vdupq_n_u8(0);
 }
@@ -0,0 +1,26 @@
+#ifndef ROCCA_BACKEND_H
+#define ROCCA_BACKEND_H
+
+// This file selects the u128 primitives for the target. It is
+// not a public header.
+//
+// Defining ROCCA_GENERIC selects the portable implementation,
+// which is slow and not constant time but lets the tests check
+// the hardware implementations against a second one.
+//
+// ROCCA_BACKEND_NAME names the selection for |rocca_tuning|.
+
+#if defined(ROCCA_GENERIC)
+#include "rocca_generic.h"
+#define ROCCA_BACKEND_NAME "generic"
+#elif defined(__SSE2__) && defined(__AES__)
+#include "rocca_amd64.h"
+#define ROCCA_BACKEND_NAME "aes-ni"
+#elif defined(__ARM_NEON) && defined(__ARM_FEATURE_CRYPTO)
+#include "rocca_arm64.h"
+#define ROCCA_BACKEND_NAME "armv8-aes"
+#else
+#error "TODO"
+#endif // defined(__SSE2__) && defined(__AES__)
+
+#endif // ROCCA_BACKEND_H
@@ -0,0 +1,215 @@
+#include "rocca.h"
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "rocca_impl.h"
+
+enum {
+    // BUF_SHARDS is the number of free lists. Threads are spread
+    // across them round-robin.
+    BUF_SHARDS = 16,
+    // BUF_HUGE_PAGE is the huge page size assumed when rounding
+    // a |ROCCA_BUF_HUGETLB| mapping.
+    BUF_HUGE_PAGE = 2 * 1024 * 1024,
+};
+
+// buf_node is the free list link, stored in the first bytes of
+// each free buffer.
+typedef struct buf_node {
+    struct buf_node* next;
+} buf_node;
+
+// buf_shard is one free list. Each shard is on its own cache
+// line so that threads using different shards do not share.
+typedef struct buf_shard {
+    _Alignas(ROCCA_BUF_ALIGN) pthread_mutex_t mu;
+    buf_node* head;
+} buf_shard;
+
+struct rocca_buf_pool {
+    buf_shard shards[BUF_SHARDS];
+    uint8_t* base;
+    size_t map_len;
+    size_t stride;
+    size_t count;
+};
+
+// buf_thread_id is a small per-thread number, assigned on first
+// use, that picks the thread's shard.
+static _Thread_local unsigned buf_thread_id;
+static unsigned buf_next_thread_id;
+
+static buf_shard* buf_local_shard(rocca_buf_pool* pool) {
+    if (buf_thread_id == 0) {
+        buf_thread_id =
+            __atomic_add_fetch(&buf_next_thread_id, 1, __ATOMIC_RELAXED);
+    }
+    return &pool->shards[buf_thread_id % BUF_SHARDS];
+}
+
+// buf_round rounds |n| up to a multiple of |m|, returning zero
+// on overflow.
+static size_t buf_round(size_t n, size_t m) {
+    if (n > SIZE_MAX - (m - 1)) {
+        return 0;
+    }
+    return (n + m - 1) / m * m;
+}
+
+// buf_map maps |*len| zeroed bytes, preferring huge pages if
+// |flags| has |ROCCA_BUF_HUGETLB|. |*len| is rounded up to the
+// page size actually used.
+static uint8_t* buf_map(size_t* len, unsigned flags) {
+    void* p = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+    if ((flags & ROCCA_BUF_HUGETLB) != 0) {
+        size_t n = buf_round(*len, BUF_HUGE_PAGE);
+        if (n != 0) {
+            p = mmap(NULL, n, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+        if (p != MAP_FAILED) {
+            *len = n;
+            return p;
+        }
+    }
+#endif // defined(MAP_HUGETLB)
+
+    long page = sysconf(_SC_PAGESIZE);
+    size_t n  = buf_round(*len, page > 0 ? (size_t)page : 4096);
+    if (n == 0) {
+        return NULL;
+    }
+    p = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+#if defined(MADV_HUGEPAGE)
+    // Transparent huge pages are the next best thing.
+    if ((flags & ROCCA_BUF_HUGETLB) != 0) {
+        madvise(p, n, MADV_HUGEPAGE);
+    }
+#endif // defined(MADV_HUGEPAGE)
+    *len = n;
+    return p;
+}
+
+rocca_buf_pool* rocca_buf_pool_new(size_t max_len,
+                                   size_t count,
+                                   unsigned flags) {
+    if (count == 0 || (flags & ~(unsigned)ROCCA_BUF_HUGETLB) != 0) {
+        return NULL;
+    }
+    if (max_len > SIZE_MAX - ROCCA_S_OVERHEAD) {
+        return NULL;
+    }
+    size_t stride = buf_round(max_len + ROCCA_S_OVERHEAD, ROCCA_BUF_ALIGN);
+    if (stride == 0 || count > SIZE_MAX / stride) {
+        return NULL;
+    }
+
+    rocca_buf_pool* pool = aligned_alloc(ROCCA_BUF_ALIGN, sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(*pool));
+    pool->map_len = stride * count;
+    pool->base    = buf_map(&pool->map_len, flags);
+    if (pool->base == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pool->stride = stride;
+    pool->count  = count;
+
+    for (int i = 0; i < BUF_SHARDS; i++) {
+        if (pthread_mutex_init(&pool->shards[i].mu, NULL) != 0) {
+            while (i-- > 0) {
+                pthread_mutex_destroy(&pool->shards[i].mu);
+            }
+            munmap(pool->base, pool->map_len);
+            free(pool);
+            return NULL;
+        }
+    }
+    // Spread the buffers evenly so that each thread starts with
+    // a share, keeping them in address order within a shard.
+    for (size_t i = count; i-- > 0;) {
+        buf_node* n      = (buf_node*)&pool->base[i * stride];
+        buf_shard* shard = &pool->shards[i % BUF_SHARDS];
+        n->next          = shard->head;
+        shard->head      = n;
+    }
+    return pool;
+}
+
+void rocca_buf_pool_free(rocca_buf_pool* pool) {
+    if (pool == NULL) {
+        return;
+    }
+    for (int i = 0; i < BUF_SHARDS; i++) {
+        pthread_mutex_destroy(&pool->shards[i].mu);
+    }
+    memset_s(pool->base, pool->map_len, 0, pool->map_len);
+    munmap(pool->base, pool->map_len);
+    free(pool);
+}
+
+size_t rocca_buf_pool_buf_size(const rocca_buf_pool* pool) {
+    if (pool == NULL) {
+        return 0;
+    }
+    return pool->stride;
+}
+
+// buf_pop removes the first buffer from |shard|, if any.
+static buf_node* buf_pop(buf_shard* shard) {
+    pthread_mutex_lock(&shard->mu);
+    buf_node* n = shard->head;
+    if (n != NULL) {
+        shard->head = n->next;
+    }
+    pthread_mutex_unlock(&shard->mu);
+    return n;
+}
+
+uint8_t* rocca_buf_get(rocca_buf_pool* pool) {
+    if (pool == NULL) {
+        return NULL;
+    }
+    buf_shard* local = buf_local_shard(pool);
+    buf_node* n      = buf_pop(local);
+    // Steal from the other shards before giving up.
+    for (int i = 1; n == NULL && i < BUF_SHARDS; i++) {
+        size_t j = ((size_t)(local - pool->shards) + i) % BUF_SHARDS;
+        n        = buf_pop(&pool->shards[j]);
+    }
+    if (n == NULL) {
+        return NULL;
+    }
+    n->next = NULL;
+    return (uint8_t*)n;
+}
+
+bool rocca_buf_put(rocca_buf_pool* pool, uint8_t* buf) {
+    if (pool == NULL || buf == NULL) {
+        return false;
+    }
+    uintptr_t off = (uintptr_t)buf - (uintptr_t)pool->base;
+    if ((uintptr_t)buf < (uintptr_t)pool->base ||
+        off >= pool->stride * pool->count || off % pool->stride != 0) {
+        return false;
+    }
+    memset_s(buf, pool->stride, 0, pool->stride);
+
+    buf_node* n      = (buf_node*)buf;
+    buf_shard* shard = buf_local_shard(pool);
+    pthread_mutex_lock(&shard->mu);
+    n->next     = shard->head;
+    shard->head = n;
+    pthread_mutex_unlock(&shard->mu);
+    return true;
+}
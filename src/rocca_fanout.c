@@ -0,0 +1,193 @@
+#include "rocca.h"
+
+#include "rocca_impl.h"
+#include "rocca_lanes.h"
+
+enum {
+    // FANOUT_STACK is the number of recipient states kept on the
+    // stack. Larger fan-outs allocate.
+    FANOUT_STACK = 16,
+};
+
+// fanout_ok validates |r| as |rocca_seal| would.
+static bool fanout_ok(const rocca_recipient* r, size_t plaintext_len) {
+    if (r->dst == NULL) {
+        return false;
+    }
+    if ((SIZE_MAX - plaintext_len) < ROCCA_OVERHEAD ||
+        r->dst_len < plaintext_len + ROCCA_OVERHEAD) {
+        return false;
+    }
+    if (r->key == NULL || r->key_len != ROCCA_KEY_SIZE) {
+        return false;
+    }
+    if (r->nonce == NULL || r->nonce_len != ROCCA_NONCE_SIZE) {
+        return false;
+    }
+    return true;
+}
+
+// fanout_lanes sets up at most |width| |lanes| for the
+// recipients starting at |r| and returns the number of lanes
+// used.
+static size_t fanout_lanes(rocca_lane lanes[ROCCA_LANES],
+                           size_t width,
+                           const rocca_recipient* r,
+                           size_t n,
+                           const uint8_t* plaintext,
+                           size_t plaintext_len,
+                           const uint8_t* additional_data,
+                           size_t additional_data_len) {
+    size_t m = n < width ? n : width;
+    for (size_t j = 0; j < m; j++) {
+        lanes[j] = (rocca_lane){
+            .key                 = r[j].key,
+            .nonce               = r[j].nonce,
+            .dst                 = r[j].dst,
+            .plaintext           = plaintext,
+            .plaintext_len       = plaintext_len,
+            .additional_data     = additional_data,
+            .additional_data_len = additional_data_len,
+        };
+    }
+    return m;
+}
+
+// fanout_absorb authenticates |nblocks| full blocks of |ad| for
+// all |n| states, |chunk| blocks at a time.
+static void fanout_absorb(rocca_state* s,
+                          size_t n,
+                          const uint8_t* ad,
+                          size_t nblocks,
+                          size_t chunk) {
+    for (size_t b = 0; b < nblocks; b += chunk) {
+        size_t end = nblocks - b < chunk ? nblocks : b + chunk;
+        for (size_t j = 0; j < n; j++) {
+            // Work on a local copy so that the state stays in
+            // registers.
+            rocca_state t;
+            memcpy(t, s[j], sizeof(t));
+            for (size_t i = b; i < end; i++) {
+                const uint8_t* src = &ad[i * ROCCA_BLOCK_SIZE];
+                u128 a0            = load_u128(&src[0]);
+                u128 a1            = load_u128(&src[ROCCA_BLOCK_SIZE / 2]);
+                rocca_update(t, a0, a1);
+            }
+            memcpy(s[j], t, sizeof(t));
+        }
+    }
+}
+
+// fanout_enc encrypts |nblocks| full blocks of |plaintext| for
+// all |n| recipients, |chunk| blocks at a time.
+static void fanout_enc(rocca_state* s,
+                       const rocca_recipient* r,
+                       size_t n,
+                       const uint8_t* plaintext,
+                       size_t nblocks,
+                       size_t chunk) {
+    for (size_t b = 0; b < nblocks; b += chunk) {
+        size_t end = nblocks - b < chunk ? nblocks : b + chunk;
+        for (size_t j = 0; j < n; j++) {
+            rocca_state t;
+            memcpy(t, s[j], sizeof(t));
+            for (size_t i = b; i < end; i++) {
+                size_t off = i * ROCCA_BLOCK_SIZE;
+                rocca_enc(t, &r[j].dst[off], &plaintext[off]);
+            }
+            memcpy(s[j], t, sizeof(t));
+        }
+    }
+}
+
+bool rocca_seal_fanout(const rocca_recipient* recipients,
+                       size_t n,
+                       const uint8_t* plaintext,
+                       size_t plaintext_len,
+                       const uint8_t* additional_data,
+                       size_t additional_data_len) {
+    if (recipients == NULL) {
+        return false;
+    }
+    bool ok = ((plaintext == NULL) == (plaintext_len == 0)) &&
+              ((additional_data == NULL) == (additional_data_len == 0));
+    for (size_t j = 0; ok && j < n; j++) {
+        ok = fanout_ok(&recipients[j], plaintext_len);
+    }
+
+    rocca_state stack[FANOUT_STACK];
+    rocca_state* s = stack;
+    if (ok && n > FANOUT_STACK) {
+        if (n > SIZE_MAX / sizeof(rocca_state)) {
+            ok = false;
+        } else {
+            s  = aligned_alloc(ROCCA_BUF_ALIGN, n * sizeof(rocca_state));
+            ok = s != NULL;
+        }
+    }
+    if (!ok) {
+        for (size_t j = 0; j < n; j++) {
+            const rocca_recipient* r = &recipients[j];
+            if (r->dst != NULL) {
+                memset_s(r->dst, r->dst_len, 0, r->dst_len);
+            }
+        }
+        return false;
+    }
+
+    rocca_tuning tuning;
+    rocca_tuning_get(&tuning);
+    rocca_lane lanes[ROCCA_LANES];
+    u128 tags[ROCCA_LANES];
+    for (size_t g = 0; g < n; g += tuning.lanes) {
+        size_t m = fanout_lanes(lanes, tuning.lanes, &recipients[g], n - g,
+                                plaintext, plaintext_len, additional_data,
+                                additional_data_len);
+        rocca_init_lanes(&s[g], lanes, m);
+    }
+
+    // Each chunk of input is read from memory once and then fed
+    // to every recipient from the cache.
+    uint8_t tmp[ROCCA_BLOCK_SIZE];
+    size_t chunk   = tuning.fanout_chunk / ROCCA_BLOCK_SIZE;
+    size_t nblocks = additional_data_len / ROCCA_BLOCK_SIZE;
+    size_t remain  = additional_data_len % ROCCA_BLOCK_SIZE;
+    fanout_absorb(s, n, additional_data, nblocks, chunk);
+    if (remain != 0) {
+        memset(tmp, 0, sizeof(tmp));
+        memcpy(tmp, &additional_data[nblocks * ROCCA_BLOCK_SIZE], remain);
+        fanout_absorb(s, n, tmp, 1, chunk);
+    }
+
+    nblocks = plaintext_len / ROCCA_BLOCK_SIZE;
+    remain  = plaintext_len % ROCCA_BLOCK_SIZE;
+    fanout_enc(s, recipients, n, plaintext, nblocks, chunk);
+    if (remain != 0) {
+        size_t off = nblocks * ROCCA_BLOCK_SIZE;
+        memset(tmp, 0, sizeof(tmp));
+        memcpy(tmp, &plaintext[off], remain);
+        u128 m0 = load_u128(&tmp[0]);
+        u128 m1 = load_u128(&tmp[ROCCA_BLOCK_SIZE / 2]);
+        for (size_t j = 0; j < n; j++) {
+            rocca_enc_u128(s[j], tmp, m0, m1);
+            memcpy(&recipients[j].dst[off], tmp, remain);
+        }
+    }
+
+    for (size_t g = 0; g < n; g += tuning.lanes) {
+        size_t m = fanout_lanes(lanes, tuning.lanes, &recipients[g], n - g,
+                                plaintext, plaintext_len, additional_data,
+                                additional_data_len);
+        rocca_mac_lanes(&s[g], lanes, m, tags);
+        for (size_t j = 0; j < m; j++) {
+            store_u128(&lanes[j].dst[plaintext_len], tags[j]);
+        }
+    }
+
+    memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+    memset_s(s, n * sizeof(rocca_state), 0, n * sizeof(rocca_state));
+    if (s != stack) {
+        free(s);
+    }
+    return true;
+}
@@ -0,0 +1,536 @@
+#include "rocca.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "rocca_impl.h"
+
+// A file is a fixed-size header followed by the sealed
+// segments, each with its tag:
+//
+//    header | segment 0 | tag | segment 1 | tag | ...
+//
+// The header is
+//
+//    0    magic (8 bytes)
+//    8    segment size (little endian uint64)
+//    16   base nonce (16 bytes)
+//    32   plaintext length (little endian uint64)
+//    40   reserved, zero (8 bytes)
+//    48   header tag (16 bytes)
+//
+// Segment i is sealed with the nonce base + i (see
+// |rocca_nonce_add|) and the first |FILE_AD_SIZE| bytes of the
+// header as additional data. The header tag is an empty message
+// sealed with the nonce base + 2^64-1 and the first
+// |FILE_TAG_OFFSET| bytes of the header as additional data.
+//
+// Every segment but the last is exactly segment size bytes, so
+// the segment holding any plaintext offset is found by division.
+enum {
+    FILE_SEGMENT_SIZE = 8,
+    FILE_NONCE        = 16,
+    FILE_LENGTH       = 32,
+    FILE_TAG_OFFSET   = 48,
+    // FILE_AD_SIZE is the part of the header known before the
+    // file is written: the magic, segment size and nonce.
+    FILE_AD_SIZE = FILE_LENGTH,
+};
+
+static const uint8_t file_magic[8] = {'R', 'O', 'C', 'C', 'A', 'F', 'L', '1'};
+
+// file_pread reads exactly |len| bytes at |off|.
+static bool file_pread(int fd, uint8_t* buf, size_t len, uint64_t off) {
+    while (len > 0) {
+        ssize_t n = pread(fd, buf, len, (off_t)off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+        off += (uint64_t)n;
+    }
+    return true;
+}
+
+// file_pwrite writes exactly |len| bytes at |off|.
+static bool file_pwrite(int fd,
+                        const uint8_t* buf,
+                        size_t len,
+                        uint64_t off) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, (off_t)off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+        off += (uint64_t)n;
+    }
+    return true;
+}
+
+// file_max_segments returns the number of segments of
+// |segment_size| bytes whose offsets fit in an off_t.
+static uint64_t file_max_segments(size_t segment_size) {
+    return ((uint64_t)INT64_MAX - ROCCA_FILE_HEADER_SIZE) /
+           (segment_size + ROCCA_OVERHEAD);
+}
+
+// file_segment_offset returns the file offset of segment |i|.
+static uint64_t file_segment_offset(size_t segment_size, uint64_t i) {
+    return ROCCA_FILE_HEADER_SIZE + i * (segment_size + ROCCA_OVERHEAD);
+}
+
+struct rocca_file_writer {
+    int fd;
+    uint8_t key[ROCCA_KEY_SIZE];
+    uint8_t header[ROCCA_FILE_HEADER_SIZE];
+    size_t segment_size;
+    // index is the index of the segment being filled, and
+    // length is the number of bytes written so far.
+    uint64_t index;
+    uint64_t length;
+    // buf holds the plaintext of the segment being filled
+    // followed by room for its ciphertext and tag.
+    size_t buf_len;
+    uint8_t* buf;
+    // done is set once the writer has failed or finished.
+    bool done;
+};
+
+rocca_file_writer* rocca_file_writer_new(int fd,
+                                         const uint8_t key[ROCCA_KEY_SIZE],
+                                         size_t key_len,
+                                         const uint8_t nonce[ROCCA_NONCE_SIZE],
+                                         size_t nonce_len,
+                                         size_t segment_size) {
+    if (fd < 0) {
+        return NULL;
+    }
+    if (key == NULL || key_len != ROCCA_KEY_SIZE) {
+        return NULL;
+    }
+    if (nonce == NULL || nonce_len != ROCCA_NONCE_SIZE) {
+        return NULL;
+    }
+    if (segment_size == 0 || segment_size > ROCCA_FILE_MAX_SEGMENT_SIZE) {
+        return NULL;
+    }
+
+    rocca_file_writer* w = calloc(1, sizeof(*w));
+    if (w == NULL) {
+        return NULL;
+    }
+    w->buf_len = 2 * segment_size + ROCCA_OVERHEAD;
+    w->buf     = malloc(w->buf_len);
+    if (w->buf == NULL) {
+        free(w);
+        return NULL;
+    }
+    w->fd           = fd;
+    w->segment_size = segment_size;
+    memcpy(w->key, key, ROCCA_KEY_SIZE);
+    memcpy(w->header, file_magic, sizeof(file_magic));
+    put_le64(&w->header[FILE_SEGMENT_SIZE], segment_size);
+    memcpy(&w->header[FILE_NONCE], nonce, ROCCA_NONCE_SIZE);
+    return w;
+}
+
+void rocca_file_writer_free(rocca_file_writer* w) {
+    if (w == NULL) {
+        return;
+    }
+    memset_s(w->buf, w->buf_len, 0, w->buf_len);
+    free(w->buf);
+    memset_s(w, sizeof(*w), 0, sizeof(*w));
+    free(w);
+}
+
+// writer_flush seals and writes the |len| bytes at the start of
+// |w->buf| as the current segment.
+static bool writer_flush(rocca_file_writer* w, size_t len) {
+    if (w->index >= file_max_segments(w->segment_size)) {
+        return false;
+    }
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+    rocca_nonce_add(&w->header[FILE_NONCE], w->index, nonce);
+    uint8_t* ct = &w->buf[w->segment_size];
+    if (!rocca_seal(ct, len + ROCCA_OVERHEAD, w->key, ROCCA_KEY_SIZE, nonce,
+                    sizeof(nonce), len ? w->buf : NULL, len, w->header,
+                    FILE_AD_SIZE)) {
+        return false;
+    }
+    uint64_t off = file_segment_offset(w->segment_size, w->index);
+    if (!file_pwrite(w->fd, ct, len + ROCCA_OVERHEAD, off)) {
+        return false;
+    }
+    w->index++;
+    return true;
+}
+
+bool rocca_file_write(rocca_file_writer* w,
+                      const uint8_t* data,
+                      size_t len) {
+    if (w == NULL || w->done || (data == NULL && len != 0)) {
+        return false;
+    }
+    if (len > UINT64_MAX - w->length) {
+        w->done = true;
+        return false;
+    }
+    while (len > 0) {
+        size_t used = (size_t)(w->length % w->segment_size);
+        // A segment is only flushed once more data arrives, so
+        // that |rocca_file_writer_finish| always has a (possibly
+        // full) final segment to write.
+        if (used == 0 && w->length > 0 &&
+            !writer_flush(w, w->segment_size)) {
+            w->done = true;
+            return false;
+        }
+        size_t n = w->segment_size - used;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&w->buf[used], data, n);
+        w->length += n;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool rocca_file_writer_finish(rocca_file_writer* w) {
+    if (w == NULL || w->done) {
+        return false;
+    }
+    w->done = true;
+
+    // An empty file still has one (empty) segment.
+    size_t last = (size_t)(w->length % w->segment_size);
+    if (last == 0 && w->length > 0) {
+        last = w->segment_size;
+    }
+    if (!writer_flush(w, last)) {
+        return false;
+    }
+
+    put_le64(&w->header[FILE_LENGTH], w->length);
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+    rocca_nonce_add(&w->header[FILE_NONCE], UINT64_MAX, nonce);
+    if (!rocca_seal(&w->header[FILE_TAG_OFFSET], ROCCA_OVERHEAD, w->key,
+                    ROCCA_KEY_SIZE, nonce, sizeof(nonce), NULL, 0, w->header,
+                    FILE_TAG_OFFSET)) {
+        return false;
+    }
+    return file_pwrite(w->fd, w->header, sizeof(w->header), 0);
+}
+
+// file_entry is a decrypted segment in the cache.
+typedef struct file_entry {
+    uint64_t index;
+    // next is the next entry in the same hash bucket.
+    int32_t next;
+    // newer and older link the entries in LRU order.
+    int32_t newer;
+    int32_t older;
+    bool valid;
+    uint8_t* data;
+} file_entry;
+
+struct rocca_file {
+    int fd;
+    uint8_t key[ROCCA_KEY_SIZE];
+    uint8_t header[ROCCA_FILE_HEADER_SIZE];
+    size_t segment_size;
+    uint64_t length;
+    uint64_t nsegments;
+
+    // ct holds one sealed segment as read from the file, and
+    // scratch one decrypted segment when there is no cache.
+    uint8_t* ct;
+    uint8_t* scratch;
+
+    // The cache is a hash table of |capacity| entries with
+    // |nbuckets| (a power of two) chains, plus an LRU list from
+    // |newest| to |oldest|.
+    size_t capacity;
+    size_t nbuckets;
+    int32_t* buckets;
+    file_entry* entries;
+    uint8_t* data;
+    int32_t newest;
+    int32_t oldest;
+};
+
+rocca_file* rocca_file_open(int fd,
+                            const uint8_t key[ROCCA_KEY_SIZE],
+                            size_t key_len,
+                            size_t cache_segments) {
+    if (fd < 0 || key == NULL || key_len != ROCCA_KEY_SIZE) {
+        return NULL;
+    }
+    if (cache_segments > INT32_MAX / 2) {
+        return NULL;
+    }
+
+    uint8_t header[ROCCA_FILE_HEADER_SIZE];
+    if (!file_pread(fd, header, sizeof(header), 0) ||
+        memcmp(header, file_magic, sizeof(file_magic)) != 0) {
+        return NULL;
+    }
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+    uint8_t empty[1];
+    rocca_nonce_add(&header[FILE_NONCE], UINT64_MAX, nonce);
+    if (!rocca_open(empty, sizeof(empty), key, ROCCA_KEY_SIZE, nonce,
+                    sizeof(nonce), &header[FILE_TAG_OFFSET], ROCCA_OVERHEAD,
+                    header, FILE_TAG_OFFSET)) {
+        return NULL;
+    }
+    uint64_t segment_size = get_le64(&header[FILE_SEGMENT_SIZE]);
+    uint64_t length       = get_le64(&header[FILE_LENGTH]);
+    if (segment_size == 0 || segment_size > ROCCA_FILE_MAX_SEGMENT_SIZE) {
+        return NULL;
+    }
+
+    rocca_file* f = calloc(1, sizeof(*f));
+    if (f == NULL) {
+        return NULL;
+    }
+    f->fd           = fd;
+    f->segment_size = (size_t)segment_size;
+    f->length       = length;
+    f->nsegments    = length == 0 ? 1 : (length - 1) / segment_size + 1;
+    if (f->nsegments > file_max_segments(f->segment_size)) {
+        free(f);
+        return NULL;
+    }
+    f->capacity = cache_segments;
+    f->newest   = -1;
+    f->oldest   = -1;
+    memcpy(f->key, key, ROCCA_KEY_SIZE);
+    memcpy(f->header, header, sizeof(header));
+
+    f->nbuckets = 1;
+    while (f->nbuckets < 2 * f->capacity) {
+        f->nbuckets *= 2;
+    }
+    f->ct      = malloc(f->segment_size + ROCCA_OVERHEAD);
+    f->scratch = malloc(f->segment_size);
+    f->buckets = malloc(f->nbuckets * sizeof(*f->buckets));
+    if (f->capacity > 0) {
+        f->entries = calloc(f->capacity, sizeof(*f->entries));
+        f->data    = malloc(f->capacity * f->segment_size);
+    }
+    if (f->ct == NULL || f->scratch == NULL || f->buckets == NULL ||
+        (f->capacity > 0 && (f->entries == NULL || f->data == NULL))) {
+        rocca_file_close(f);
+        return NULL;
+    }
+    for (size_t i = 0; i < f->nbuckets; i++) {
+        f->buckets[i] = -1;
+    }
+    // Every entry starts out unused, at the old end of the list.
+    for (size_t i = 0; i < f->capacity; i++) {
+        file_entry* e = &f->entries[i];
+        e->data       = &f->data[i * f->segment_size];
+        e->next       = -1;
+        e->newer      = i == 0 ? -1 : (int32_t)(i - 1);
+        e->older      = i + 1 == f->capacity ? -1 : (int32_t)(i + 1);
+    }
+    if (f->capacity > 0) {
+        f->newest = 0;
+        f->oldest = (int32_t)(f->capacity - 1);
+    }
+    return f;
+}
+
+void rocca_file_close(rocca_file* f) {
+    if (f == NULL) {
+        return;
+    }
+    if (f->data != NULL) {
+        size_t n = f->capacity * f->segment_size;
+        memset_s(f->data, n, 0, n);
+    }
+    if (f->scratch != NULL) {
+        memset_s(f->scratch, f->segment_size, 0, f->segment_size);
+    }
+    free(f->ct);
+    free(f->scratch);
+    free(f->buckets);
+    free(f->entries);
+    free(f->data);
+    memset_s(f, sizeof(*f), 0, sizeof(*f));
+    free(f);
+}
+
+uint64_t rocca_file_size(const rocca_file* f) {
+    if (f == NULL) {
+        return 0;
+    }
+    return f->length;
+}
+
+// file_segment_len returns the plaintext length of segment |i|.
+static size_t file_segment_len(const rocca_file* f, uint64_t i) {
+    if (i + 1 < f->nsegments) {
+        return f->segment_size;
+    }
+    return (size_t)(f->length - i * f->segment_size);
+}
+
+// file_decrypt reads, verifies and decrypts segment |i| into
+// |dst|.
+static bool file_decrypt(rocca_file* f, uint64_t i, uint8_t* dst) {
+    size_t len   = file_segment_len(f, i);
+    uint64_t off = file_segment_offset(f->segment_size, i);
+    if (!file_pread(f->fd, f->ct, len + ROCCA_OVERHEAD, off)) {
+        return false;
+    }
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+    rocca_nonce_add(&f->header[FILE_NONCE], i, nonce);
+    // rocca_open does not accept a zero-length destination, so
+    // the empty segment of an empty file is opened into |scratch|.
+    return rocca_open(len ? dst : f->scratch, len ? len : f->segment_size,
+                      f->key, ROCCA_KEY_SIZE, nonce, sizeof(nonce), f->ct,
+                      len + ROCCA_OVERHEAD, f->header, FILE_AD_SIZE);
+}
+
+static size_t file_bucket(const rocca_file* f, uint64_t i) {
+    // Fibonacci hashing spreads sequential indices across the
+    // buckets.
+    return (size_t)((i * 0x9e3779b97f4a7c15ull) >> 32) & (f->nbuckets - 1);
+}
+
+// cache_unlink removes entry |k| from the LRU list.
+static void cache_unlink(rocca_file* f, int32_t k) {
+    file_entry* e = &f->entries[k];
+    if (e->newer >= 0) {
+        f->entries[e->newer].older = e->older;
+    } else {
+        f->newest = e->older;
+    }
+    if (e->older >= 0) {
+        f->entries[e->older].newer = e->newer;
+    } else {
+        f->oldest = e->newer;
+    }
+}
+
+// cache_push makes entry |k| the newest.
+static void cache_push(rocca_file* f, int32_t k) {
+    file_entry* e = &f->entries[k];
+    e->newer      = -1;
+    e->older      = f->newest;
+    if (f->newest >= 0) {
+        f->entries[f->newest].newer = k;
+    }
+    f->newest = k;
+    if (f->oldest < 0) {
+        f->oldest = k;
+    }
+}
+
+// cache_remove removes entry |k| from its hash chain.
+static void cache_remove(rocca_file* f, int32_t k) {
+    file_entry* e = &f->entries[k];
+    int32_t* p    = &f->buckets[file_bucket(f, e->index)];
+    while (*p != k) {
+        p = &f->entries[*p].next;
+    }
+    *p       = e->next;
+    e->valid = false;
+}
+
+// cache_get returns the decrypted segment |i|, either from the
+// cache or by reading it into the least recently used entry.
+static const uint8_t* cache_get(rocca_file* f, uint64_t i) {
+    size_t b = file_bucket(f, i);
+    for (int32_t k = f->buckets[b]; k >= 0; k = f->entries[k].next) {
+        if (f->entries[k].index == i) {
+            cache_unlink(f, k);
+            cache_push(f, k);
+            return f->entries[k].data;
+        }
+    }
+
+    int32_t k     = f->oldest;
+    file_entry* e = &f->entries[k];
+    if (e->valid) {
+        cache_remove(f, k);
+    }
+    if (!file_decrypt(f, i, e->data)) {
+        // rocca_open has wiped the entry. Leave it unused, at
+        // the old end of the list.
+        return NULL;
+    }
+    e->index      = i;
+    e->valid      = true;
+    e->next       = f->buckets[b];
+    f->buckets[b] = k;
+    cache_unlink(f, k);
+    cache_push(f, k);
+    return e->data;
+}
+
+bool rocca_file_pread(rocca_file* f,
+                      uint8_t* dst,
+                      size_t dst_len,
+                      uint64_t offset,
+                      size_t* n) {
+    if (n != NULL) {
+        *n = 0;
+    }
+    if (f == NULL || (dst == NULL && dst_len != 0)) {
+        return false;
+    }
+    if (offset >= f->length || dst_len == 0) {
+        return true;
+    }
+    if (dst_len > f->length - offset) {
+        dst_len = (size_t)(f->length - offset);
+    }
+
+    size_t done = 0;
+    while (done < dst_len) {
+        uint64_t pos   = offset + done;
+        uint64_t i     = pos / f->segment_size;
+        size_t skip    = (size_t)(pos % f->segment_size);
+        size_t seg_len = file_segment_len(f, i);
+        size_t m       = seg_len - skip;
+        if (m > dst_len - done) {
+            m = dst_len - done;
+        }
+
+        const uint8_t* src = NULL;
+        if (f->capacity > 0) {
+            src = cache_get(f, i);
+        } else if (skip == 0 && m == seg_len) {
+            // The whole segment is wanted, so skip the copy.
+            if (file_decrypt(f, i, &dst[done])) {
+                done += m;
+                continue;
+            }
+        } else if (file_decrypt(f, i, f->scratch)) {
+            src = f->scratch;
+        }
+        if (src == NULL) {
+            memset_s(dst, dst_len, 0, dst_len);
+            return false;
+        }
+        memcpy(&dst[done], &src[skip], m);
+        done += m;
+    }
+    if (n != NULL) {
+        *n = done;
+    }
+    return true;
+}
@@ -0,0 +1,378 @@
+#ifndef ROCCA_IMPL_H
+#define ROCCA_IMPL_H
+
+// This file contains the Rocca core shared by the translation
+// units in src/. It is not a public header.
+
+#ifndef __STDC_WANT_LIB_EXT1__
+#define __STDC_WANT_LIB_EXT1__ 1
+#endif // __STDC_WANT_LIB_EXT1__
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rocca.h"
+
+#include "rocca_backend.h"
+
+#if !defined(__STDC_LIB_EXT1__) && !defined(__APPLE__)
+// memset_s is optional (C11 Annex K) and glibc does not provide
+// it, so fall back to memset followed by a compiler barrier that
+// keeps the stores from being elided.
+static inline int rocca_memset_s(void* s, size_t smax, int c, size_t n) {
+    if (n > smax) {
+        n = smax;
+    }
+    memset(s, c, n);
+    __asm__ __volatile__("" : : "r"(s) : "memory");
+    return 0;
+}
+#define memset_s rocca_memset_s
+#endif // !defined(__STDC_LIB_EXT1__) && !defined(__APPLE__)
+
+enum {
+    // ROCCA_ROUNDS is the number of state update rounds performed by
+    // |rocca_init| and |rocca_mac|.
+    ROCCA_ROUNDS = 20,
+    // ROCCA_BLOCK_SIZE is the size of one Rocca block.
+    ROCCA_BLOCK_SIZE = 32,
+};
+
+// Z0: A constant block defined as Z0 = 428a2f98d728ae227137449123ef65cd.
+static const uint8_t Z0[16] = {
+    0xcd, 0x65, 0xef, 0x23, 0x91, 0x44, 0x37, 0x71,
+    0x22, 0xae, 0x28, 0xd7, 0x98, 0x2f, 0x8a, 0x42,
+};
+
+// Z1: A constant block defined as Z1 = b5c0fbcfec4d3b2fe9b5dba58189dbbc.
+static const uint8_t Z1[16] = {
+    0xbc, 0xdb, 0x89, 0x81, 0xa5, 0xdb, 0xb5, 0xe9,
+    0x2f, 0x3b, 0x4d, 0xec, 0xcf, 0xfb, 0xc0, 0xb5,
+};
+
+typedef u128 rocca_state[8];
+
+static inline void rocca_update(rocca_state s, u128 x0, u128 x1) {
+    u128 t0 = xor_u128(s[7], x0);    // Snew[0] = S[7] ⊕ X0
+    u128 t1 = aes_round(s[0], s[7]); // Snew[1] = AES(S[0], S[7])
+    u128 t2 = xor_u128(s[1], s[6]);  // Snew[2] = S[1] ⊕ S[6]
+    u128 t3 = aes_round(s[2], s[1]); // Snew[3] = AES(S[2], S[1])
+    u128 t4 = xor_u128(s[3], x1);    // Snew[4] = S[3] ⊕ X1
+    u128 t5 = aes_round(s[4], s[3]); // Snew[5] = AES(S[4], S[3])
+    u128 t6 = aes_round(s[5], s[4]); // Snew[6] = AES(S[5], S[4])
+    u128 t7 = xor_u128(s[0], s[6]);  // Snew[7] = S[0] ⊕ S[6]
+
+    s[0] = t0;
+    s[1] = t1;
+    s[2] = t2;
+    s[3] = t3;
+    s[4] = t4;
+    s[5] = t5;
+    s[6] = t6;
+    s[7] = t7;
+}
+
+// rocca_init_load loads |key| and |nonce| into |s|, ready for
+// the rounds of |rocca_init|.
+static inline void rocca_init_load(rocca_state s,
+                                   const uint8_t key[ROCCA_KEY_SIZE],
+                                   const uint8_t nonce[ROCCA_NONCE_SIZE]) {
+    u128 k0 = load_u128(&key[0]);
+    u128 k1 = load_u128(&key[ROCCA_KEY_SIZE / 2]);
+    u128 N  = load_u128(nonce);
+
+    // First, (N,K0,K1) is loaded into the state S in the
+    // following way:
+    s[0] = k1;              // S[0] = K1
+    s[1] = N;               // S[1] = N
+    s[2] = load_u128(Z0);   // S[2] = Z0
+    s[3] = load_u128(Z1);   // S[3] = Z1
+    s[4] = xor_u128(N, k1); // S[4] = N ⊕ K1
+    s[5] = zero_u128();     // S[5] = 0
+    s[6] = k0;              // S[6] = K0
+    s[7] = zero_u128();     // S[7] = 0
+}
+
+static inline void rocca_init(rocca_state s,
+                              const uint8_t key[ROCCA_KEY_SIZE],
+                              const uint8_t nonce[ROCCA_NONCE_SIZE]) {
+    u128 z0 = load_u128(Z0);
+    u128 z1 = load_u128(Z1);
+    rocca_init_load(s, key, nonce);
+
+    // Then, 20 iterations of the round function R(S,Z0,Z1) is
+    // applied to the state S.
+    for (int i = 0; i < ROCCA_ROUNDS; i++) {
+        rocca_update(s, z0, z1);
+    }
+}
+
+// rocca_enc_u128 is |rocca_enc| for a block that has already
+// been loaded.
+static inline void rocca_enc_u128(rocca_state s,
+                                  uint8_t dst[ROCCA_BLOCK_SIZE],
+                                  u128 m0,
+                                  u128 m1) {
+    // Ci0 = AES(S[1], S[5]) ⊕ M0i
+    u128 c0 = aes_round(s[1], s[5]);
+    c0      = xor_u128(c0, m0);
+
+    // Ci1 = AES(S[0] ⊕ S[4], S[2]) ⊕ M1i
+    u128 c1 = xor_u128(s[0], s[4]);
+    c1      = aes_round(c1, s[2]);
+    c1      = xor_u128(c1, m1);
+
+    store_u128(&dst[0], c0);
+    store_u128(&dst[ROCCA_BLOCK_SIZE / 2], c1);
+
+    // R(S, Mi0, Mi1)
+    rocca_update(s, m0, m1);
+}
+
+static inline void rocca_enc(rocca_state s,
+                             uint8_t dst[ROCCA_BLOCK_SIZE],
+                             const uint8_t src[ROCCA_BLOCK_SIZE]) {
+    u128 m0 = load_u128(&src[0]);
+    u128 m1 = load_u128(&src[ROCCA_BLOCK_SIZE / 2]);
+    rocca_enc_u128(s, dst, m0, m1);
+}
+
+static inline void rocca_dec(rocca_state s,
+                             uint8_t dst[ROCCA_BLOCK_SIZE],
+                             const uint8_t src[ROCCA_BLOCK_SIZE]) {
+    u128 c0 = load_u128(&src[0]);
+    u128 c1 = load_u128(&src[ROCCA_BLOCK_SIZE / 2]);
+
+    u128 m0 = aes_round(s[1], s[5]);
+    m0      = xor_u128(m0, c0);
+
+    u128 m1 = xor_u128(s[0], s[4]);
+    m1      = aes_round(m1, s[2]);
+    m1      = xor_u128(m1, c1);
+
+    store_u128(&dst[0], m0);
+    store_u128(&dst[ROCCA_BLOCK_SIZE / 2], m1);
+
+    rocca_update(s, m0, m1);
+}
+
+static inline void rocca_dec_partial(rocca_state s,
+                                     uint8_t* dst,
+                                     size_t dst_len,
+                                     const uint8_t src[ROCCA_BLOCK_SIZE]) {
+    u128 c0 = load_u128(&src[0]);
+    u128 c1 = load_u128(&src[ROCCA_BLOCK_SIZE / 2]);
+
+    u128 m0 = aes_round(s[1], s[5]);
+    m0      = xor_u128(m0, c0);
+
+    u128 m1 = xor_u128(s[0], s[4]);
+    m1      = aes_round(m1, s[2]);
+    m1      = xor_u128(m1, c1);
+
+    uint8_t pad[ROCCA_BLOCK_SIZE] = {0};
+    store_u128(&pad[0], m0);
+    store_u128(&pad[ROCCA_BLOCK_SIZE / 2], m1);
+    memset(&pad[dst_len], 0, sizeof(pad) - dst_len);
+    memcpy(dst, pad, dst_len);
+
+    u128 p0 = load_u128(&pad[0]);
+    u128 p1 = load_u128(&pad[ROCCA_BLOCK_SIZE / 2]);
+    rocca_update(s, p0, p1);
+}
+
+static inline void put_le64(uint8_t* b, uint64_t v) {
+    b[0] = (uint8_t)(v);
+    b[1] = (uint8_t)(v >> 8);
+    b[2] = (uint8_t)(v >> 16);
+    b[3] = (uint8_t)(v >> 24);
+    b[4] = (uint8_t)(v >> 32);
+    b[5] = (uint8_t)(v >> 40);
+    b[6] = (uint8_t)(v >> 48);
+    b[7] = (uint8_t)(v >> 56);
+}
+
+// rocca_nonce_add writes |base| + |i| to |dst|, treating the
+// nonce as a 128-bit big-endian integer.
+static inline void rocca_nonce_add(const uint8_t base[ROCCA_NONCE_SIZE],
+                                   uint64_t i,
+                                   uint8_t dst[ROCCA_NONCE_SIZE]) {
+    unsigned carry = 0;
+    for (int j = ROCCA_NONCE_SIZE - 1; j >= 0; j--) {
+        unsigned v = base[j] + (unsigned)(i & 0xff) + carry;
+        dst[j]     = (uint8_t)v;
+        carry      = v >> 8;
+        i >>= 8;
+    }
+}
+
+// rocca_mac_lengths sets |ad| and |pt| to the lengths in bits
+// that |rocca_mac| feeds to each round.
+static inline void rocca_mac_lengths(uint64_t additional_data_len,
+                                     uint64_t plaintext_len,
+                                     u128* ad,
+                                     u128* pt) {
+    uint8_t buf[16] = {0};
+
+    put_le64(buf, additional_data_len * 8);
+    *ad = load_u128(buf);
+
+    put_le64(buf, plaintext_len * 8);
+    *pt = load_u128(buf);
+}
+
+// rocca_tag folds |s| into the tag once the rounds of
+// |rocca_mac| are done.
+static inline u128 rocca_tag(const rocca_state s) {
+    //  T ← 0
+    //  for i = 0 to 7 do
+    //    T ← T ⊕ S[i]
+    u128 tag = s[0];
+    for (int i = 1; i < 8; i++) {
+        tag = xor_u128(tag, s[i]);
+    }
+    return tag;
+}
+
+static inline u128 rocca_mac(rocca_state s,
+                             uint64_t additional_data_len,
+                             uint64_t plaintext_len) {
+    u128 ad, pt;
+    rocca_mac_lengths(additional_data_len, plaintext_len, &ad, &pt);
+
+    //  for i = 0 to 19 do
+    //    S ← R(S, |AD|, |M|)
+    for (int i = 0; i < ROCCA_ROUNDS; i++) {
+        rocca_update(s, ad, pt);
+    }
+    return rocca_tag(s);
+}
+
+static inline uint64_t get_le64(const uint8_t* b) {
+    return (uint64_t)b[0] | ((uint64_t)b[1] << 8) | ((uint64_t)b[2] << 16) |
+           ((uint64_t)b[3] << 24) | ((uint64_t)b[4] << 32) |
+           ((uint64_t)b[5] << 40) | ((uint64_t)b[6] << 48) |
+           ((uint64_t)b[7] << 56);
+}
+
+// rocca_absorb authenticates |additional_data_len| bytes from
+// |additional_data|, zero padding the final block.
+static inline void rocca_absorb(rocca_state s,
+                                const uint8_t* additional_data,
+                                size_t additional_data_len) {
+    // Authenticate full blocks.
+    size_t nblocks = additional_data_len / ROCCA_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        u128 a0 = load_u128(&additional_data[i * ROCCA_BLOCK_SIZE]);
+        u128 a1 = load_u128(
+            &additional_data[i * ROCCA_BLOCK_SIZE + ROCCA_BLOCK_SIZE / 2]);
+        rocca_update(s, a0, a1);
+    }
+
+    // Authenticate a partial block.
+    size_t remain = additional_data_len % ROCCA_BLOCK_SIZE;
+    if (remain != 0) {
+        uint8_t tmp[ROCCA_BLOCK_SIZE] = {0};
+        memcpy(tmp, &additional_data[nblocks * ROCCA_BLOCK_SIZE], remain);
+        u128 a0 = load_u128(&tmp[0]);
+        u128 a1 = load_u128(&tmp[ROCCA_BLOCK_SIZE / 2]);
+        rocca_update(s, a0, a1);
+    }
+}
+
+// rocca_keystream writes the keystream for the next block to
+// |dst| without updating the state.
+static inline void rocca_keystream(const rocca_state s,
+                                   uint8_t dst[ROCCA_BLOCK_SIZE]) {
+    u128 k0 = aes_round(s[1], s[5]);
+    u128 k1 = aes_round(xor_u128(s[0], s[4]), s[2]);
+    store_u128(&dst[0], k0);
+    store_u128(&dst[ROCCA_BLOCK_SIZE / 2], k1);
+}
+
+// rocca_seal_state encrypts and authenticates |plaintext| and
+// |additional_data| using the initialized state |s| and writes
+// the ciphertext followed by the tag to |dst|.
+//
+// The arguments must already be validated.
+static inline void rocca_seal_state(rocca_state s,
+                                    uint8_t* dst,
+                                    const uint8_t* plaintext,
+                                    size_t plaintext_len,
+                                    const uint8_t* additional_data,
+                                    size_t additional_data_len) {
+    uint8_t tmp[ROCCA_BLOCK_SIZE] = {0};
+
+    rocca_absorb(s, additional_data, additional_data_len);
+
+    // Encrypt full blocks.
+    size_t nblocks = plaintext_len / ROCCA_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        rocca_enc(s, &dst[i * ROCCA_BLOCK_SIZE],
+                  &plaintext[i * ROCCA_BLOCK_SIZE]);
+    }
+
+    // Encrypt a partial block.
+    size_t remain = plaintext_len % ROCCA_BLOCK_SIZE;
+    if (remain != 0) {
+        memset(tmp, 0, sizeof(tmp));
+        memcpy(tmp, &plaintext[nblocks * ROCCA_BLOCK_SIZE], remain);
+        rocca_enc(s, tmp, tmp);
+        memcpy(&dst[nblocks * ROCCA_BLOCK_SIZE], tmp, remain);
+    }
+
+    u128 tag = rocca_mac(s, additional_data_len, plaintext_len);
+    store_u128(&dst[(nblocks * ROCCA_BLOCK_SIZE) + remain], tag);
+
+    memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+}
+
+// rocca_open_state decrypts and authenticates |ciphertext|
+// (which includes the tag) and |additional_data| using the
+// initialized state |s| and writes the plaintext to |dst|.
+//
+// It returns true on success and false otherwise. If it returns
+// false, |dst_len| bytes of |dst| will be filled with zeros.
+//
+// The arguments must already be validated.
+static inline bool rocca_open_state(rocca_state s,
+                                    uint8_t* dst,
+                                    size_t dst_len,
+                                    const uint8_t* ciphertext,
+                                    size_t ciphertext_len,
+                                    const uint8_t* additional_data,
+                                    size_t additional_data_len) {
+    ciphertext_len -= ROCCA_TAG_SIZE;
+    u128 tag = load_u128(&ciphertext[ciphertext_len]);
+
+    uint8_t tmp[ROCCA_BLOCK_SIZE] = {0};
+
+    rocca_absorb(s, additional_data, additional_data_len);
+
+    // Decrypt full blocks.
+    size_t nblocks = ciphertext_len / ROCCA_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        rocca_dec(s, &dst[i * ROCCA_BLOCK_SIZE],
+                  &ciphertext[i * ROCCA_BLOCK_SIZE]);
+    }
+
+    // Decrypt a partial block.
+    size_t remain = ciphertext_len % ROCCA_BLOCK_SIZE;
+    if (remain != 0) {
+        memset(tmp, 0, sizeof(tmp));
+        memcpy(tmp, &ciphertext[nblocks * ROCCA_BLOCK_SIZE], remain);
+        rocca_dec_partial(s, &dst[nblocks * ROCCA_BLOCK_SIZE], remain, tmp);
+    }
+
+    memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+
+    u128 expectedTag = rocca_mac(s, additional_data_len, ciphertext_len);
+    if (!constant_time_compare_u128(tag, expectedTag)) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    return true;
+}
+
+#endif // ROCCA_IMPL_H
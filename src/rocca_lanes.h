@@ -0,0 +1,124 @@
+#ifndef ROCCA_LANES_H
+#define ROCCA_LANES_H
+
+// This file contains multi-lane Rocca sealing: up to
+// |ROCCA_LANES| independent messages, each with its own key and
+// nonce, are processed in lockstep so that the AES rounds of
+// different lanes can overlap in the pipeline. It is not
+// a public header.
+
+#include "rocca_impl.h"
+
+enum {
+    // ROCCA_LANES is the maximum number of lanes processed
+    // together. The number actually used is the |lanes| setting
+    // of the current |rocca_tuning|.
+    ROCCA_LANES = ROCCA_TUNING_MAX_LANES,
+};
+
+// rocca_lane is one message in a multi-lane seal. The arguments
+// must already be validated, as for |rocca_seal_state|.
+typedef struct rocca_lane {
+    const uint8_t* key;
+    const uint8_t* nonce;
+    uint8_t* dst;
+    const uint8_t* plaintext;
+    size_t plaintext_len;
+    const uint8_t* additional_data;
+    size_t additional_data_len;
+} rocca_lane;
+
+// rocca_init_lanes is |rocca_init| for |n| lanes.
+static inline void rocca_init_lanes(rocca_state* s,
+                                    const rocca_lane* lanes,
+                                    size_t n) {
+    u128 z0 = load_u128(Z0);
+    u128 z1 = load_u128(Z1);
+    for (size_t j = 0; j < n; j++) {
+        rocca_init_load(s[j], lanes[j].key, lanes[j].nonce);
+    }
+    for (int i = 0; i < ROCCA_ROUNDS; i++) {
+        for (size_t j = 0; j < n; j++) {
+            rocca_update(s[j], z0, z1);
+        }
+    }
+}
+
+// rocca_mac_lanes is |rocca_mac| for |n| lanes.
+static inline void rocca_mac_lanes(rocca_state* s,
+                                   const rocca_lane* lanes,
+                                   size_t n,
+                                   u128 tags[ROCCA_LANES]) {
+    u128 ad[ROCCA_LANES];
+    u128 pt[ROCCA_LANES];
+    for (size_t j = 0; j < n; j++) {
+        rocca_mac_lengths(lanes[j].additional_data_len,
+                          lanes[j].plaintext_len, &ad[j], &pt[j]);
+    }
+    for (int i = 0; i < ROCCA_ROUNDS; i++) {
+        for (size_t j = 0; j < n; j++) {
+            rocca_update(s[j], ad[j], pt[j]);
+        }
+    }
+    for (size_t j = 0; j < n; j++) {
+        tags[j] = rocca_tag(s[j]);
+    }
+}
+
+// rocca_seal_lanes is |rocca_seal_state| for |n| lanes,
+// including initialization.
+//
+// Initialization, finalization and the blocks that every lane
+// has are interleaved. The rest of each lane is processed on its
+// own.
+//
+// Each lane's |dst| may be the same as its |plaintext|.
+static inline void rocca_seal_lanes(const rocca_lane* lanes, size_t n) {
+    rocca_state s[ROCCA_LANES];
+    rocca_init_lanes(s, lanes, n);
+
+    size_t common = SIZE_MAX;
+    for (size_t j = 0; j < n; j++) {
+        rocca_absorb(s[j], lanes[j].additional_data,
+                     lanes[j].additional_data_len);
+        size_t nblocks = lanes[j].plaintext_len / ROCCA_BLOCK_SIZE;
+        if (nblocks < common) {
+            common = nblocks;
+        }
+    }
+
+    for (size_t i = 0; i < common; i++) {
+        size_t off = i * ROCCA_BLOCK_SIZE;
+        for (size_t j = 0; j < n; j++) {
+            rocca_enc(s[j], &lanes[j].dst[off], &lanes[j].plaintext[off]);
+        }
+    }
+
+    uint8_t tmp[ROCCA_BLOCK_SIZE];
+    for (size_t j = 0; j < n; j++) {
+        const rocca_lane* l = &lanes[j];
+        size_t nblocks      = l->plaintext_len / ROCCA_BLOCK_SIZE;
+        for (size_t i = common; i < nblocks; i++) {
+            rocca_enc(s[j], &l->dst[i * ROCCA_BLOCK_SIZE],
+                      &l->plaintext[i * ROCCA_BLOCK_SIZE]);
+        }
+        size_t remain = l->plaintext_len % ROCCA_BLOCK_SIZE;
+        if (remain != 0) {
+            memset(tmp, 0, sizeof(tmp));
+            memcpy(tmp, &l->plaintext[nblocks * ROCCA_BLOCK_SIZE], remain);
+            rocca_enc(s[j], tmp, tmp);
+            memcpy(&l->dst[nblocks * ROCCA_BLOCK_SIZE], tmp, remain);
+        }
+    }
+
+    u128 tags[ROCCA_LANES];
+    rocca_mac_lanes(s, lanes, n, tags);
+    for (size_t j = 0; j < n; j++) {
+        store_u128(&lanes[j].dst[lanes[j].plaintext_len], tags[j]);
+    }
+
+    memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+    memset_s(s, sizeof(s), 0, sizeof(s));
+}
+
+#endif // ROCCA_LANES_H
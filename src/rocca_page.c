@@ -0,0 +1,244 @@
+#include "rocca.h"
+
+#include "rocca_impl.h"
+#include "rocca_lanes.h"
+
+// A sealed page is laid out as
+//
+//    header (header_len bytes) | payload | tag (ROCCA_TAG_SIZE)
+//
+// The header is authenticated as additional data and left in
+// the clear. The payload is encrypted in place. The nonce is
+// the page number followed by the LSN, both little endian.
+struct rocca_page_cipher {
+    uint8_t key[ROCCA_KEY_SIZE];
+    size_t page_size;
+    size_t header_len;
+    size_t payload_len;
+};
+
+rocca_page_cipher* rocca_page_cipher_new(const uint8_t key[ROCCA_KEY_SIZE],
+                                         size_t key_len,
+                                         size_t page_size,
+                                         size_t header_len) {
+    if (key == NULL || key_len != ROCCA_KEY_SIZE) {
+        return NULL;
+    }
+    if (page_size > ROCCA_PAGE_MAX_SIZE || page_size < ROCCA_TAG_SIZE ||
+        header_len > page_size - ROCCA_TAG_SIZE) {
+        return NULL;
+    }
+    rocca_page_cipher* c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+        return NULL;
+    }
+    memcpy(c->key, key, ROCCA_KEY_SIZE);
+    c->page_size   = page_size;
+    c->header_len  = header_len;
+    c->payload_len = page_size - header_len - ROCCA_TAG_SIZE;
+    return c;
+}
+
+void rocca_page_cipher_free(rocca_page_cipher* c) {
+    if (c == NULL) {
+        return;
+    }
+    memset_s(c, sizeof(*c), 0, sizeof(*c));
+    free(c);
+}
+
+// page_nonce writes the nonce for |page_no| and |lsn| to |dst|.
+static void page_nonce(uint64_t page_no,
+                       uint64_t lsn,
+                       uint8_t dst[ROCCA_NONCE_SIZE]) {
+    put_le64(&dst[0], page_no);
+    put_le64(&dst[8], lsn);
+}
+
+// page_lane sets up |lane| to seal or open |p| in place. The
+// nonce is written to |nonce|, which must outlive the lane.
+static void page_lane(const rocca_page_cipher* c,
+                      const rocca_page* p,
+                      uint8_t nonce[ROCCA_NONCE_SIZE],
+                      rocca_lane* lane) {
+    page_nonce(p->page_no, p->lsn, nonce);
+    uint8_t* payload = &p->data[c->header_len];
+    *lane            = (rocca_lane){
+        .key                 = c->key,
+        .nonce               = nonce,
+        .dst                 = payload,
+        .plaintext           = c->payload_len ? payload : NULL,
+        .plaintext_len       = c->payload_len,
+        .additional_data     = c->header_len ? p->data : NULL,
+        .additional_data_len = c->header_len,
+    };
+}
+
+// page_open_lanes decrypts and verifies |n| pages in place,
+// interleaving their states, and returns the number that are
+// authentic. The rest are filled with zeros.
+static size_t page_open_lanes(const rocca_page_cipher* c,
+                              rocca_page* const* pages,
+                              size_t n) {
+    rocca_lane lanes[ROCCA_LANES];
+    uint8_t nonces[ROCCA_LANES][ROCCA_NONCE_SIZE];
+    u128 want[ROCCA_LANES];
+    for (size_t j = 0; j < n; j++) {
+        page_lane(c, pages[j], nonces[j], &lanes[j]);
+        want[j] = load_u128(&lanes[j].dst[c->payload_len]);
+    }
+
+    rocca_state s[ROCCA_LANES];
+    rocca_init_lanes(s, lanes, n);
+    for (size_t j = 0; j < n; j++) {
+        rocca_absorb(s[j], lanes[j].additional_data,
+                     lanes[j].additional_data_len);
+    }
+
+    // Every page has the same length, so every block is common.
+    size_t nblocks = c->payload_len / ROCCA_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        size_t off = i * ROCCA_BLOCK_SIZE;
+        for (size_t j = 0; j < n; j++) {
+            rocca_dec(s[j], &lanes[j].dst[off], &lanes[j].dst[off]);
+        }
+    }
+    size_t remain = c->payload_len % ROCCA_BLOCK_SIZE;
+    if (remain != 0) {
+        uint8_t tmp[ROCCA_BLOCK_SIZE];
+        for (size_t j = 0; j < n; j++) {
+            uint8_t* p = &lanes[j].dst[nblocks * ROCCA_BLOCK_SIZE];
+            memset(tmp, 0, sizeof(tmp));
+            memcpy(tmp, p, remain);
+            rocca_dec_partial(s[j], p, remain, tmp);
+        }
+        memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+    }
+
+    u128 tags[ROCCA_LANES];
+    rocca_mac_lanes(s, lanes, n, tags);
+    size_t opened = 0;
+    for (size_t j = 0; j < n; j++) {
+        rocca_page* p = pages[j];
+        p->ok         = constant_time_compare_u128(want[j], tags[j]);
+        if (!p->ok) {
+            memset_s(p->data, c->page_size, 0, c->page_size);
+        }
+        opened += p->ok;
+    }
+    memset_s(s, sizeof(s), 0, sizeof(s));
+    return opened;
+}
+
+size_t rocca_page_seal_batch(const rocca_page_cipher* c,
+                             rocca_page* pages,
+                             size_t n) {
+    if (c == NULL || pages == NULL) {
+        return 0;
+    }
+    rocca_tuning tuning;
+    rocca_tuning_get(&tuning);
+    rocca_lane lanes[ROCCA_LANES];
+    uint8_t nonces[ROCCA_LANES][ROCCA_NONCE_SIZE];
+    size_t nlanes = 0;
+    size_t sealed = 0;
+    for (size_t i = 0; i < n; i++) {
+        rocca_page* p = &pages[i];
+        p->ok         = p->data != NULL;
+        if (!p->ok) {
+            continue;
+        }
+        page_lane(c, p, nonces[nlanes], &lanes[nlanes]);
+        if (++nlanes == tuning.lanes) {
+            rocca_seal_lanes(lanes, nlanes);
+            sealed += nlanes;
+            nlanes = 0;
+        }
+    }
+    if (nlanes != 0) {
+        rocca_seal_lanes(lanes, nlanes);
+        sealed += nlanes;
+    }
+    return sealed;
+}
+
+size_t rocca_page_open_batch(const rocca_page_cipher* c,
+                             rocca_page* pages,
+                             size_t n) {
+    if (c == NULL || pages == NULL) {
+        return 0;
+    }
+    rocca_tuning tuning;
+    rocca_tuning_get(&tuning);
+    rocca_page* group[ROCCA_LANES];
+    size_t ngroup = 0;
+    size_t opened = 0;
+    for (size_t i = 0; i < n; i++) {
+        rocca_page* p = &pages[i];
+        p->ok         = false;
+        if (p->data == NULL) {
+            continue;
+        }
+        group[ngroup++] = p;
+        if (ngroup == tuning.lanes) {
+            opened += page_open_lanes(c, group, ngroup);
+            ngroup = 0;
+        }
+    }
+    if (ngroup != 0) {
+        opened += page_open_lanes(c, group, ngroup);
+    }
+    return opened;
+}
+
+bool rocca_page_seal(const rocca_page_cipher* c,
+                     uint8_t* page,
+                     uint64_t page_no,
+                     uint64_t lsn) {
+    rocca_page p = {.data = page, .page_no = page_no, .lsn = lsn};
+    return rocca_page_seal_batch(c, &p, 1) == 1;
+}
+
+bool rocca_page_open(const rocca_page_cipher* c,
+                     uint8_t* page,
+                     uint64_t page_no,
+                     uint64_t lsn) {
+    rocca_page p = {.data = page, .page_no = page_no, .lsn = lsn};
+    return rocca_page_open_batch(c, &p, 1) == 1;
+}
+
+bool rocca_page_verify(const rocca_page_cipher* c,
+                       const uint8_t* page,
+                       uint64_t page_no,
+                       uint64_t lsn) {
+    if (c == NULL || page == NULL) {
+        return false;
+    }
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+    page_nonce(page_no, lsn, nonce);
+    rocca_state s;
+    rocca_init(s, c->key, nonce);
+    rocca_absorb(s, c->header_len ? page : NULL, c->header_len);
+
+    // Decrypt into a scratch block so that the page is not
+    // modified.
+    const uint8_t* payload = &page[c->header_len];
+    uint8_t tmp[ROCCA_BLOCK_SIZE];
+    size_t nblocks = c->payload_len / ROCCA_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        rocca_dec(s, tmp, &payload[i * ROCCA_BLOCK_SIZE]);
+    }
+    size_t remain = c->payload_len % ROCCA_BLOCK_SIZE;
+    if (remain != 0) {
+        memset(tmp, 0, sizeof(tmp));
+        memcpy(tmp, &payload[nblocks * ROCCA_BLOCK_SIZE], remain);
+        rocca_dec_partial(s, tmp, remain, tmp);
+    }
+
+    u128 want = load_u128(&payload[c->payload_len]);
+    u128 got  = rocca_mac(s, c->header_len, c->payload_len);
+    bool ok   = constant_time_compare_u128(want, got);
+    memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+    memset_s(s, sizeof(s), 0, sizeof(s));
+    return ok;
+}
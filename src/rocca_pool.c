@@ -0,0 +1,372 @@
+#include "rocca.h"
+
+#include <pthread.h>
+
+#include "rocca_impl.h"
+
+enum {
+    POOL_MODE_NONE = 0,
+    POOL_MODE_SEAL = 1,
+    POOL_MODE_OPEN = 2,
+};
+
+struct rocca_state_pool {
+    pthread_mutex_t mu;
+    // more is signaled whenever a state is taken or the pool is
+    // being freed.
+    pthread_cond_t more;
+    pthread_t thread;
+    bool running;
+    bool stop;
+    int mode;
+
+    uint8_t key[ROCCA_KEY_SIZE];
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+
+    // next is the index of the next nonce to hand out. The
+    // states for [next, filled) are ready in |slots|, with the
+    // state for index i stored at i % capacity.
+    uint64_t next;
+    uint64_t filled;
+    size_t capacity;
+    rocca_state* slots;
+};
+
+// pool_nonce writes the nonce for index |i| to |dst|.
+static void pool_nonce(const rocca_state_pool* pool,
+                       uint64_t i,
+                       uint8_t dst[ROCCA_NONCE_SIZE]) {
+    rocca_nonce_add(pool->nonce, i, dst);
+}
+
+// pool_index writes the index of |nonce| in the sequence of
+// |pool| to |i|. It returns false if |nonce| is not in the first
+// 2^64 nonces of the sequence.
+static bool pool_index(const rocca_state_pool* pool,
+                       const uint8_t nonce[ROCCA_NONCE_SIZE],
+                       uint64_t* i) {
+    // The nonces wrap around like |rocca_nonce_add|, so the
+    // borrow out of the top byte is dropped.
+    uint8_t diff[ROCCA_NONCE_SIZE];
+    unsigned borrow = 0;
+    for (int j = ROCCA_NONCE_SIZE - 1; j >= 0; j--) {
+        unsigned v = (unsigned)nonce[j] - pool->nonce[j] - borrow;
+        diff[j]    = (uint8_t)v;
+        borrow     = (v >> 8) & 1;
+    }
+    uint64_t v = 0;
+    for (int j = 0; j < ROCCA_NONCE_SIZE; j++) {
+        if (j < ROCCA_NONCE_SIZE - 8 && diff[j] != 0) {
+            return false;
+        }
+        v = (v << 8) | diff[j];
+    }
+    *i = v;
+    return true;
+}
+
+rocca_state_pool* rocca_state_pool_new(const uint8_t key[ROCCA_KEY_SIZE],
+                                       size_t key_len,
+                                       const uint8_t nonce[ROCCA_NONCE_SIZE],
+                                       size_t nonce_len,
+                                       size_t capacity) {
+    if (key == NULL || key_len != ROCCA_KEY_SIZE) {
+        return NULL;
+    }
+    if (nonce == NULL || nonce_len != ROCCA_NONCE_SIZE) {
+        return NULL;
+    }
+    if (capacity == 0 || capacity > SIZE_MAX / sizeof(rocca_state)) {
+        return NULL;
+    }
+
+    rocca_state_pool* pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->slots = calloc(capacity, sizeof(rocca_state));
+    if (pool->slots == NULL) {
+        free(pool);
+        return NULL;
+    }
+    if (pthread_mutex_init(&pool->mu, NULL) != 0) {
+        free(pool->slots);
+        free(pool);
+        return NULL;
+    }
+    if (pthread_cond_init(&pool->more, NULL) != 0) {
+        pthread_mutex_destroy(&pool->mu);
+        free(pool->slots);
+        free(pool);
+        return NULL;
+    }
+    memcpy(pool->key, key, ROCCA_KEY_SIZE);
+    memcpy(pool->nonce, nonce, ROCCA_NONCE_SIZE);
+    pool->capacity = capacity;
+    return pool;
+}
+
+void rocca_state_pool_free(rocca_state_pool* pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mu);
+    pool->stop   = true;
+    bool running = pool->running;
+    pthread_cond_broadcast(&pool->more);
+    pthread_mutex_unlock(&pool->mu);
+    if (running) {
+        pthread_join(pool->thread, NULL);
+    }
+
+    pthread_cond_destroy(&pool->more);
+    pthread_mutex_destroy(&pool->mu);
+    size_t n = pool->capacity * sizeof(rocca_state);
+    memset_s(pool->slots, n, 0, n);
+    free(pool->slots);
+    memset_s(pool, sizeof(*pool), 0, sizeof(*pool));
+    free(pool);
+}
+
+size_t rocca_state_pool_fill(rocca_state_pool* pool, size_t max) {
+    if (pool == NULL) {
+        return 0;
+    }
+
+    size_t added = 0;
+    rocca_state s;
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+    while (added < max) {
+        pthread_mutex_lock(&pool->mu);
+        if (pool->stop || pool->filled - pool->next >= pool->capacity) {
+            pthread_mutex_unlock(&pool->mu);
+            break;
+        }
+        uint64_t i = pool->filled;
+        pthread_mutex_unlock(&pool->mu);
+
+        // The expensive part happens outside of the lock so that
+        // seal and open never wait on it.
+        pool_nonce(pool, i, nonce);
+        rocca_init(s, pool->key, nonce);
+
+        pthread_mutex_lock(&pool->mu);
+        // If a consumer already moved past |i|, or another filler
+        // won the race, the state is stale and must be dropped.
+        bool ok = i == pool->filled && i >= pool->next &&
+                  pool->filled - pool->next < pool->capacity;
+        if (ok) {
+            memcpy(pool->slots[i % pool->capacity], s, sizeof(s));
+            pool->filled++;
+            added++;
+        }
+        pthread_mutex_unlock(&pool->mu);
+        if (!ok) {
+            break;
+        }
+    }
+    memset_s(s, sizeof(s), 0, sizeof(s));
+    return added;
+}
+
+static void* pool_thread(void* arg) {
+    rocca_state_pool* pool = arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->mu);
+        while (!pool->stop && pool->filled - pool->next >= pool->capacity) {
+            pthread_cond_wait(&pool->more, &pool->mu);
+        }
+        bool stop = pool->stop;
+        pthread_mutex_unlock(&pool->mu);
+        if (stop) {
+            return NULL;
+        }
+        rocca_state_pool_fill(pool, pool->capacity);
+    }
+}
+
+bool rocca_state_pool_start(rocca_state_pool* pool) {
+    if (pool == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&pool->mu);
+    bool ok = !pool->running && !pool->stop;
+    if (ok) {
+        ok = pthread_create(&pool->thread, NULL, pool_thread, pool) == 0;
+        pool->running = ok;
+    }
+    pthread_mutex_unlock(&pool->mu);
+    return ok;
+}
+
+// pool_take removes the state for the next nonce from |pool|
+// and writes it to |s|, computing it inline if it is not ready.
+static bool pool_take(rocca_state_pool* pool,
+                      rocca_state s,
+                      uint8_t nonce[ROCCA_NONCE_SIZE]) {
+    pthread_mutex_lock(&pool->mu);
+    if (pool->mode == POOL_MODE_OPEN) {
+        pthread_mutex_unlock(&pool->mu);
+        return false;
+    }
+    pool->mode = POOL_MODE_SEAL;
+
+    uint64_t i = pool->next;
+    pool_nonce(pool, i, nonce);
+
+    bool ready = i < pool->filled;
+    if (ready) {
+        rocca_state* slot = &pool->slots[i % pool->capacity];
+        memcpy(s, *slot, sizeof(rocca_state));
+        memset_s(*slot, sizeof(*slot), 0, sizeof(*slot));
+    }
+    pool->next++;
+    if (pool->filled < pool->next) {
+        pool->filled = pool->next;
+    }
+    pthread_cond_signal(&pool->more);
+    pthread_mutex_unlock(&pool->mu);
+
+    if (!ready) {
+        rocca_init(s, pool->key, nonce);
+    }
+    return true;
+}
+
+// pool_peek writes the state for |nonce| to |s| without removing
+// it from |pool|, computing it inline if it is not ready. It
+// returns false if |pool| is sealing.
+//
+// |*in_window| is set if |nonce| is the next nonce or is less
+// than |capacity| nonces ahead of it, in which case |*i| is its
+// index for |pool_commit|.
+static bool pool_peek(rocca_state_pool* pool,
+                      const uint8_t nonce[ROCCA_NONCE_SIZE],
+                      rocca_state s,
+                      uint64_t* i,
+                      bool* in_window) {
+    pthread_mutex_lock(&pool->mu);
+    if (pool->mode == POOL_MODE_SEAL) {
+        pthread_mutex_unlock(&pool->mu);
+        return false;
+    }
+    *in_window = pool_index(pool, nonce, i) && *i >= pool->next &&
+                 *i - pool->next < pool->capacity;
+    bool ready = *in_window && *i < pool->filled;
+    if (ready) {
+        memcpy(s, pool->slots[*i % pool->capacity], sizeof(rocca_state));
+    }
+    pthread_mutex_unlock(&pool->mu);
+
+    if (!ready) {
+        rocca_init(s, pool->key, nonce);
+    }
+    return true;
+}
+
+// pool_commit removes the state for index |i| from |pool| and
+// wipes the states of the nonces before it, so the sequence
+// continues after |i|. It is only called once a message for |i|
+// is authentic, and does nothing if another open has already
+// moved past |i|.
+static void pool_commit(rocca_state_pool* pool, uint64_t i) {
+    pthread_mutex_lock(&pool->mu);
+    if (pool->mode != POOL_MODE_SEAL && i >= pool->next) {
+        // A nonce ahead of the next one means that the messages
+        // in between were lost or reordered. Skipping them keeps
+        // the pool in step with the sender.
+        pool->mode = POOL_MODE_OPEN;
+        for (uint64_t j = pool->next; j <= i && j < pool->filled; j++) {
+            rocca_state* slot = &pool->slots[j % pool->capacity];
+            memset_s(*slot, sizeof(*slot), 0, sizeof(*slot));
+        }
+        pool->next = i + 1;
+        if (pool->filled < pool->next) {
+            pool->filled = pool->next;
+        }
+        pthread_cond_signal(&pool->more);
+    }
+    pthread_mutex_unlock(&pool->mu);
+}
+
+bool rocca_state_pool_seal(rocca_state_pool* pool,
+                           uint8_t nonce[ROCCA_NONCE_SIZE],
+                           uint8_t* dst,
+                           size_t dst_len,
+                           const uint8_t* plaintext,
+                           size_t plaintext_len,
+                           const uint8_t* additional_data,
+                           size_t additional_data_len) {
+    if (dst == NULL) {
+        return false;
+    }
+    if (pool == NULL || nonce == NULL) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if ((SIZE_MAX - plaintext_len) < ROCCA_OVERHEAD ||
+        dst_len < plaintext_len + ROCCA_OVERHEAD) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if (((plaintext == NULL) != (plaintext_len == 0)) ||
+        ((additional_data == NULL) != (additional_data_len == 0))) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+
+    rocca_state s;
+    if (!pool_take(pool, s, nonce)) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    rocca_seal_state(s, dst, plaintext, plaintext_len, additional_data,
+                     additional_data_len);
+    memset_s(s, sizeof(s), 0, sizeof(s));
+    return true;
+}
+
+bool rocca_state_pool_open(rocca_state_pool* pool,
+                           const uint8_t nonce[ROCCA_NONCE_SIZE],
+                           size_t nonce_len,
+                           uint8_t* dst,
+                           size_t dst_len,
+                           const uint8_t* ciphertext,
+                           size_t ciphertext_len,
+                           const uint8_t* additional_data,
+                           size_t additional_data_len) {
+    if (dst == NULL) {
+        return false;
+    }
+    if (pool == NULL || nonce == NULL || nonce_len != ROCCA_NONCE_SIZE) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if (ciphertext == NULL || ciphertext_len < ROCCA_OVERHEAD ||
+        dst_len < ciphertext_len - ROCCA_OVERHEAD) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if ((additional_data == NULL) != (additional_data_len == 0)) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+
+    // The state is only consumed once the ciphertext is found to
+    // be authentic, so that forgeries cannot advance the pool.
+    rocca_state s;
+    uint64_t i = 0;
+    bool in_window;
+    if (!pool_peek(pool, nonce, s, &i, &in_window)) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    bool ok = rocca_open_state(s, dst, dst_len, ciphertext, ciphertext_len,
+                               additional_data, additional_data_len);
+    memset_s(s, sizeof(s), 0, sizeof(s));
+    if (ok && in_window) {
+        pool_commit(pool, i);
+    }
+    return ok;
+}
@@ -0,0 +1,291 @@
+#include "rocca.h"
+
+#include "rocca_impl.h"
+
+// Rocca-S as specified in draft-nakano-rocca-s. It shares the
+// constants, block size and AES round primitives with Rocca but
+// has a seven block state, a different round function and
+// a 256-bit tag.
+
+enum {
+    // ROCCA_S_ROUNDS is the number of state update rounds
+    // performed by |rocca_s_init| and |rocca_s_mac|.
+    ROCCA_S_ROUNDS = 16,
+};
+
+typedef u128 rocca_s_state[7];
+
+static void rocca_s_update(rocca_s_state s, u128 x0, u128 x1) {
+    u128 t0 = xor_u128(s[6], s[1]);  // Snew[0] = S[6] ⊕ S[1]
+    u128 t1 = aes_round(s[0], x0);   // Snew[1] = AES(S[0], X0)
+    u128 t2 = aes_round(s[1], s[0]); // Snew[2] = AES(S[1], S[0])
+    u128 t3 = aes_round(s[2], s[6]); // Snew[3] = AES(S[2], S[6])
+    u128 t4 = aes_round(s[3], x1);   // Snew[4] = AES(S[3], X1)
+    u128 t5 = aes_round(s[4], s[3]); // Snew[5] = AES(S[4], S[3])
+    u128 t6 = aes_round(s[5], s[4]); // Snew[6] = AES(S[5], S[4])
+
+    s[0] = t0;
+    s[1] = t1;
+    s[2] = t2;
+    s[3] = t3;
+    s[4] = t4;
+    s[5] = t5;
+    s[6] = t6;
+}
+
+static void rocca_s_init(rocca_s_state s,
+                         const uint8_t key[ROCCA_S_KEY_SIZE],
+                         const uint8_t nonce[ROCCA_S_NONCE_SIZE]) {
+    u128 z0 = load_u128(Z0);
+    u128 z1 = load_u128(Z1);
+    u128 k0 = load_u128(&key[0]);
+    u128 k1 = load_u128(&key[ROCCA_S_KEY_SIZE / 2]);
+    u128 N  = load_u128(nonce);
+
+    s[0] = k1;              // S[0] = K1
+    s[1] = N;               // S[1] = N
+    s[2] = z0;              // S[2] = Z0
+    s[3] = k0;              // S[3] = K0
+    s[4] = z1;              // S[4] = Z1
+    s[5] = xor_u128(N, k1); // S[5] = N ⊕ K1
+    s[6] = zero_u128();     // S[6] = 0
+
+    for (int i = 0; i < ROCCA_S_ROUNDS; i++) {
+        rocca_s_update(s, z0, z1);
+    }
+
+    // Finally, the key is XORed back into the state.
+    s[0] = xor_u128(s[0], k0);
+    s[1] = xor_u128(s[1], k0);
+    s[2] = xor_u128(s[2], k1);
+    s[3] = xor_u128(s[3], k0);
+    s[4] = xor_u128(s[4], k0);
+    s[5] = xor_u128(s[5], k1);
+    s[6] = xor_u128(s[6], k1);
+}
+
+// rocca_s_keystream returns the keystream for the next block.
+static void rocca_s_keystream(const rocca_s_state s, u128* k0, u128* k1) {
+    // Ci0 = AES(S[3] ⊕ S[5], S[0]) ⊕ Mi0
+    *k0 = aes_round(xor_u128(s[3], s[5]), s[0]);
+    // Ci1 = AES(S[4] ⊕ S[6], S[2]) ⊕ Mi1
+    *k1 = aes_round(xor_u128(s[4], s[6]), s[2]);
+}
+
+static void rocca_s_enc(rocca_s_state s,
+                        uint8_t dst[ROCCA_BLOCK_SIZE],
+                        const uint8_t src[ROCCA_BLOCK_SIZE]) {
+    u128 k0, k1;
+    rocca_s_keystream(s, &k0, &k1);
+    u128 m0 = load_u128(&src[0]);
+    u128 m1 = load_u128(&src[ROCCA_BLOCK_SIZE / 2]);
+    store_u128(&dst[0], xor_u128(m0, k0));
+    store_u128(&dst[ROCCA_BLOCK_SIZE / 2], xor_u128(m1, k1));
+    rocca_s_update(s, m0, m1);
+}
+
+static void rocca_s_dec(rocca_s_state s,
+                        uint8_t dst[ROCCA_BLOCK_SIZE],
+                        const uint8_t src[ROCCA_BLOCK_SIZE]) {
+    u128 k0, k1;
+    rocca_s_keystream(s, &k0, &k1);
+    u128 m0 = xor_u128(load_u128(&src[0]), k0);
+    u128 m1 = xor_u128(load_u128(&src[ROCCA_BLOCK_SIZE / 2]), k1);
+    store_u128(&dst[0], m0);
+    store_u128(&dst[ROCCA_BLOCK_SIZE / 2], m1);
+    rocca_s_update(s, m0, m1);
+}
+
+static void rocca_s_dec_partial(rocca_s_state s,
+                                uint8_t* dst,
+                                size_t dst_len,
+                                const uint8_t src[ROCCA_BLOCK_SIZE]) {
+    u128 k0, k1;
+    rocca_s_keystream(s, &k0, &k1);
+    u128 m0 = xor_u128(load_u128(&src[0]), k0);
+    u128 m1 = xor_u128(load_u128(&src[ROCCA_BLOCK_SIZE / 2]), k1);
+
+    uint8_t pad[ROCCA_BLOCK_SIZE] = {0};
+    store_u128(&pad[0], m0);
+    store_u128(&pad[ROCCA_BLOCK_SIZE / 2], m1);
+    memset(&pad[dst_len], 0, sizeof(pad) - dst_len);
+    memcpy(dst, pad, dst_len);
+
+    u128 p0 = load_u128(&pad[0]);
+    u128 p1 = load_u128(&pad[ROCCA_BLOCK_SIZE / 2]);
+    rocca_s_update(s, p0, p1);
+    memset_s(pad, sizeof(pad), 0, sizeof(pad));
+}
+
+static void rocca_s_absorb(rocca_s_state s,
+                           const uint8_t* additional_data,
+                           size_t additional_data_len) {
+    size_t nblocks = additional_data_len / ROCCA_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        const uint8_t* p = &additional_data[i * ROCCA_BLOCK_SIZE];
+        rocca_s_update(s, load_u128(&p[0]),
+                       load_u128(&p[ROCCA_BLOCK_SIZE / 2]));
+    }
+    size_t remain = additional_data_len % ROCCA_BLOCK_SIZE;
+    if (remain != 0) {
+        uint8_t tmp[ROCCA_BLOCK_SIZE] = {0};
+        memcpy(tmp, &additional_data[nblocks * ROCCA_BLOCK_SIZE], remain);
+        rocca_s_update(s, load_u128(&tmp[0]),
+                       load_u128(&tmp[ROCCA_BLOCK_SIZE / 2]));
+    }
+}
+
+// le128_bits returns the length |n| in bits as a 128-bit
+// little-endian integer.
+static u128 le128_bits(uint64_t n) {
+    uint8_t buf[16];
+    put_le64(&buf[0], n << 3);
+    put_le64(&buf[8], n >> 61);
+    return load_u128(buf);
+}
+
+static void rocca_s_mac(rocca_s_state s,
+                        uint64_t additional_data_len,
+                        uint64_t plaintext_len,
+                        uint8_t tag[ROCCA_S_TAG_SIZE]) {
+    u128 ad = le128_bits(additional_data_len);
+    u128 pt = le128_bits(plaintext_len);
+
+    //  for i = 0 to 15 do
+    //    S ← R(S, LE128(|AD|), LE128(|M|))
+    for (int i = 0; i < ROCCA_S_ROUNDS; i++) {
+        rocca_s_update(s, ad, pt);
+    }
+
+    //  T ← (S[0] ⊕ S[1] ⊕ S[2] ⊕ S[3]) || (S[4] ⊕ S[5] ⊕ S[6])
+    u128 t0 = xor_u128(xor_u128(s[0], s[1]), xor_u128(s[2], s[3]));
+    u128 t1 = xor_u128(xor_u128(s[4], s[5]), s[6]);
+    store_u128(&tag[0], t0);
+    store_u128(&tag[ROCCA_S_TAG_SIZE / 2], t1);
+}
+
+bool rocca_s_seal(uint8_t* dst,
+                  size_t dst_len,
+                  const uint8_t key[ROCCA_S_KEY_SIZE],
+                  size_t key_len,
+                  const uint8_t nonce[ROCCA_S_NONCE_SIZE],
+                  size_t nonce_len,
+                  const uint8_t* plaintext,
+                  size_t plaintext_len,
+                  const uint8_t* additional_data,
+                  size_t additional_data_len) {
+    if (dst == NULL) {
+        return false;
+    }
+    if ((SIZE_MAX - plaintext_len) < ROCCA_S_OVERHEAD ||
+        dst_len < plaintext_len + ROCCA_S_OVERHEAD) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if (key == NULL || key_len != ROCCA_S_KEY_SIZE) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if (nonce == NULL || nonce_len != ROCCA_S_NONCE_SIZE) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if (((plaintext == NULL) != (plaintext_len == 0)) ||
+        ((additional_data == NULL) != (additional_data_len == 0))) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+
+    rocca_s_state s;
+    rocca_s_init(s, key, nonce);
+    rocca_s_absorb(s, additional_data, additional_data_len);
+
+    // Encrypt full blocks.
+    size_t nblocks = plaintext_len / ROCCA_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        rocca_s_enc(s, &dst[i * ROCCA_BLOCK_SIZE],
+                    &plaintext[i * ROCCA_BLOCK_SIZE]);
+    }
+
+    // Encrypt a partial block.
+    size_t remain = plaintext_len % ROCCA_BLOCK_SIZE;
+    if (remain != 0) {
+        uint8_t tmp[ROCCA_BLOCK_SIZE] = {0};
+        memcpy(tmp, &plaintext[nblocks * ROCCA_BLOCK_SIZE], remain);
+        rocca_s_enc(s, tmp, tmp);
+        memcpy(&dst[nblocks * ROCCA_BLOCK_SIZE], tmp, remain);
+        memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+    }
+
+    rocca_s_mac(s, additional_data_len, plaintext_len, &dst[plaintext_len]);
+    memset_s(s, sizeof(s), 0, sizeof(s));
+    return true;
+}
+
+bool rocca_s_open(uint8_t* dst,
+                  size_t dst_len,
+                  const uint8_t key[ROCCA_S_KEY_SIZE],
+                  size_t key_len,
+                  const uint8_t nonce[ROCCA_S_NONCE_SIZE],
+                  size_t nonce_len,
+                  const uint8_t* ciphertext,
+                  size_t ciphertext_len,
+                  const uint8_t* additional_data,
+                  size_t additional_data_len) {
+    if (dst == NULL) {
+        return false;
+    }
+    if (ciphertext == NULL || ciphertext_len < ROCCA_S_OVERHEAD ||
+        dst_len < ciphertext_len - ROCCA_S_OVERHEAD) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if (key == NULL || key_len != ROCCA_S_KEY_SIZE) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if (nonce == NULL || nonce_len != ROCCA_S_NONCE_SIZE) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    if ((additional_data == NULL) != (additional_data_len == 0)) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+
+    ciphertext_len -= ROCCA_S_TAG_SIZE;
+    u128 tag0 = load_u128(&ciphertext[ciphertext_len]);
+    u128 tag1 = load_u128(&ciphertext[ciphertext_len + ROCCA_S_TAG_SIZE / 2]);
+
+    rocca_s_state s;
+    rocca_s_init(s, key, nonce);
+    rocca_s_absorb(s, additional_data, additional_data_len);
+
+    // Decrypt full blocks.
+    size_t nblocks = ciphertext_len / ROCCA_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        rocca_s_dec(s, &dst[i * ROCCA_BLOCK_SIZE],
+                    &ciphertext[i * ROCCA_BLOCK_SIZE]);
+    }
+
+    // Decrypt a partial block.
+    size_t remain = ciphertext_len % ROCCA_BLOCK_SIZE;
+    if (remain != 0) {
+        uint8_t tmp[ROCCA_BLOCK_SIZE] = {0};
+        memcpy(tmp, &ciphertext[nblocks * ROCCA_BLOCK_SIZE], remain);
+        rocca_s_dec_partial(s, &dst[nblocks * ROCCA_BLOCK_SIZE], remain, tmp);
+    }
+
+    uint8_t expectedTag[ROCCA_S_TAG_SIZE];
+    rocca_s_mac(s, additional_data_len, ciphertext_len, expectedTag);
+    memset_s(s, sizeof(s), 0, sizeof(s));
+
+    bool ok = constant_time_compare_u128(tag0, load_u128(&expectedTag[0]));
+    ok &= constant_time_compare_u128(
+        tag1, load_u128(&expectedTag[ROCCA_S_TAG_SIZE / 2]));
+    if (!ok) {
+        memset_s(dst, dst_len, 0, dst_len);
+        return false;
+    }
+    return true;
+}
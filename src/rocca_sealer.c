@@ -0,0 +1,180 @@
+#include "rocca.h"
+
+#include "rocca_impl.h"
+
+struct rocca_sealer {
+    // The pending message and the message pushed after it use
+    // the two states in turn, so that neither is ever copied.
+    rocca_state states[2];
+    unsigned cur;
+    uint8_t key[ROCCA_KEY_SIZE];
+    // pending is the message whose tag has not been written yet,
+    // or NULL. If it is valid, |states[cur]| is its state after
+    // the last block of plaintext.
+    rocca_sealer_msg* pending;
+    // interleave is |rocca_tuning.sealer_interleave| when the
+    // sealer was created.
+    bool interleave;
+};
+
+rocca_sealer* rocca_sealer_new(const uint8_t key[ROCCA_KEY_SIZE],
+                               size_t key_len) {
+    if (key == NULL || key_len != ROCCA_KEY_SIZE) {
+        return NULL;
+    }
+    rocca_sealer* p = calloc(1, sizeof(*p));
+    if (p == NULL) {
+        return NULL;
+    }
+    memcpy(p->key, key, ROCCA_KEY_SIZE);
+
+    rocca_tuning tuning;
+    rocca_tuning_get(&tuning);
+    p->interleave = tuning.sealer_interleave;
+    return p;
+}
+
+void rocca_sealer_free(rocca_sealer* p) {
+    if (p == NULL) {
+        return;
+    }
+    memset_s(p, sizeof(*p), 0, sizeof(*p));
+    free(p);
+}
+
+// sealer_ok validates |msg| as |rocca_seal| would.
+static bool sealer_ok(const rocca_sealer_msg* msg) {
+    if (msg->dst == NULL) {
+        return false;
+    }
+    if ((SIZE_MAX - msg->plaintext_len) < ROCCA_OVERHEAD ||
+        msg->dst_len < msg->plaintext_len + ROCCA_OVERHEAD) {
+        return false;
+    }
+    if (msg->nonce == NULL || msg->nonce_len != ROCCA_NONCE_SIZE) {
+        return false;
+    }
+    if (((msg->plaintext == NULL) != (msg->plaintext_len == 0)) ||
+        ((msg->additional_data == NULL) != (msg->additional_data_len == 0))) {
+        return false;
+    }
+    return true;
+}
+
+// sealer_encrypt authenticates the additional data of |msg| and
+// encrypts its plaintext to |dst|, leaving |s| ready for
+// |rocca_mac|.
+static void sealer_encrypt(rocca_state s, const rocca_sealer_msg* msg) {
+    rocca_absorb(s, msg->additional_data, msg->additional_data_len);
+
+    size_t nblocks = msg->plaintext_len / ROCCA_BLOCK_SIZE;
+    for (size_t i = 0; i < nblocks; i++) {
+        rocca_enc(s, &msg->dst[i * ROCCA_BLOCK_SIZE],
+                  &msg->plaintext[i * ROCCA_BLOCK_SIZE]);
+    }
+    size_t remain = msg->plaintext_len % ROCCA_BLOCK_SIZE;
+    if (remain != 0) {
+        uint8_t tmp[ROCCA_BLOCK_SIZE] = {0};
+        memcpy(tmp, &msg->plaintext[nblocks * ROCCA_BLOCK_SIZE], remain);
+        rocca_enc(s, tmp, tmp);
+        memcpy(&msg->dst[nblocks * ROCCA_BLOCK_SIZE], tmp, remain);
+        memset_s(tmp, sizeof(tmp), 0, sizeof(tmp));
+    }
+}
+
+// sealer_mac_init is |rocca_mac| of |src| for |msg| and
+// |rocca_init| of |dst| for |key| and |nonce|, with the rounds
+// of the two interleaved.
+static u128 sealer_mac_init(const rocca_state src,
+                            const rocca_sealer_msg* msg,
+                            rocca_state dst,
+                            const uint8_t key[ROCCA_KEY_SIZE],
+                            const uint8_t nonce[ROCCA_NONCE_SIZE]) {
+    // The rounds work on locals, which the compiler keeps in
+    // registers, rather than on the sealer, which it does not.
+    rocca_state s;
+    rocca_state t;
+    memcpy(s, src, sizeof(s));
+
+    u128 ad, pt;
+    rocca_mac_lengths(msg->additional_data_len, msg->plaintext_len, &ad,
+                      &pt);
+
+    u128 z0 = load_u128(Z0);
+    u128 z1 = load_u128(Z1);
+    rocca_init_load(t, key, nonce);
+
+    // Unrolling lets the compiler rename the two states from one
+    // round to the next instead of moving them between registers,
+    // which matters once they no longer fit in registers.
+#pragma GCC unroll 20
+    for (int i = 0; i < ROCCA_ROUNDS; i++) {
+        rocca_update(s, ad, pt);
+        rocca_update(t, z0, z1);
+    }
+    memcpy(dst, t, sizeof(t));
+
+    u128 tag = rocca_tag(s);
+    // |t| is now in the sealer, so only |s| needs wiping.
+    memset_s(s, sizeof(s), 0, sizeof(s));
+    return tag;
+}
+
+// sealer_finish writes |tag| to the pending message, if it is
+// valid, and returns the message.
+static rocca_sealer_msg* sealer_finish(rocca_sealer* p, u128 tag) {
+    rocca_sealer_msg* msg = p->pending;
+    if (msg != NULL && msg->ok) {
+        store_u128(&msg->dst[msg->plaintext_len], tag);
+    }
+    p->pending = NULL;
+    return msg;
+}
+
+rocca_sealer_msg* rocca_sealer_push(rocca_sealer* p, rocca_sealer_msg* msg) {
+    if (p == NULL || msg == NULL) {
+        return NULL;
+    }
+    msg->ok = sealer_ok(msg);
+    if (!msg->ok && msg->dst != NULL) {
+        memset_s(msg->dst, msg->dst_len, 0, msg->dst_len);
+    }
+
+    u128* s                      = p->states[p->cur];
+    u128* t                      = p->states[p->cur ^ 1];
+    u128 tag                     = zero_u128();
+    const rocca_sealer_msg* prev = p->pending;
+    bool finish                  = prev != NULL && prev->ok;
+    bool fused                   = finish && msg->ok && p->interleave;
+    if (fused) {
+        tag = sealer_mac_init(s, prev, t, p->key, msg->nonce);
+    } else if (finish) {
+        tag = rocca_mac(s, prev->additional_data_len, prev->plaintext_len);
+    }
+    rocca_sealer_msg* done = sealer_finish(p, tag);
+
+    if (msg->ok) {
+        if (!fused) {
+            rocca_init(t, p->key, msg->nonce);
+        }
+        sealer_encrypt(t, msg);
+    }
+    p->cur ^= 1;
+    p->pending = msg;
+    return done;
+}
+
+rocca_sealer_msg* rocca_sealer_flush(rocca_sealer* p) {
+    if (p == NULL || p->pending == NULL) {
+        return NULL;
+    }
+    const rocca_sealer_msg* msg = p->pending;
+    u128 tag                    = zero_u128();
+    if (msg->ok) {
+        tag = rocca_mac(p->states[p->cur], msg->additional_data_len,
+                        msg->plaintext_len);
+    }
+    rocca_sealer_msg* done = sealer_finish(p, tag);
+    memset_s(p->states, sizeof(p->states), 0, sizeof(p->states));
+    return done;
+}
@@ -0,0 +1,204 @@
+#include "rocca.h"
+
+#include "rocca_impl.h"
+#include "rocca_lanes.h"
+
+struct rocca_session_table {
+    size_t capacity;
+    // Each array is indexed by session id and starts on its own
+    // |ROCCA_BUF_ALIGN| byte boundary.
+    uint8_t (*keys)[ROCCA_KEY_SIZE];
+    uint8_t (*nonces)[ROCCA_NONCE_SIZE];
+    uint64_t* counters;
+    uint64_t* messages;
+    uint64_t* bytes;
+    bool* active;
+};
+
+// session_alloc allocates |n| zeroed elements of |size| bytes
+// on a |ROCCA_BUF_ALIGN| byte boundary.
+static void* session_alloc(size_t n, size_t size) {
+    if (n > (SIZE_MAX - ROCCA_BUF_ALIGN) / size) {
+        return NULL;
+    }
+    size_t len = (n * size + ROCCA_BUF_ALIGN - 1) / ROCCA_BUF_ALIGN *
+                 ROCCA_BUF_ALIGN;
+    void* p = aligned_alloc(ROCCA_BUF_ALIGN, len);
+    if (p != NULL) {
+        memset(p, 0, len);
+    }
+    return p;
+}
+
+rocca_session_table* rocca_session_table_new(size_t capacity) {
+    if (capacity == 0) {
+        return NULL;
+    }
+    rocca_session_table* table = calloc(1, sizeof(*table));
+    if (table == NULL) {
+        return NULL;
+    }
+    table->capacity = capacity;
+    table->keys     = session_alloc(capacity, ROCCA_KEY_SIZE);
+    table->nonces   = session_alloc(capacity, ROCCA_NONCE_SIZE);
+    table->counters = session_alloc(capacity, sizeof(uint64_t));
+    table->messages = session_alloc(capacity, sizeof(uint64_t));
+    table->bytes    = session_alloc(capacity, sizeof(uint64_t));
+    table->active   = session_alloc(capacity, sizeof(bool));
+    if (table->keys == NULL || table->nonces == NULL ||
+        table->counters == NULL || table->messages == NULL ||
+        table->bytes == NULL || table->active == NULL) {
+        rocca_session_table_free(table);
+        return NULL;
+    }
+    return table;
+}
+
+void rocca_session_table_free(rocca_session_table* table) {
+    if (table == NULL) {
+        return;
+    }
+    if (table->keys != NULL) {
+        size_t n = table->capacity * ROCCA_KEY_SIZE;
+        memset_s(table->keys, n, 0, n);
+    }
+    free(table->keys);
+    free(table->nonces);
+    free(table->counters);
+    free(table->messages);
+    free(table->bytes);
+    free(table->active);
+    free(table);
+}
+
+bool rocca_session_set(rocca_session_table* table,
+                       size_t id,
+                       const uint8_t key[ROCCA_KEY_SIZE],
+                       size_t key_len,
+                       const uint8_t nonce[ROCCA_NONCE_SIZE],
+                       size_t nonce_len) {
+    if (table == NULL || id >= table->capacity) {
+        return false;
+    }
+    if (key == NULL || key_len != ROCCA_KEY_SIZE) {
+        return false;
+    }
+    if (nonce == NULL || nonce_len != ROCCA_NONCE_SIZE) {
+        return false;
+    }
+    memcpy(table->keys[id], key, ROCCA_KEY_SIZE);
+    memcpy(table->nonces[id], nonce, ROCCA_NONCE_SIZE);
+    table->counters[id] = 0;
+    table->messages[id] = 0;
+    table->bytes[id]    = 0;
+    table->active[id]   = true;
+    return true;
+}
+
+void rocca_session_clear(rocca_session_table* table, size_t id) {
+    if (table == NULL || id >= table->capacity) {
+        return;
+    }
+    memset_s(table->keys[id], ROCCA_KEY_SIZE, 0, ROCCA_KEY_SIZE);
+    memset(table->nonces[id], 0, ROCCA_NONCE_SIZE);
+    table->counters[id] = 0;
+    table->messages[id] = 0;
+    table->bytes[id]    = 0;
+    table->active[id]   = false;
+}
+
+bool rocca_session_stats(const rocca_session_table* table,
+                         size_t id,
+                         uint64_t* messages,
+                         uint64_t* bytes) {
+    if (table == NULL || id >= table->capacity || !table->active[id]) {
+        return false;
+    }
+    if (messages != NULL) {
+        *messages = table->messages[id];
+    }
+    if (bytes != NULL) {
+        *bytes = table->bytes[id];
+    }
+    return true;
+}
+
+// session_msg_ok validates |m| as |rocca_seal| would.
+static bool session_msg_ok(const rocca_session_table* table,
+                           const rocca_session_msg* m) {
+    if (m->session >= table->capacity || !table->active[m->session] ||
+        table->counters[m->session] == UINT64_MAX) {
+        return false;
+    }
+    if ((SIZE_MAX - m->plaintext_len) < ROCCA_OVERHEAD ||
+        m->dst_len < m->plaintext_len + ROCCA_OVERHEAD) {
+        return false;
+    }
+    if (((m->plaintext == NULL) != (m->plaintext_len == 0)) ||
+        ((m->additional_data == NULL) != (m->additional_data_len == 0))) {
+        return false;
+    }
+    return true;
+}
+
+size_t rocca_session_seal_batch(rocca_session_table* table,
+                                rocca_session_msg* msgs,
+                                size_t n) {
+    if (table == NULL || msgs == NULL) {
+        return 0;
+    }
+
+    // Start loading every session the batch touches before any
+    // of them is needed.
+    for (size_t i = 0; i < n; i++) {
+        size_t id = msgs[i].session;
+        if (id < table->capacity) {
+            __builtin_prefetch(table->keys[id]);
+            __builtin_prefetch(table->nonces[id]);
+            __builtin_prefetch(&table->counters[id], 1);
+        }
+    }
+
+    rocca_tuning tuning;
+    rocca_tuning_get(&tuning);
+    rocca_lane lanes[ROCCA_LANES];
+    size_t nlanes = 0;
+    size_t sealed = 0;
+    for (size_t i = 0; i < n; i++) {
+        rocca_session_msg* m = &msgs[i];
+        if (m->dst == NULL || !session_msg_ok(table, m)) {
+            if (m->dst != NULL) {
+                memset_s(m->dst, m->dst_len, 0, m->dst_len);
+            }
+            memset(m->nonce, 0, sizeof(m->nonce));
+            m->ok = false;
+            continue;
+        }
+
+        size_t id = m->session;
+        rocca_nonce_add(table->nonces[id], table->counters[id]++, m->nonce);
+        table->messages[id]++;
+        table->bytes[id] += m->plaintext_len;
+        m->ok = true;
+
+        lanes[nlanes++] = (rocca_lane){
+            .key                 = table->keys[id],
+            .nonce               = m->nonce,
+            .dst                 = m->dst,
+            .plaintext           = m->plaintext,
+            .plaintext_len       = m->plaintext_len,
+            .additional_data     = m->additional_data,
+            .additional_data_len = m->additional_data_len,
+        };
+        if (nlanes == tuning.lanes) {
+            rocca_seal_lanes(lanes, nlanes);
+            sealed += nlanes;
+            nlanes = 0;
+        }
+    }
+    if (nlanes != 0) {
+        rocca_seal_lanes(lanes, nlanes);
+        sealed += nlanes;
+    }
+    return sealed;
+}
@@ -0,0 +1,504 @@
+#include "rocca.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif // defined(__x86_64__) || defined(__i386__)
+
+#include "rocca_impl.h"
+#include "rocca_lanes.h"
+
+enum {
+    // TUNE_DEFAULT_CHUNK is the default |fanout_chunk|. It is
+    // small enough to stay in the L1 cache and large enough that
+    // each recipient writes long runs of ciphertext.
+    TUNE_DEFAULT_CHUNK = 16 * 1024,
+    // TUNE_REPS is the number of times each alternative is timed.
+    // Only the fastest run counts, which filters out interrupts.
+    TUNE_REPS = 8,
+    // TUNE_MARGIN is how much faster, in percent, an alternative
+    // must be than the default to replace it.
+    TUNE_MARGIN = 5,
+    // The workloads that are timed. Each run takes tens of
+    // microseconds, except for the fan-out that times
+    // |fanout_chunk|, which needs a payload several chunks long.
+    // The fan-out that times |lanes| is short, like the rest of
+    // that mix.
+    TUNE_PAGES          = 32,
+    TUNE_PAGE_SIZE      = 256,
+    TUNE_PAGE_HEADER    = 32,
+    TUNE_RECIPIENTS     = 4,
+    TUNE_FANOUT_LEN     = 128 * 1024,
+    TUNE_MIX_FANOUT_LEN = 2048,
+    TUNE_MSGS           = 32,
+    TUNE_MSG_LEN        = 64,
+    // TUNE_MODEL_MAX is the size of a CPU model string.
+    TUNE_MODEL_MAX = 128,
+    // TUNE_LINE_MAX is the longest line read from the cache.
+    TUNE_LINE_MAX = 512,
+    // TUNE_MAX_VALUES is the most alternatives for one setting.
+    TUNE_MAX_VALUES = 4,
+};
+
+// tune_cache_header is the first line of the cache, which
+// describes the fields of the lines after it.
+static const char tune_cache_header[] =
+    "# rocca tuning: cpu\tbackend\tlanes fanout_chunk sealer_interleave\n";
+
+// The current tuning. Each setting is loaded and stored
+// atomically on its own, since any combination of valid settings
+// is valid.
+static unsigned tune_lanes         = ROCCA_LANES;
+static size_t tune_fanout_chunk    = TUNE_DEFAULT_CHUNK;
+static bool tune_sealer_interleave = false;
+
+// tune_trial is the tuning being measured by |tune_measure| on
+// this thread, or NULL. It stands in for the current tuning on
+// this thread only, so other threads never run with a candidate.
+static _Thread_local const rocca_tuning* tune_trial;
+
+void rocca_tuning_get(rocca_tuning* tuning) {
+    if (tuning == NULL) {
+        return;
+    }
+    if (tune_trial != NULL) {
+        *tuning = *tune_trial;
+        return;
+    }
+    tuning->backend      = ROCCA_BACKEND_NAME;
+    tuning->lanes        = __atomic_load_n(&tune_lanes, __ATOMIC_RELAXED);
+    tuning->fanout_chunk = __atomic_load_n(&tune_fanout_chunk,
+                                           __ATOMIC_RELAXED);
+    tuning->sealer_interleave =
+        __atomic_load_n(&tune_sealer_interleave, __ATOMIC_RELAXED);
+}
+
+// tune_valid reports whether every setting in |t| is in range.
+static bool tune_valid(const rocca_tuning* t) {
+    if (t->lanes < 1 || t->lanes > ROCCA_LANES) {
+        return false;
+    }
+    if (t->fanout_chunk < ROCCA_TUNING_MIN_CHUNK ||
+        t->fanout_chunk > ROCCA_TUNING_MAX_CHUNK ||
+        t->fanout_chunk % ROCCA_BLOCK_SIZE != 0) {
+        return false;
+    }
+    return true;
+}
+
+bool rocca_tuning_set(const rocca_tuning* tuning) {
+    if (tuning == NULL || !tune_valid(tuning)) {
+        return false;
+    }
+    __atomic_store_n(&tune_lanes, tuning->lanes, __ATOMIC_RELAXED);
+    __atomic_store_n(&tune_fanout_chunk, tuning->fanout_chunk,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&tune_sealer_interleave, tuning->sealer_interleave,
+                     __ATOMIC_RELAXED);
+    return true;
+}
+
+static void tune_set_lanes(rocca_tuning* t, size_t v) {
+    t->lanes = (unsigned)v;
+}
+
+static void tune_set_chunk(rocca_tuning* t, size_t v) {
+    t->fanout_chunk = v;
+}
+
+static void tune_set_interleave(rocca_tuning* t, size_t v) {
+    t->sealer_interleave = v != 0;
+}
+
+// tune_ctx holds the workloads that are timed.
+typedef struct tune_ctx {
+    uint8_t* mem;
+    rocca_page_cipher* cipher;
+    rocca_page pages[TUNE_PAGES];
+    rocca_session_table* sessions;
+    rocca_session_msg session_msgs[TUNE_MSGS];
+    const uint8_t* payload;
+    rocca_recipient recipients[TUNE_RECIPIENTS];
+    rocca_sealer_msg msgs[TUNE_MSGS];
+    uint8_t key[ROCCA_KEY_SIZE];
+    uint8_t nonces[TUNE_MSGS][ROCCA_NONCE_SIZE];
+} tune_ctx;
+
+static void tune_ctx_free(tune_ctx* c) {
+    rocca_page_cipher_free(c->cipher);
+    rocca_session_table_free(c->sessions);
+    free(c->mem);
+    free(c);
+}
+
+// tune_ctx_new sets up the workloads. The key and nonces are
+// fixed, which is fine since nothing sealed here leaves this
+// file.
+static tune_ctx* tune_ctx_new(void) {
+    const size_t page_mem   = (size_t)TUNE_PAGES * TUNE_PAGE_SIZE;
+    const size_t fanout_dst = TUNE_FANOUT_LEN + ROCCA_OVERHEAD;
+    const size_t msg_dst    = TUNE_MSG_LEN + ROCCA_OVERHEAD;
+
+    const size_t len = page_mem + TUNE_FANOUT_LEN +
+                       TUNE_RECIPIENTS * fanout_dst + 2 * TUNE_MSGS * msg_dst;
+
+    tune_ctx* c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+        return NULL;
+    }
+    c->mem    = calloc(1, len);
+    c->cipher = rocca_page_cipher_new(c->key, sizeof(c->key), TUNE_PAGE_SIZE,
+                                      TUNE_PAGE_HEADER);
+    c->sessions = rocca_session_table_new(TUNE_MSGS);
+    if (c->mem == NULL || c->cipher == NULL || c->sessions == NULL) {
+        tune_ctx_free(c);
+        return NULL;
+    }
+
+    uint8_t* p = c->mem;
+    for (size_t i = 0; i < TUNE_PAGES; i++) {
+        c->pages[i] = (rocca_page){.data = p, .page_no = i};
+        p += TUNE_PAGE_SIZE;
+    }
+    c->payload = p;
+    p += TUNE_FANOUT_LEN;
+    for (size_t i = 0; i < TUNE_MSGS; i++) {
+        c->nonces[i][0] = (uint8_t)i;
+        if (!rocca_session_set(c->sessions, i, c->key, sizeof(c->key),
+                               c->nonces[i], ROCCA_NONCE_SIZE)) {
+            tune_ctx_free(c);
+            return NULL;
+        }
+    }
+    for (size_t i = 0; i < TUNE_RECIPIENTS; i++) {
+        c->recipients[i] = (rocca_recipient){
+            .key       = c->key,
+            .key_len   = sizeof(c->key),
+            .nonce     = c->nonces[i],
+            .nonce_len = ROCCA_NONCE_SIZE,
+            .dst       = p,
+            .dst_len   = fanout_dst,
+        };
+        p += fanout_dst;
+    }
+    for (size_t i = 0; i < TUNE_MSGS; i++) {
+        c->session_msgs[i] = (rocca_session_msg){
+            .session       = i,
+            .dst           = p,
+            .dst_len       = msg_dst,
+            .plaintext     = c->payload,
+            .plaintext_len = TUNE_MSG_LEN,
+        };
+        p += msg_dst;
+    }
+    for (size_t i = 0; i < TUNE_MSGS; i++) {
+        c->msgs[i] = (rocca_sealer_msg){
+            .nonce         = c->nonces[i],
+            .nonce_len     = ROCCA_NONCE_SIZE,
+            .dst           = p,
+            .dst_len       = msg_dst,
+            .plaintext     = c->payload,
+            .plaintext_len = TUNE_MSG_LEN,
+        };
+        p += msg_dst;
+    }
+    return c;
+}
+
+// tune_run_lanes runs a batch of each API that interleaves
+// |lanes| messages: pages, short messages for many sessions and
+// a short fan-out.
+static void tune_run_lanes(tune_ctx* c) {
+    rocca_page_seal_batch(c->cipher, c->pages, TUNE_PAGES);
+    rocca_session_seal_batch(c->sessions, c->session_msgs, TUNE_MSGS);
+    rocca_seal_fanout(c->recipients, TUNE_RECIPIENTS, c->payload,
+                      TUNE_MIX_FANOUT_LEN, NULL, 0);
+}
+
+static void tune_run_fanout(tune_ctx* c) {
+    rocca_seal_fanout(c->recipients, TUNE_RECIPIENTS, c->payload,
+                      TUNE_FANOUT_LEN, NULL, 0);
+}
+
+// tune_run_sealer creates its sealer on every run, since
+// a sealer keeps the tuning in effect when it is created.
+static void tune_run_sealer(tune_ctx* c) {
+    rocca_sealer* p = rocca_sealer_new(c->key, sizeof(c->key));
+    if (p == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < TUNE_MSGS; i++) {
+        rocca_sealer_push(p, &c->msgs[i]);
+    }
+    rocca_sealer_flush(p);
+    rocca_sealer_free(p);
+}
+
+// tune_now returns a monotonic time in nanoseconds.
+static uint64_t tune_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+// tune_pick times |run| with each of the |n| |values| of one
+// setting written to |trial| by |set| and leaves the fastest in
+// |trial|. |values[0]| is the default, which is kept unless
+// another value is at least |TUNE_MARGIN| percent faster.
+static void tune_pick(tune_ctx* c,
+                      rocca_tuning* trial,
+                      void (*set)(rocca_tuning*, size_t),
+                      const size_t* values,
+                      size_t n,
+                      void (*run)(tune_ctx*)) {
+    uint64_t best[TUNE_MAX_VALUES];
+    for (size_t i = 0; i < n; i++) {
+        best[i] = UINT64_MAX;
+    }
+    // The alternatives take turns so that a slow period does not
+    // count against only one of them. The first round warms up
+    // the caches and is not counted.
+    for (int rep = 0; rep <= TUNE_REPS; rep++) {
+        for (size_t i = 0; i < n; i++) {
+            set(trial, values[i]);
+            uint64_t start = tune_now();
+            run(c);
+            uint64_t elapsed = tune_now() - start;
+            if (rep > 0 && elapsed < best[i]) {
+                best[i] = elapsed;
+            }
+        }
+    }
+
+    size_t pick = 0;
+    for (size_t i = 1; i < n; i++) {
+        if (best[i] < best[pick]) {
+            pick = i;
+        }
+    }
+    if (best[pick] * 100 > best[0] * (100 - TUNE_MARGIN)) {
+        pick = 0;
+    }
+    set(trial, values[pick]);
+}
+
+// tune_measure times the alternatives for each setting in turn,
+// starting from the defaults, and writes the fastest to |t|.
+// The alternatives are timed under a private tuning, so the
+// current tuning is left alone.
+static bool tune_measure(rocca_tuning* t) {
+    static const size_t lanes[]       = {ROCCA_LANES, 1, 2, 3};
+    static const size_t chunks[]      = {TUNE_DEFAULT_CHUNK, 4096, 65536};
+    static const size_t interleaves[] = {false, true};
+
+    tune_ctx* c = tune_ctx_new();
+    if (c == NULL) {
+        return false;
+    }
+    rocca_tuning trial = {
+        .backend           = ROCCA_BACKEND_NAME,
+        .lanes             = ROCCA_LANES,
+        .fanout_chunk      = TUNE_DEFAULT_CHUNK,
+        .sealer_interleave = false,
+    };
+    tune_trial = &trial;
+#define TUNE_COUNT(a) (sizeof(a) / sizeof((a)[0]))
+    tune_pick(c, &trial, tune_set_lanes, lanes, TUNE_COUNT(lanes),
+              tune_run_lanes);
+    tune_pick(c, &trial, tune_set_chunk, chunks, TUNE_COUNT(chunks),
+              tune_run_fanout);
+    tune_pick(c, &trial, tune_set_interleave, interleaves,
+              TUNE_COUNT(interleaves), tune_run_sealer);
+#undef TUNE_COUNT
+    tune_trial = NULL;
+    tune_ctx_free(c);
+    *t = trial;
+    return true;
+}
+
+// tune_clean replaces the characters in |s| that would break the
+// cache format with spaces and trims the spaces at both ends.
+static void tune_clean(char* s) {
+    size_t len = strlen(s);
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] < ' ' || s[i] > '~') {
+            s[i] = ' ';
+        }
+    }
+    while (len > 0 && s[len - 1] == ' ') {
+        s[--len] = '\0';
+    }
+    size_t skip = strspn(s, " ");
+    memmove(s, &s[skip], len - skip + 1);
+}
+
+// tune_cpu_model writes the model of the CPU to |dst|, or
+// "unknown".
+static void tune_cpu_model(char dst[TUNE_MODEL_MAX]) {
+    dst[0] = '\0';
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned r[12];
+    if (__get_cpuid_max(0x80000000, NULL) >= 0x80000004) {
+        for (unsigned i = 0; i < 3; i++) {
+            __get_cpuid(0x80000002 + i, &r[4 * i], &r[4 * i + 1],
+                        &r[4 * i + 2], &r[4 * i + 3]);
+        }
+        memcpy(dst, r, sizeof(r));
+        dst[sizeof(r)] = '\0';
+    }
+#elif defined(__APPLE__)
+    size_t len = TUNE_MODEL_MAX - 1;
+    if (sysctlbyname("machdep.cpu.brand_string", dst, &len, NULL, 0) == 0) {
+        dst[len] = '\0';
+    } else {
+        dst[0] = '\0';
+    }
+#else
+    // Arm cores have no model name in /proc/cpuinfo, but the
+    // implementer and part numbers identify them.
+    char implementer[TUNE_LINE_MAX] = "";
+    char part[TUNE_LINE_MAX]        = "";
+    FILE* f                         = fopen("/proc/cpuinfo", "r");
+    if (f != NULL) {
+        char line[TUNE_LINE_MAX];
+        while (fgets(line, sizeof(line), f) != NULL) {
+            const char* value = strchr(line, ':');
+            if (value == NULL) {
+                continue;
+            }
+            if (strncmp(line, "model name", 10) == 0) {
+                snprintf(dst, TUNE_MODEL_MAX, "%s", value + 1);
+                break;
+            }
+            if (implementer[0] == '\0' &&
+                strncmp(line, "CPU implementer", 15) == 0) {
+                snprintf(implementer, sizeof(implementer), "%s", value + 1);
+            }
+            if (part[0] == '\0' && strncmp(line, "CPU part", 8) == 0) {
+                snprintf(part, sizeof(part), "%s", value + 1);
+            }
+        }
+        fclose(f);
+    }
+    if (dst[0] == '\0' && part[0] != '\0') {
+        tune_clean(implementer);
+        tune_clean(part);
+        snprintf(dst, TUNE_MODEL_MAX, "arm %.32s %.32s", implementer, part);
+    }
+#endif // defined(__x86_64__) || defined(__i386__)
+    tune_clean(dst);
+    if (dst[0] == '\0') {
+        snprintf(dst, TUNE_MODEL_MAX, "unknown");
+    }
+}
+
+// tune_cache_key writes the cache key for this host to |dst|:
+// the CPU model and the backend, separated by a tab.
+static void tune_cache_key(char dst[TUNE_MODEL_MAX + 32]) {
+    char model[TUNE_MODEL_MAX];
+    tune_cpu_model(model);
+    snprintf(dst, TUNE_MODEL_MAX + 32, "%s\t%s", model, ROCCA_BACKEND_NAME);
+}
+
+// tune_match returns the rest of |line| after |key| and a tab,
+// or NULL if |line| is not for |key|.
+static const char* tune_match(const char* line, const char* key) {
+    size_t len = strlen(key);
+    if (strncmp(line, key, len) != 0 || line[len] != '\t') {
+        return NULL;
+    }
+    return &line[len + 1];
+}
+
+// tune_load looks |key| up in the cache at |path| and, if it is
+// found with valid settings, writes them to |t|.
+static bool tune_load(const char* path, const char* key, rocca_tuning* t) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    bool found = false;
+    char line[TUNE_LINE_MAX];
+    while (!found && fgets(line, sizeof(line), f) != NULL) {
+        const char* rest = tune_match(line, key);
+        unsigned lanes;
+        size_t chunk;
+        int interleave;
+        if (rest == NULL ||
+            sscanf(rest, "%u %zu %d", &lanes, &chunk, &interleave) != 3) {
+            continue;
+        }
+        *t = (rocca_tuning){
+            .backend           = ROCCA_BACKEND_NAME,
+            .lanes             = lanes,
+            .fanout_chunk      = chunk,
+            .sealer_interleave = interleave != 0,
+        };
+        found = tune_valid(t);
+    }
+    fclose(f);
+    return found;
+}
+
+// tune_save writes |t| for |key| to the cache at |path|, keeping
+// the entries for other keys. The new file is renamed into
+// place, so that readers never see a partial file.
+static bool tune_save(const char* path,
+                      const char* key,
+                      const rocca_tuning* t) {
+    size_t tmp_len = strlen(path) + 32;
+    char* tmp      = malloc(tmp_len);
+    if (tmp == NULL) {
+        return false;
+    }
+    snprintf(tmp, tmp_len, "%s.%ld.tmp", path, (long)getpid());
+    FILE* out = fopen(tmp, "w");
+    if (out == NULL) {
+        free(tmp);
+        return false;
+    }
+
+    fputs(tune_cache_header, out);
+    FILE* in = fopen(path, "r");
+    if (in != NULL) {
+        char line[TUNE_LINE_MAX];
+        while (fgets(line, sizeof(line), in) != NULL) {
+            if (line[0] != '#' && tune_match(line, key) == NULL) {
+                fputs(line, out);
+            }
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s\t%u %zu %d\n", key, t->lanes, t->fanout_chunk,
+            t->sealer_interleave ? 1 : 0);
+
+    bool ok = !ferror(out);
+    ok      = fclose(out) == 0 && ok;
+    ok      = ok && rename(tmp, path) == 0;
+    if (!ok) {
+        remove(tmp);
+    }
+    free(tmp);
+    return ok;
+}
+
+bool rocca_autotune(const char* cache_path, rocca_tuning* tuning) {
+    char key[TUNE_MODEL_MAX + 32];
+    tune_cache_key(key);
+
+    rocca_tuning t;
+    bool ok = true;
+    if (cache_path == NULL || !tune_load(cache_path, key, &t)) {
+        if (!tune_measure(&t)) {
+            return false;
+        }
+        ok = cache_path == NULL || tune_save(cache_path, key, &t);
+    }
+    rocca_tuning_set(&t);
+    rocca_tuning_get(tuning);
+    return ok;
+}
@@ -0,0 +1,551 @@
+// fuzz.c is a differential harness that checks every API form
+// of the library against a simple reference implementation of
+// Rocca written directly from the paper.
+//
+// Built with -DROCCA_LIBFUZZER it is a libFuzzer target.
+// Otherwise it is a standalone program that replays the inputs
+// named on the command line or, with no arguments, runs random
+// inputs.
+//
+// Each input is a stream of choices (key, nonce, lengths,
+// buffer alignments, chunk sizes, which byte to tamper with);
+// the message contents are generated from a seed taken from
+// the input. Any mismatch aborts.
+
+#include "rocca.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    // MAX_AD and MAX_PT bound the generated lengths. They are
+    // a few blocks past the sizes where the implementations
+    // change strategy.
+    MAX_AD = 300,
+    MAX_PT = 2100,
+    // MAX_ALIGN is the largest misalignment applied to a buffer.
+    MAX_ALIGN = 64,
+};
+
+// The reference implementation works on bytes and follows the
+// paper's notation.
+
+static uint8_t ref_sbox[256];
+
+// ref_xtime multiplies |a| by x (that is, 2) in GF(2^8).
+static uint8_t ref_xtime(uint8_t a) {
+    return (uint8_t)((a << 1) ^ ((a & 0x80) ? 0x1b : 0));
+}
+
+// ref_mul multiplies |a| and |b| in GF(2^8).
+static uint8_t ref_mul(uint8_t a, uint8_t b) {
+    uint8_t p = 0;
+    while (b != 0) {
+        if (b & 1) {
+            p ^= a;
+        }
+        a = ref_xtime(a);
+        b >>= 1;
+    }
+    return p;
+}
+
+// ref_init_sbox computes the AES S-box from its definition:
+// the inverse in GF(2^8) followed by the affine transform.
+static void ref_init_sbox(void) {
+    for (int x = 0; x < 256; x++) {
+        uint8_t inv = 0;
+        for (int y = 1; x != 0 && y < 256; y++) {
+            if (ref_mul((uint8_t)x, (uint8_t)y) == 1) {
+                inv = (uint8_t)y;
+                break;
+            }
+        }
+        uint8_t s = inv;
+        for (int i = 1; i <= 4; i++) {
+            s ^= (uint8_t)((inv << i) | (inv >> (8 - i)));
+        }
+        ref_sbox[x] = s ^ 0x63;
+    }
+}
+
+// ref_aes is AES(S, K): one AES round of |s| with round key
+// |k|, written to |out|.
+static void ref_aes(uint8_t out[16], const uint8_t s[16], const uint8_t k[16]) {
+    uint8_t t[16];
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            // SubBytes and ShiftRows.
+            t[4 * c + r] = ref_sbox[s[4 * ((c + r) % 4) + r]];
+        }
+    }
+    for (int c = 0; c < 4; c++) {
+        const uint8_t* a = &t[4 * c];
+        for (int r = 0; r < 4; r++) {
+            // MixColumns and AddRoundKey.
+            out[4 * c + r] = ref_xtime(a[r]) ^ ref_xtime(a[(r + 1) % 4]) ^
+                             a[(r + 1) % 4] ^ a[(r + 2) % 4] ^
+                             a[(r + 3) % 4] ^ k[4 * c + r];
+        }
+    }
+}
+
+static void ref_xor(uint8_t out[16], const uint8_t a[16], const uint8_t b[16]) {
+    for (int i = 0; i < 16; i++) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+static const uint8_t ref_z0[16] = {
+    0xcd, 0x65, 0xef, 0x23, 0x91, 0x44, 0x37, 0x71,
+    0x22, 0xae, 0x28, 0xd7, 0x98, 0x2f, 0x8a, 0x42,
+};
+
+static const uint8_t ref_z1[16] = {
+    0xbc, 0xdb, 0x89, 0x81, 0xa5, 0xdb, 0xb5, 0xe9,
+    0x2f, 0x3b, 0x4d, 0xec, 0xcf, 0xfb, 0xc0, 0xb5,
+};
+
+// ref_r is the round function R(S, X0, X1).
+static void ref_r(uint8_t s[8][16],
+                  const uint8_t x0[16],
+                  const uint8_t x1[16]) {
+    uint8_t n[8][16];
+    ref_xor(n[0], s[7], x0);
+    ref_aes(n[1], s[0], s[7]);
+    ref_xor(n[2], s[1], s[6]);
+    ref_aes(n[3], s[2], s[1]);
+    ref_xor(n[4], s[3], x1);
+    ref_aes(n[5], s[4], s[3]);
+    ref_aes(n[6], s[5], s[4]);
+    ref_xor(n[7], s[0], s[6]);
+    memcpy(s, n, sizeof(n));
+}
+
+// ref_seal writes the ciphertext and tag of |pt| to |out|.
+static void ref_seal(const uint8_t key[ROCCA_KEY_SIZE],
+                     const uint8_t nonce[ROCCA_NONCE_SIZE],
+                     const uint8_t* ad,
+                     size_t ad_len,
+                     const uint8_t* pt,
+                     size_t pt_len,
+                     uint8_t* out) {
+    uint8_t s[8][16] = {{0}};
+    memcpy(s[0], &key[16], 16);
+    memcpy(s[1], nonce, 16);
+    memcpy(s[2], ref_z0, 16);
+    memcpy(s[3], ref_z1, 16);
+    ref_xor(s[4], nonce, &key[16]);
+    memcpy(s[6], key, 16);
+    for (int i = 0; i < 20; i++) {
+        ref_r(s, ref_z0, ref_z1);
+    }
+
+    uint8_t m[32];
+    for (size_t i = 0; i < ad_len; i += 32) {
+        size_t n = ad_len - i < 32 ? ad_len - i : 32;
+        memset(m, 0, sizeof(m));
+        memcpy(m, &ad[i], n);
+        ref_r(s, &m[0], &m[16]);
+    }
+    for (size_t i = 0; i < pt_len; i += 32) {
+        size_t n = pt_len - i < 32 ? pt_len - i : 32;
+        memset(m, 0, sizeof(m));
+        memcpy(m, &pt[i], n);
+        uint8_t c[32];
+        uint8_t t[16];
+        ref_aes(c, s[1], s[5]);
+        ref_xor(c, c, &m[0]);
+        ref_xor(t, s[0], s[4]);
+        ref_aes(&c[16], t, s[2]);
+        ref_xor(&c[16], &c[16], &m[16]);
+        memcpy(&out[i], c, n);
+        ref_r(s, &m[0], &m[16]);
+    }
+
+    uint8_t a[16] = {0};
+    uint8_t b[16] = {0};
+    for (int i = 0; i < 8; i++) {
+        a[i] = (uint8_t)(((uint64_t)ad_len * 8) >> (8 * i));
+        b[i] = (uint8_t)(((uint64_t)pt_len * 8) >> (8 * i));
+    }
+    for (int i = 0; i < 20; i++) {
+        ref_r(s, a, b);
+    }
+    uint8_t* tag = &out[pt_len];
+    memset(tag, 0, 16);
+    for (int i = 0; i < 8; i++) {
+        ref_xor(tag, tag, s[i]);
+    }
+}
+
+// input reads choices from the fuzzer's input. Once the input
+// is exhausted every choice is zero.
+typedef struct input {
+    const uint8_t* data;
+    size_t len;
+} input;
+
+static uint64_t input_u64(input* in, int nbytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < nbytes && in->len > 0; i++) {
+        v |= (uint64_t)in->data[0] << (8 * i);
+        in->data++;
+        in->len--;
+    }
+    return v;
+}
+
+// input_range returns a choice in [0, n).
+static size_t input_range(input* in, size_t n) {
+    return (size_t)(input_u64(in, n > 256 ? 2 : 1) % n);
+}
+
+static void input_bytes(input* in, uint8_t* dst, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = (uint8_t)input_u64(in, 1);
+    }
+}
+
+// input_chunk returns the next chunk length for a buffer with
+// |remain| bytes left, biased towards block boundaries and
+// their neighbors.
+static size_t input_chunk(input* in, size_t remain) {
+    // Empty chunks are allowed, but once the input is exhausted
+    // the rest is taken at once so that loops terminate.
+    if (in->len == 0) {
+        return remain;
+    }
+    size_t n = 0;
+    switch (input_range(in, 4)) {
+        case 0:
+            n = input_range(in, 4);
+            break;
+        case 1:
+            n = 32 * (input_range(in, 4) + 1) + input_range(in, 3) - 1;
+            break;
+        case 2:
+            n = input_range(in, 100);
+            break;
+        default:
+            n = remain;
+            break;
+    }
+    return n > remain ? remain : n;
+}
+
+static void fill(uint64_t seed, uint8_t* dst, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        seed += 0x9e3779b97f4a7c15ull;
+        uint64_t z = seed;
+        z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z          = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        dst[i]     = (uint8_t)(z ^ (z >> 31));
+    }
+}
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: check failed: %s (ad_len=%zu "           \
+                    "pt_len=%zu)\n",                                          \
+                    __FILE__, __LINE__, #cond, ad_len, pt_len);              \
+            abort();                                                         \
+        }                                                                    \
+    } while (0)
+
+static bool all_zero(const uint8_t* p, size_t len) {
+    uint8_t v = 0;
+    for (size_t i = 0; i < len; i++) {
+        v |= p[i];
+    }
+    return v == 0;
+}
+
+// Buffers are allocated once, with room for any misalignment.
+static uint8_t buf_ad[MAX_AD + MAX_ALIGN];
+static uint8_t buf_pt[MAX_PT + MAX_ALIGN];
+static uint8_t buf_ct[MAX_PT + ROCCA_OVERHEAD + MAX_ALIGN];
+static uint8_t buf_out[MAX_PT + ROCCA_OVERHEAD + MAX_ALIGN];
+static uint8_t want[MAX_PT + ROCCA_OVERHEAD];
+static uint8_t want2[MAX_PT + ROCCA_OVERHEAD];
+static uint8_t page[MAX_AD + MAX_PT + ROCCA_OVERHEAD];
+
+// check_streaming seals and opens with a |rocca_ctx| in random
+// chunks, optionally exporting and importing the context
+// between chunks.
+static void check_streaming(input* in,
+                            const uint8_t* key,
+                            const uint8_t* nonce,
+                            const uint8_t* ad,
+                            size_t ad_len,
+                            const uint8_t* pt,
+                            size_t pt_len) {
+    for (int dir = 0; dir < 2; dir++) {
+        bool seal   = dir == 0;
+        uint8_t* ct = &buf_ct[input_range(in, MAX_ALIGN)];
+        rocca_ctx ctx;
+        CHECK(seal ? rocca_seal_init(&ctx, key, ROCCA_KEY_SIZE, nonce,
+                                     ROCCA_NONCE_SIZE)
+                   : rocca_open_init(&ctx, key, ROCCA_KEY_SIZE, nonce,
+                                     ROCCA_NONCE_SIZE));
+        for (size_t off = 0; off < ad_len;) {
+            size_t n = input_chunk(in, ad_len - off);
+            CHECK(rocca_update_ad(&ctx, n ? &ad[off] : NULL, n));
+            off += n;
+        }
+
+        // Decrypt in place from a copy of the ciphertext.
+        const uint8_t* src = pt;
+        if (!seal) {
+            memcpy(ct, want, pt_len);
+            src = ct;
+        }
+        for (size_t off = 0; off < pt_len;) {
+            if (input_range(in, 8) == 0) {
+                uint8_t blob[ROCCA_CTX_EXPORT_SIZE];
+                CHECK(rocca_ctx_export(&ctx, blob, sizeof(blob)));
+                memset(&ctx, 0xa5, sizeof(ctx));
+                CHECK(rocca_ctx_import(&ctx, blob, sizeof(blob)));
+            }
+            size_t n = input_chunk(in, pt_len - off);
+            if (seal) {
+                CHECK(rocca_seal_update(&ctx, n ? &ct[off] : NULL, n,
+                                        n ? &src[off] : NULL, n));
+            } else {
+                CHECK(rocca_open_update(&ctx, n ? &ct[off] : NULL, n,
+                                        n ? &ct[off] : NULL, n));
+            }
+            off += n;
+        }
+
+        if (seal) {
+            uint8_t tag[ROCCA_TAG_SIZE];
+            CHECK(rocca_seal_final(&ctx, tag, sizeof(tag)));
+            CHECK(memcmp(ct, want, pt_len) == 0);
+            CHECK(memcmp(tag, &want[pt_len], sizeof(tag)) == 0);
+        } else {
+            uint8_t tag[ROCCA_TAG_SIZE];
+            memcpy(tag, &want[pt_len], sizeof(tag));
+            bool tamper = input_range(in, 2) == 0;
+            tag[input_range(in, sizeof(tag))] ^= (uint8_t)tamper;
+            CHECK(rocca_open_final(&ctx, tag, sizeof(tag)) == !tamper);
+            CHECK(memcmp(ct, pt, pt_len) == 0);
+        }
+    }
+}
+
+// check_batches compares the batch and multi-key APIs against
+// |want| (the sealed message) and |want2| (the same message
+// under |key2|).
+static void check_batches(input* in,
+                          const uint8_t* key,
+                          const uint8_t* key2,
+                          const uint8_t* nonce,
+                          const uint8_t* ad,
+                          size_t ad_len,
+                          const uint8_t* pt,
+                          size_t pt_len) {
+    const size_t ct_len = pt_len + ROCCA_OVERHEAD;
+    uint8_t* ct         = &buf_ct[input_range(in, MAX_ALIGN)];
+    uint8_t* out        = &buf_out[input_range(in, MAX_ALIGN)];
+    uint8_t got_nonce[ROCCA_NONCE_SIZE];
+
+    rocca_state_pool* pool =
+        rocca_state_pool_new(key, ROCCA_KEY_SIZE, nonce, ROCCA_NONCE_SIZE, 2);
+    CHECK(pool != NULL);
+    if (input_range(in, 2) == 0) {
+        rocca_state_pool_fill(pool, 1);
+    }
+    CHECK(rocca_state_pool_seal(pool, got_nonce, ct, ct_len,
+                                pt_len ? pt : NULL, pt_len,
+                                ad_len ? ad : NULL, ad_len));
+    rocca_state_pool_free(pool);
+    CHECK(memcmp(got_nonce, nonce, sizeof(got_nonce)) == 0);
+    CHECK(memcmp(ct, want, ct_len) == 0);
+
+    rocca_session_table* table = rocca_session_table_new(2);
+    CHECK(table != NULL);
+    CHECK(rocca_session_set(table, 1, key, ROCCA_KEY_SIZE, nonce,
+                            ROCCA_NONCE_SIZE));
+    rocca_session_msg msg = {
+        .session             = 1,
+        .dst                 = ct,
+        .dst_len             = ct_len,
+        .plaintext           = pt_len ? pt : NULL,
+        .plaintext_len       = pt_len,
+        .additional_data     = ad_len ? ad : NULL,
+        .additional_data_len = ad_len,
+    };
+    CHECK(rocca_session_seal_batch(table, &msg, 1) == 1 && msg.ok);
+    rocca_session_table_free(table);
+    CHECK(memcmp(msg.nonce, nonce, sizeof(msg.nonce)) == 0);
+    CHECK(memcmp(ct, want, ct_len) == 0);
+
+    rocca_recipient recipients[2] = {
+        {key, ROCCA_KEY_SIZE, nonce, ROCCA_NONCE_SIZE, ct, ct_len},
+        {key2, ROCCA_KEY_SIZE, nonce, ROCCA_NONCE_SIZE, out, ct_len},
+    };
+    CHECK(rocca_seal_fanout(recipients, 2, pt_len ? pt : NULL, pt_len,
+                            ad_len ? ad : NULL, ad_len));
+    CHECK(memcmp(ct, want, ct_len) == 0);
+    CHECK(memcmp(out, want2, ct_len) == 0);
+
+    // The second message is finished by |rocca_sealer_flush| and
+    // the first by the push of the second, with and without the
+    // two interleaved.
+    rocca_tuning orig;
+    rocca_tuning_get(&orig);
+    rocca_tuning tuning = orig;
+    for (int interleave = 0; interleave < 2; interleave++) {
+        tuning.sealer_interleave = interleave != 0;
+        CHECK(rocca_tuning_set(&tuning));
+        rocca_sealer* sealer = rocca_sealer_new(key, ROCCA_KEY_SIZE);
+        CHECK(sealer != NULL);
+        rocca_sealer_msg msgs[2];
+        for (int i = 0; i < 2; i++) {
+            msgs[i] = (rocca_sealer_msg){
+                .nonce               = nonce,
+                .nonce_len           = ROCCA_NONCE_SIZE,
+                .dst                 = i == 0 ? ct : out,
+                .dst_len             = ct_len,
+                .plaintext           = pt_len ? pt : NULL,
+                .plaintext_len       = pt_len,
+                .additional_data     = ad_len ? ad : NULL,
+                .additional_data_len = ad_len,
+            };
+        }
+        CHECK(rocca_sealer_push(sealer, &msgs[0]) == NULL);
+        CHECK(rocca_sealer_push(sealer, &msgs[1]) == &msgs[0]);
+        CHECK(rocca_sealer_flush(sealer) == &msgs[1]);
+        rocca_sealer_free(sealer);
+        CHECK(msgs[0].ok && msgs[1].ok);
+        CHECK(memcmp(ct, want, ct_len) == 0);
+        CHECK(memcmp(out, want, ct_len) == 0);
+    }
+    CHECK(rocca_tuning_set(&orig));
+
+    // A page whose header is the additional data is sealed to
+    // the header followed by the same ciphertext, with the
+    // nonce split into the page number and LSN.
+    uint64_t page_no = 0;
+    uint64_t lsn     = 0;
+    for (int i = 0; i < 8; i++) {
+        page_no |= (uint64_t)nonce[i] << (8 * i);
+        lsn |= (uint64_t)nonce[8 + i] << (8 * i);
+    }
+    size_t page_size = ad_len + ct_len;
+    rocca_page_cipher* c =
+        rocca_page_cipher_new(key, ROCCA_KEY_SIZE, page_size, ad_len);
+    CHECK(c != NULL);
+    memcpy(page, ad, ad_len);
+    memcpy(&page[ad_len], pt, pt_len);
+    CHECK(rocca_page_seal(c, page, page_no, lsn));
+    CHECK(memcmp(&page[ad_len], want, ct_len) == 0);
+    CHECK(rocca_page_verify(c, page, page_no, lsn));
+    bool tamper = input_range(in, 2) == 0;
+    page[input_range(in, page_size)] ^= (uint8_t)tamper;
+    CHECK(rocca_page_verify(c, page, page_no, lsn) == !tamper);
+    CHECK(rocca_page_open(c, page, page_no, lsn) == !tamper);
+    if (tamper) {
+        CHECK(all_zero(page, page_size));
+    } else {
+        CHECK(memcmp(&page[ad_len], pt, pt_len) == 0);
+    }
+    rocca_page_cipher_free(c);
+}
+
+// check_one runs every check on one input.
+static void check_one(const uint8_t* data, size_t len) {
+    input in = {data, len};
+
+    uint8_t key[ROCCA_KEY_SIZE];
+    uint8_t key2[ROCCA_KEY_SIZE];
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+    input_bytes(&in, key, sizeof(key));
+    input_bytes(&in, nonce, sizeof(nonce));
+    memcpy(key2, key, sizeof(key));
+    key2[input_range(&in, sizeof(key2))] ^= 0x80;
+
+    size_t ad_len = input_range(&in, MAX_AD + 1);
+    size_t pt_len = input_range(&in, MAX_PT + 1);
+    uint8_t* ad   = &buf_ad[input_range(&in, MAX_ALIGN)];
+    uint8_t* pt   = &buf_pt[input_range(&in, MAX_ALIGN)];
+    uint64_t seed = input_u64(&in, 8);
+    fill(seed, ad, ad_len);
+    fill(~seed, pt, pt_len);
+
+    ref_seal(key, nonce, ad, ad_len, pt, pt_len, want);
+    ref_seal(key2, nonce, ad, ad_len, pt, pt_len, want2);
+
+    // One-shot seal and open.
+    const size_t ct_len = pt_len + ROCCA_OVERHEAD;
+    uint8_t* ct         = &buf_ct[input_range(&in, MAX_ALIGN)];
+    uint8_t* out        = &buf_out[input_range(&in, MAX_ALIGN)];
+    CHECK(rocca_seal(ct, ct_len, key, sizeof(key), nonce, sizeof(nonce),
+                     pt_len ? pt : NULL, pt_len, ad_len ? ad : NULL, ad_len));
+    CHECK(memcmp(ct, want, ct_len) == 0);
+    CHECK(rocca_open(out, pt_len + 1, key, sizeof(key), nonce, sizeof(nonce),
+                     ct, ct_len, ad_len ? ad : NULL, ad_len));
+    CHECK(memcmp(out, pt, pt_len) == 0);
+
+    // Flipping any bit of the ciphertext or tag is rejected and
+    // wipes the output.
+    size_t pos = input_range(&in, ct_len);
+    ct[pos] ^= (uint8_t)(1 << input_range(&in, 8));
+    CHECK(!rocca_open(out, pt_len + 1, key, sizeof(key), nonce,
+                      sizeof(nonce), ct, ct_len, ad_len ? ad : NULL, ad_len));
+    CHECK(all_zero(out, pt_len + 1));
+
+    check_streaming(&in, key, nonce, ad, ad_len, pt, pt_len);
+    check_batches(&in, key, key2, nonce, ad, ad_len, pt, pt_len);
+}
+
+#if defined(ROCCA_LIBFUZZER)
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t len) {
+    if (ref_sbox[0] == 0) {
+        ref_init_sbox();
+    }
+    check_one(data, len);
+    return 0;
+}
+#else
+int main(int argc, char** argv) {
+    ref_init_sbox();
+
+    // Replay the named inputs.
+    if (argc > 1) {
+        static uint8_t data[1 << 16];
+        for (int i = 1; i < argc; i++) {
+            FILE* fp = fopen(argv[i], "rb");
+            if (fp == NULL) {
+                perror(argv[i]);
+                return EXIT_FAILURE;
+            }
+            size_t n = fread(data, 1, sizeof(data), fp);
+            fclose(fp);
+            check_one(data, n);
+        }
+        fprintf(stderr, "ok: %d inputs\n", argc - 1);
+        return EXIT_SUCCESS;
+    }
+
+    // Otherwise, run random inputs. ROCCA_FUZZ_ITERS overrides
+    // the count.
+    long iters      = 20000;
+    const char* env = getenv("ROCCA_FUZZ_ITERS");
+    if (env != NULL) {
+        iters = atol(env);
+    }
+    uint8_t data[256];
+    for (long i = 0; i < iters; i++) {
+        fill((uint64_t)i, data, sizeof(data));
+        check_one(data, data[0]);
+    }
+    fprintf(stderr, "ok: %ld random inputs\n", iters);
+    return EXIT_SUCCESS;
+}
+#endif // defined(ROCCA_LIBFUZZER)
@@ -0,0 +1,61 @@
+// Small message benchmark for comparing the out-of-line library
+// with the single-header build. See the bench-small target in
+// test/Makefile.
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "rocca.h"
+
+#if defined(ROCCA_IMPLEMENTATION)
+#define BUILD "inline"
+#else
+#define BUILD "library"
+#endif // defined(ROCCA_IMPLEMENTATION)
+
+enum {
+    ITERS = 1 << 20,
+};
+
+static uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+// bench_seal seals |len| bytes |ITERS| times and returns the
+// average time per call in nanoseconds.
+//
+// It is always inlined so that the key, nonce, and message
+// sizes are compile-time constants at the |rocca_seal| call
+// site, as they are in a typical packet loop.
+__attribute__((always_inline)) static inline double bench_seal(size_t len) {
+    static uint8_t key[ROCCA_KEY_SIZE];
+    static uint8_t nonce[ROCCA_NONCE_SIZE];
+    static uint8_t ad[8];
+    static uint8_t pt[1024];
+    static uint8_t ct[sizeof(pt) + ROCCA_OVERHEAD];
+
+    uint64_t start = now();
+    for (int i = 0; i < ITERS; i++) {
+        nonce[0] = (uint8_t)i;
+        if (!rocca_seal(ct, len + ROCCA_OVERHEAD, key, sizeof(key), nonce,
+                        sizeof(nonce), pt, len, ad, sizeof(ad))) {
+            fprintf(stderr, "seal failed\n");
+            exit(EXIT_FAILURE);
+        }
+        // Chain the output so the calls cannot be elided.
+        pt[0] ^= ct[len];
+    }
+    return (double)(now() - start) / ITERS;
+}
+
+int main(void) {
+    fprintf(stderr, "%s: 16 bytes: %0.1f ns/op\n", BUILD, bench_seal(16));
+    fprintf(stderr, "%s: 64 bytes: %0.1f ns/op\n", BUILD, bench_seal(64));
+    fprintf(stderr, "%s: 256 bytes: %0.1f ns/op\n", BUILD, bench_seal(256));
+    fprintf(stderr, "%s: 1024 bytes: %0.1f ns/op\n", BUILD, bench_seal(1024));
+    return EXIT_SUCCESS;
+}
@@ -1,4 +1,5 @@
 #include "rocca.h"
+#include "aegis.h"
 
 #include <inttypes.h>
 #include <stdint.h>
@@ -6,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 static void dump_hex(const char* prefix, uint8_t* src, size_t src_len) {
     static const uint8_t hextable[] = "0123456789abcdef";
@@ -296,6 +298,999 @@ static int test_vectors(void) {
     return TEST_PASS;
 }
 
+// prng_bytes fills |buf| with deterministic pseudorandom bytes
+// derived from |*seed|.
+static void prng_bytes(uint64_t* seed, uint8_t* buf, size_t buf_len) {
+    for (size_t i = 0; i < buf_len; i++) {
+        uint64_t x = *seed;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        *seed  = x;
+        buf[i] = (uint8_t)(x >> 24);
+    }
+}
+
+static uint64_t prng_uint(uint64_t* seed, uint64_t n) {
+    uint8_t b[8];
+    prng_bytes(seed, b, sizeof(b));
+    uint64_t x = 0;
+    memcpy(&x, b, sizeof(x));
+    return x % n;
+}
+
+static int test_streaming(void) {
+    enum { max_len = 300 };
+
+    uint64_t seed = 0x9e3779b97f4a7c15;
+    uint8_t key[ROCCA_KEY_SIZE];
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+    uint8_t ad[max_len];
+    uint8_t pt[max_len];
+    uint8_t want[max_len + ROCCA_OVERHEAD];
+    uint8_t got[max_len + ROCCA_OVERHEAD];
+    uint8_t out[max_len];
+
+    for (int iter = 0; iter < 500; iter++) {
+        size_t ad_len = prng_uint(&seed, max_len);
+        size_t pt_len = prng_uint(&seed, max_len);
+        prng_bytes(&seed, key, sizeof(key));
+        prng_bytes(&seed, nonce, sizeof(nonce));
+        prng_bytes(&seed, ad, ad_len);
+        prng_bytes(&seed, pt, pt_len);
+
+        bool ok = rocca_seal(want, pt_len + ROCCA_OVERHEAD, key, sizeof(key),
+                             nonce, sizeof(nonce), pt_len ? pt : NULL, pt_len,
+                             ad_len ? ad : NULL, ad_len);
+        if (!ok) {
+            fprintf(stderr, "rocca_seal failed\n");
+            return TEST_FAIL;
+        }
+
+        rocca_ctx ctx;
+        ok = rocca_seal_init(&ctx, key, sizeof(key), nonce, sizeof(nonce));
+        for (size_t i = 0; ok && i < ad_len;) {
+            size_t n = 1 + prng_uint(&seed, ad_len - i);
+            ok       = rocca_update_ad(&ctx, &ad[i], n);
+            i += n;
+        }
+        for (size_t i = 0; ok && i < pt_len;) {
+            size_t n = 1 + prng_uint(&seed, pt_len - i);
+            ok       = rocca_seal_update(&ctx, &got[i], n, &pt[i], n);
+            i += n;
+        }
+        ok = ok && rocca_seal_final(&ctx, &got[pt_len], ROCCA_TAG_SIZE);
+        if (!ok) {
+            fprintf(stderr, "rocca_seal_* failed\n");
+            return TEST_FAIL;
+        }
+        if (memcmp(want, got, pt_len + ROCCA_OVERHEAD) != 0) {
+            fprintf(stderr, "streaming seal mismatch (ad=%zu, pt=%zu)\n",
+                    ad_len, pt_len);
+            dump_hex("W", want, pt_len + ROCCA_OVERHEAD);
+            dump_hex("G", got, pt_len + ROCCA_OVERHEAD);
+            return TEST_FAIL;
+        }
+
+        ok = rocca_open_init(&ctx, key, sizeof(key), nonce, sizeof(nonce)) &&
+             rocca_update_ad(&ctx, ad_len ? ad : NULL, ad_len);
+        for (size_t i = 0; ok && i < pt_len;) {
+            size_t n = 1 + prng_uint(&seed, pt_len - i);
+            ok       = rocca_open_update(&ctx, &out[i], n, &want[i], n);
+            i += n;
+        }
+        ok = ok && rocca_open_final(&ctx, &want[pt_len], ROCCA_TAG_SIZE);
+        if (!ok || memcmp(out, pt, pt_len) != 0) {
+            fprintf(stderr, "streaming open failed (ad=%zu, pt=%zu)\n",
+                    ad_len, pt_len);
+            return TEST_FAIL;
+        }
+
+        want[pt_len] ^= 1;
+        ok = rocca_open_init(&ctx, key, sizeof(key), nonce, sizeof(nonce)) &&
+             rocca_update_ad(&ctx, ad_len ? ad : NULL, ad_len) &&
+             rocca_open_update(&ctx, out, sizeof(out), pt_len ? want : NULL,
+                               pt_len) &&
+             rocca_open_final(&ctx, &want[pt_len], ROCCA_TAG_SIZE);
+        if (ok) {
+            fprintf(stderr, "streaming open accepted a bad tag\n");
+            return TEST_FAIL;
+        }
+    }
+    return TEST_PASS;
+}
+
+static int test_ctx_export(void) {
+    enum { ad_len = 45, pt_len = 203 };
+
+    uint64_t seed = 42;
+    uint8_t key[ROCCA_KEY_SIZE];
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+    uint8_t ad[ad_len];
+    uint8_t pt[pt_len];
+    prng_bytes(&seed, key, sizeof(key));
+    prng_bytes(&seed, nonce, sizeof(nonce));
+    prng_bytes(&seed, ad, sizeof(ad));
+    prng_bytes(&seed, pt, sizeof(pt));
+
+    uint8_t want[pt_len + ROCCA_OVERHEAD];
+    if (!rocca_seal(want, sizeof(want), key, sizeof(key), nonce,
+                    sizeof(nonce), pt, sizeof(pt), ad, sizeof(ad))) {
+        fprintf(stderr, "rocca_seal failed\n");
+        return TEST_FAIL;
+    }
+
+    // Checkpoint at every split point, both while absorbing
+    // additional data and while encrypting.
+    for (size_t split = 0; split <= ad_len + pt_len; split++) {
+        uint8_t got[pt_len + ROCCA_OVERHEAD];
+        uint8_t blob[ROCCA_CTX_EXPORT_SIZE];
+        rocca_ctx ctx;
+
+        size_t ad_split = split < ad_len ? split : ad_len;
+        size_t pt_split = split - ad_split;
+
+        bool ok = rocca_seal_init(&ctx, key, sizeof(key), nonce, sizeof(nonce));
+        ok      = ok && rocca_update_ad(&ctx, ad_split ? ad : NULL, ad_split);
+        ok = ok && rocca_seal_update(&ctx, got, pt_split, pt_split ? pt : NULL,
+                                     pt_split);
+        ok = ok && rocca_ctx_export(&ctx, blob, sizeof(blob));
+        memset(&ctx, 0xff, sizeof(ctx));
+        ok = ok && rocca_ctx_import(&ctx, blob, sizeof(blob));
+        if (ad_split < ad_len) {
+            ok = ok && rocca_update_ad(&ctx, &ad[ad_split], ad_len - ad_split);
+        }
+        if (pt_split < pt_len) {
+            ok = ok && rocca_seal_update(&ctx, &got[pt_split],
+                                         pt_len - pt_split, &pt[pt_split],
+                                         pt_len - pt_split);
+        }
+        ok = ok && rocca_seal_final(&ctx, &got[pt_len], ROCCA_TAG_SIZE);
+        if (!ok) {
+            fprintf(stderr, "split %zu: export/import failed\n", split);
+            return TEST_FAIL;
+        }
+        if (memcmp(want, got, sizeof(want)) != 0) {
+            fprintf(stderr, "split %zu: bad output\n", split);
+            dump_hex("W", want, sizeof(want));
+            dump_hex("G", got, sizeof(got));
+            return TEST_FAIL;
+        }
+
+        // Corrupted blobs must be rejected.
+        blob[4] ^= 0x80;
+        if (rocca_ctx_import(&ctx, blob, sizeof(blob))) {
+            fprintf(stderr, "split %zu: accepted a bad version\n", split);
+            return TEST_FAIL;
+        }
+    }
+    return TEST_PASS;
+}
+
+static int test_rocca_s(void) {
+    typedef struct vector {
+        const char* name;
+        uint8_t key[ROCCA_S_KEY_SIZE];
+        uint8_t nonce[ROCCA_S_NONCE_SIZE];
+        uint8_t additional_data[32];
+        size_t additional_data_len;
+        uint8_t plaintext[64];
+        size_t plaintext_len;
+        uint8_t ciphertext[64 + ROCCA_S_OVERHEAD];
+    } vector;
+
+    // Test vectors #1 and #2 from draft-nakano-rocca-s. Both use
+    // a key whose halves are equal, so the last vector uses
+    // distinct halves to pin down where K0 and K1 are loaded. It
+    // also ends the additional data and the plaintext mid-block.
+    // Its ciphertext is not from the draft: it was computed with
+    // a model written from the draft's pseudocode, which
+    // reproduces vector #1.
+    static const vector vectors[] = {
+        {
+            .name                = "=== test vector #1 ===",
+            .key                 = {0},
+            .nonce               = {0},
+            .additional_data     = {0},
+            .additional_data_len = 32,
+            .plaintext           = {0},
+            .plaintext_len       = 64,
+            .ciphertext =
+                {
+                    0x9a, 0xc3, 0x32, 0x64, 0x95, 0xa8, 0xd4, 0x14, 0xfe, 0x40,
+                    0x7f, 0x47, 0xb5, 0x44, 0x10, 0x50, 0x24, 0x81, 0xcf, 0x79,
+                    0xca, 0xb8, 0xc0, 0xa6, 0x69, 0x32, 0x3e, 0x07, 0x71, 0x1e,
+                    0x46, 0x17, 0x0d, 0xe5, 0xb2, 0xfb, 0xba, 0x0f, 0xae, 0x8d,
+                    0xe7, 0xc1, 0xfc, 0xca, 0xee, 0xfc, 0x36, 0x26, 0x24, 0xfc,
+                    0xfd, 0xc1, 0x5f, 0x8b, 0xb3, 0xe6, 0x44, 0x57, 0xe8, 0xb7,
+                    0xe3, 0x75, 0x57, 0xbb, 0x8d, 0xf9, 0x34, 0xd1, 0x48, 0x37,
+                    0x10, 0xc9, 0x41, 0x0f, 0x6a, 0x08, 0x9c, 0x4c, 0xed, 0x97,
+                    0x91, 0x90, 0x1b, 0x7e, 0x2e, 0x66, 0x12, 0x06, 0x20, 0x2d,
+                    0xb2, 0xcc, 0x7a, 0x24, 0xa3, 0x86,
+                },
+        },
+        {
+            .name = "=== test vector #2 ===",
+            .key =
+                {
+                    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+                    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+                    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+                    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+                },
+            .nonce =
+                {
+                    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+                    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+                },
+            .additional_data =
+                {
+                    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+                    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+                    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+                    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+                },
+            .additional_data_len = 32,
+            .plaintext           = {0},
+            .plaintext_len       = 64,
+            .ciphertext =
+                {
+                    0x55, 0x9e, 0xcb, 0x25, 0x3b, 0xcf, 0xe2, 0x6b, 0x48, 0x3b,
+                    0xf0, 0x0e, 0x9c, 0x74, 0x83, 0x45, 0x97, 0x8f, 0xf9, 0x21,
+                    0x03, 0x6a, 0x6c, 0x1f, 0xdc, 0xb7, 0x12, 0x17, 0x28, 0x36,
+                    0x50, 0x4f, 0xbc, 0x64, 0xd4, 0x30, 0xa7, 0x3f, 0xc6, 0x7a,
+                    0xcd, 0x3c, 0x3b, 0x9c, 0x19, 0x76, 0xd8, 0x07, 0x90, 0xf4,
+                    0x83, 0x57, 0xe7, 0xfe, 0x0c, 0x06, 0x82, 0x62, 0x45, 0x69,
+                    0xd3, 0xa6, 0x58, 0xfb, 0xc1, 0xfd, 0xf3, 0x97, 0x62, 0xec,
+                    0xa7, 0x7d, 0xa8, 0xb0, 0xf1, 0xda, 0xe5, 0xff, 0xf7, 0x5a,
+                    0x92, 0xfb, 0x0a, 0xdf, 0xa7, 0x94, 0x0a, 0x28, 0xc8, 0xca,
+                    0xdb, 0xbb, 0xe8, 0xe4, 0xca, 0x8d,
+                },
+        },
+        {
+            .name = "=== distinct key halves ===",
+            .key =
+                {
+                    0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                    0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                    0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+                    0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+                },
+            .nonce =
+                {
+                    0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+                    0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+                },
+            .additional_data =
+                {
+                    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+                    0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+                    0x90, 0x91,
+                },
+            .additional_data_len = 18,
+            .plaintext =
+                {
+                    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+                    0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13,
+                    0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+                    0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+                    0x28, 0x29, 0x2a, 0x2b, 0x2c,
+                },
+            .plaintext_len = 45,
+            .ciphertext =
+                {
+                    0xe2, 0x8d, 0x9f, 0x86, 0x28, 0x8f, 0x77, 0x11, 0x5d, 0x4e,
+                    0xf6, 0x20, 0xe7, 0xce, 0xde, 0xce, 0xe4, 0xd7, 0xde, 0x0f,
+                    0xce, 0x38, 0xa9, 0x06, 0x1f, 0x81, 0x3c, 0x98, 0x05, 0xbc,
+                    0x1e, 0xa7, 0xfd, 0xf6, 0x70, 0x9e, 0xab, 0xcf, 0xcf, 0x75,
+                    0x80, 0x16, 0x49, 0xed, 0xc0, 0x17, 0xfa, 0xad, 0x2c, 0xcf,
+                    0x70, 0xf7, 0x53, 0x18, 0xca, 0x67, 0x5a, 0x6d, 0x00, 0xaa,
+                    0x86, 0xb9, 0x0a, 0xef, 0x19, 0xab, 0xe8, 0x33, 0x31, 0xa6,
+                    0xaf, 0x17, 0x30, 0xc5, 0x3a, 0x40, 0xfe,
+                },
+        },
+    };
+
+    bool ok;
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        const vector* v = &vectors[i];
+        size_t ct_len   = v->plaintext_len + ROCCA_S_OVERHEAD;
+
+        uint8_t gotCt[sizeof(v->ciphertext)] = {0};
+        uint8_t gotPt[sizeof(v->plaintext)]  = {0};
+        ok = rocca_s_seal(gotCt, ct_len, v->key, sizeof(v->key), v->nonce,
+                          sizeof(v->nonce), v->plaintext, v->plaintext_len,
+                          v->additional_data, v->additional_data_len);
+        if (!ok) {
+            fprintf(stderr, "%s: rocca_s_seal failed\n", v->name);
+            return TEST_FAIL;
+        }
+        if (memcmp(v->ciphertext, gotCt, ct_len) != 0) {
+            fprintf(stderr, "%s: rocca_s_seal bad output\n", v->name);
+            dump_hex("W", (uint8_t*)v->ciphertext, ct_len);
+            dump_hex("G", gotCt, ct_len);
+            return TEST_FAIL;
+        }
+        ok = rocca_s_open(gotPt, v->plaintext_len, v->key, sizeof(v->key),
+                          v->nonce, sizeof(v->nonce), v->ciphertext, ct_len,
+                          v->additional_data, v->additional_data_len);
+        if (!ok || memcmp(v->plaintext, gotPt, v->plaintext_len) != 0) {
+            fprintf(stderr, "%s: rocca_s_open failed\n", v->name);
+            return TEST_FAIL;
+        }
+    }
+
+    // Round trip partial blocks at every offset, and make sure
+    // that both halves of the tag are checked.
+    uint64_t seed = 29;
+    for (size_t pt_len = 0; pt_len <= 100; pt_len++) {
+        uint8_t k[ROCCA_S_KEY_SIZE];
+        uint8_t n[ROCCA_S_NONCE_SIZE];
+        uint8_t ad[45];
+        uint8_t pt[100];
+        uint8_t ct[100 + ROCCA_S_OVERHEAD];
+        uint8_t out[100];
+        size_t ad_len = pt_len % sizeof(ad);
+        prng_bytes(&seed, k, sizeof(k));
+        prng_bytes(&seed, n, sizeof(n));
+        prng_bytes(&seed, ad, sizeof(ad));
+        prng_bytes(&seed, pt, sizeof(pt));
+
+        const uint8_t* a = ad_len ? ad : NULL;
+        size_t ct_len    = pt_len + ROCCA_S_OVERHEAD;
+
+        ok = rocca_s_seal(ct, ct_len, k, sizeof(k), n, sizeof(n),
+                          pt_len ? pt : NULL, pt_len, a, ad_len) &&
+             rocca_s_open(out, pt_len, k, sizeof(k), n, sizeof(n), ct, ct_len,
+                          a, ad_len);
+        if (!ok || memcmp(out, pt, pt_len) != 0) {
+            fprintf(stderr, "rocca_s round trip failed (pt=%zu)\n", pt_len);
+            return TEST_FAIL;
+        }
+        size_t bad = pt_len + (pt_len % 2 ? 0 : ROCCA_S_TAG_SIZE - 1);
+        ct[bad] ^= 1;
+        if (rocca_s_open(out, pt_len, k, sizeof(k), n, sizeof(n), ct, ct_len,
+                         a, ad_len)) {
+            fprintf(stderr, "rocca_s_open accepted a bad tag\n");
+            return TEST_FAIL;
+        }
+    }
+    return TEST_PASS;
+}
+
+static int test_state_pool(void) {
+    enum { nmsgs = 64, msg_len = 77 };
+
+    uint64_t seed = 7;
+    uint8_t key[ROCCA_KEY_SIZE];
+    uint8_t nonce[ROCCA_NONCE_SIZE];
+    uint8_t pt[msg_len];
+    uint8_t ad[13];
+    prng_bytes(&seed, key, sizeof(key));
+    prng_bytes(&seed, nonce, sizeof(nonce));
+    prng_bytes(&seed, pt, sizeof(pt));
+    prng_bytes(&seed, ad, sizeof(ad));
+    // Exercise the carry into the upper bytes of the counter.
+    nonce[ROCCA_NONCE_SIZE - 1] = 0xf0;
+
+    rocca_state_pool* seal = rocca_state_pool_new(key, sizeof(key), nonce,
+                                                  sizeof(nonce), 8);
+    rocca_state_pool* open = rocca_state_pool_new(key, sizeof(key), nonce,
+                                                  sizeof(nonce), 8);
+    if (seal == NULL || open == NULL || !rocca_state_pool_start(open)) {
+        fprintf(stderr, "rocca_state_pool_new failed\n");
+        return TEST_FAIL;
+    }
+    if (rocca_state_pool_fill(seal, 100) != 8) {
+        fprintf(stderr, "rocca_state_pool_fill did not fill the pool\n");
+        return TEST_FAIL;
+    }
+
+    int result = TEST_FAIL;
+    uint8_t want_nonce[ROCCA_NONCE_SIZE];
+    memcpy(want_nonce, nonce, sizeof(nonce));
+    for (int i = 0; i < nmsgs; i++) {
+        uint8_t got_nonce[ROCCA_NONCE_SIZE];
+        uint8_t got[msg_len + ROCCA_OVERHEAD];
+        uint8_t want[msg_len + ROCCA_OVERHEAD];
+        uint8_t out[msg_len];
+        if (i % 3 == 0) {
+            rocca_state_pool_fill(seal, 2);
+        }
+        bool ok = rocca_state_pool_seal(seal, got_nonce, got, sizeof(got), pt,
+                                        sizeof(pt), ad, sizeof(ad));
+        ok = ok && rocca_seal(want, sizeof(want), key, sizeof(key), want_nonce,
+                              sizeof(want_nonce), pt, sizeof(pt), ad,
+                              sizeof(ad));
+        if (!ok || memcmp(got_nonce, want_nonce, sizeof(want_nonce)) != 0 ||
+            memcmp(got, want, sizeof(want)) != 0) {
+            fprintf(stderr, "message %d: bad pooled seal\n", i);
+            goto done;
+        }
+        // Every other message is first opened with a stale nonce,
+        // which must fail without consuming the pooled state.
+        if (i % 2 == 1 &&
+            rocca_state_pool_open(open, nonce, sizeof(nonce), out,
+                                  sizeof(out), got, sizeof(got), ad,
+                                  sizeof(ad))) {
+            fprintf(stderr, "message %d: opened with a stale nonce\n", i);
+            goto done;
+        }
+        if (!rocca_state_pool_open(open, got_nonce, sizeof(got_nonce), out,
+                                   sizeof(out), got, sizeof(got), ad,
+                                   sizeof(ad)) ||
+            memcmp(out, pt, sizeof(pt)) != 0) {
+            fprintf(stderr, "message %d: bad pooled open\n", i);
+            goto done;
+        }
+        for (int j = ROCCA_NONCE_SIZE - 1; j >= 0 && ++want_nonce[j] == 0;
+             j--) {
+        }
+    }
+    result = TEST_PASS;
+
+done:
+    rocca_state_pool_free(seal);
+    rocca_state_pool_free(open);
+    return result;
+}
+
+// test_state_pool_skip opens messages after others were lost
+// and checks that the pool skips their states and keeps using
+// the ones after them.
+static int test_state_pool_skip(void) {
+    enum { capacity = 8 };
+
+    static const uint8_t key[ROCCA_KEY_SIZE] = {1};
+    static const uint8_t pt[45]              = {2};
+    uint8_t nonce[ROCCA_NONCE_SIZE]          = {3};
+    nonce[ROCCA_NONCE_SIZE - 1]              = 0xfe;
+    rocca_state_pool* pool = rocca_state_pool_new(key, sizeof(key), nonce,
+                                                  sizeof(nonce), capacity);
+    if (pool == NULL || rocca_state_pool_fill(pool, 100) != capacity) {
+        fprintf(stderr, "rocca_state_pool_new failed\n");
+        rocca_state_pool_free(pool);
+        return TEST_FAIL;
+    }
+
+    // Each step opens the message for the nonce at |index|, with
+    // its tag corrupted if |forged| is set, and then refills the
+    // pool, which tops up the states taken or skipped.
+    static const struct {
+        uint64_t index;
+        size_t refilled;
+        bool forged;
+    } steps[] = {
+        {2, 3, false},            // 0 and 1 are lost.
+        {5, 0, true},             // A forgery does not skip ahead.
+        {1, 0, false},            // 1 arrives late and is opened as-is.
+        {3, 1, false},            // The sequence continues after 2.
+        {capacity + 4, 0, false}, // Too far ahead to skip to.
+        {4 + capacity - 1, capacity, false},
+        {4 + capacity, 1, false},
+    };
+    int result = TEST_FAIL;
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        uint8_t n[ROCCA_NONCE_SIZE];
+        uint8_t ct[sizeof(pt) + ROCCA_OVERHEAD];
+        uint8_t out[sizeof(pt)];
+        memcpy(n, nonce, sizeof(n));
+        for (uint64_t k = 0; k < steps[i].index; k++) {
+            for (int j = ROCCA_NONCE_SIZE - 1; j >= 0 && ++n[j] == 0; j--) {
+            }
+        }
+        if (!rocca_seal(ct, sizeof(ct), key, sizeof(key), n, sizeof(n), pt,
+                        sizeof(pt), NULL, 0)) {
+            fprintf(stderr, "step %zu: rocca_seal failed\n", i);
+            goto done;
+        }
+        if (steps[i].forged) {
+            ct[sizeof(ct) - 1] ^= 1;
+        }
+        bool ok = rocca_state_pool_open(pool, n, sizeof(n), out, sizeof(out),
+                                        ct, sizeof(ct), NULL, 0);
+        if (ok == steps[i].forged ||
+            (ok && memcmp(out, pt, sizeof(pt)) != 0)) {
+            fprintf(stderr, "step %zu: bad pooled open\n", i);
+            goto done;
+        }
+        size_t refilled = rocca_state_pool_fill(pool, 100);
+        if (refilled != steps[i].refilled) {
+            fprintf(stderr, "step %zu: refilled %zu states, want %zu\n", i,
+                    refilled, steps[i].refilled);
+            goto done;
+        }
+    }
+    result = TEST_PASS;
+
+done:
+    rocca_state_pool_free(pool);
+    return result;
+}
+
+static int test_buf_pool(void) {
+    enum { nbufs = 40, max_len = 1000 };
+
+    rocca_buf_pool* pool =
+        rocca_buf_pool_new(max_len, nbufs, ROCCA_BUF_HUGETLB);
+    if (pool == NULL) {
+        fprintf(stderr, "rocca_buf_pool_new failed\n");
+        return TEST_FAIL;
+    }
+    size_t size = rocca_buf_pool_buf_size(pool);
+    if (size < max_len + ROCCA_S_OVERHEAD || size % ROCCA_BUF_ALIGN != 0) {
+        fprintf(stderr, "bad buffer size: %zu\n", size);
+        rocca_buf_pool_free(pool);
+        return TEST_FAIL;
+    }
+
+    int result = TEST_FAIL;
+    uint8_t* bufs[nbufs];
+    for (int i = 0; i < nbufs; i++) {
+        bufs[i] = rocca_buf_get(pool);
+        if (bufs[i] == NULL || (uintptr_t)bufs[i] % ROCCA_BUF_ALIGN != 0) {
+            fprintf(stderr, "buffer %d: bad buffer\n", i);
+            goto done;
+        }
+        for (size_t j = 0; j < size; j++) {
+            if (bufs[i][j] != 0) {
+                fprintf(stderr, "buffer %d: not zeroed\n", i);
+                goto done;
+            }
+        }
+        // Seal in place: every byte of the buffer must be usable
+        // and must not overlap any other buffer.
+        static const uint8_t key[ROCCA_KEY_SIZE] = {0};
+        uint8_t nonce[ROCCA_NONCE_SIZE]          = {(uint8_t)i};
+        memset(bufs[i], i, max_len);
+        if (!rocca_seal(bufs[i], size, key, sizeof(key), nonce, sizeof(nonce),
+                        bufs[i], max_len, NULL, 0)) {
+            fprintf(stderr, "buffer %d: seal failed\n", i);
+            goto done;
+        }
+        memset(&bufs[i][max_len + ROCCA_OVERHEAD], i,
+               size - max_len - ROCCA_OVERHEAD);
+    }
+    if (rocca_buf_get(pool) != NULL) {
+        fprintf(stderr, "rocca_buf_get did not run out\n");
+        goto done;
+    }
+    uint8_t other[ROCCA_BUF_ALIGN];
+    if (rocca_buf_put(pool, &bufs[0][1]) || rocca_buf_put(pool, other)) {
+        fprintf(stderr, "rocca_buf_put accepted a foreign buffer\n");
+        goto done;
+    }
+    for (int i = 0; i < nbufs; i++) {
+        if (!rocca_buf_put(pool, bufs[i])) {
+            fprintf(stderr, "buffer %d: rocca_buf_put failed\n", i);
+            goto done;
+        }
+    }
+    // Returned buffers are wiped, so reuse hands out zeros.
+    for (int i = 0; i < nbufs; i++) {
+        bufs[i] = rocca_buf_get(pool);
+        for (size_t j = 0; bufs[i] != NULL && j < size; j++) {
+            if (bufs[i][j] != 0) {
+                fprintf(stderr, "buffer %d: not wiped\n", i);
+                goto done;
+            }
+        }
+    }
+    result = TEST_PASS;
+
+done:
+    rocca_buf_pool_free(pool);
+    return result;
+}
+
+static int test_session_table(void) {
+    enum { nsessions = 9, nmsgs = 41 };
+
+    uint64_t seed = 11;
+    uint8_t keys[nsessions][ROCCA_KEY_SIZE];
+    uint8_t nonces[nsessions][ROCCA_NONCE_SIZE];
+    prng_bytes(&seed, (uint8_t*)keys, sizeof(keys));
+    prng_bytes(&seed, (uint8_t*)nonces, sizeof(nonces));
+
+    rocca_session_table* table = rocca_session_table_new(nsessions + 1);
+    if (table == NULL) {
+        fprintf(stderr, "rocca_session_table_new failed\n");
+        return TEST_FAIL;
+    }
+    // The last session is left unset.
+    for (int i = 0; i < nsessions; i++) {
+        if (!rocca_session_set(table, i, keys[i], ROCCA_KEY_SIZE, nonces[i],
+                               ROCCA_NONCE_SIZE)) {
+            fprintf(stderr, "rocca_session_set failed\n");
+            rocca_session_table_free(table);
+            return TEST_FAIL;
+        }
+    }
+
+    int result = TEST_FAIL;
+    uint8_t pt[nmsgs][100];
+    uint8_t ct[nmsgs][100 + ROCCA_OVERHEAD];
+    uint8_t ad[nmsgs][40];
+    uint64_t counters[nsessions] = {0};
+    uint64_t bytes[nsessions]    = {0};
+    rocca_session_msg msgs[nmsgs];
+    prng_bytes(&seed, (uint8_t*)pt, sizeof(pt));
+    prng_bytes(&seed, (uint8_t*)ad, sizeof(ad));
+    for (int i = 0; i < nmsgs; i++) {
+        size_t pt_len        = prng_uint(&seed, sizeof(pt[i]) + 1);
+        size_t ad_len        = prng_uint(&seed, sizeof(ad[i]) + 1);
+        rocca_session_msg* m = &msgs[i];
+        memset(m, 0, sizeof(*m));
+        m->session             = prng_uint(&seed, nsessions + 2);
+        m->dst                 = ct[i];
+        m->dst_len             = pt_len + ROCCA_OVERHEAD;
+        m->plaintext           = pt_len ? pt[i] : NULL;
+        m->plaintext_len       = pt_len;
+        m->additional_data     = ad_len ? ad[i] : NULL;
+        m->additional_data_len = ad_len;
+    }
+    size_t want = 0;
+    for (int i = 0; i < nmsgs; i++) {
+        want += msgs[i].session < nsessions;
+    }
+    if (rocca_session_seal_batch(table, msgs, nmsgs) != want) {
+        fprintf(stderr, "rocca_session_seal_batch: wrong count\n");
+        goto done;
+    }
+
+    for (int i = 0; i < nmsgs; i++) {
+        const rocca_session_msg* m = &msgs[i];
+        if (m->session >= nsessions) {
+            if (m->ok) {
+                fprintf(stderr, "message %d: sealed for a bad session\n", i);
+                goto done;
+            }
+            continue;
+        }
+        uint8_t nonce[ROCCA_NONCE_SIZE];
+        memcpy(nonce, nonces[m->session], sizeof(nonce));
+        for (uint64_t c = counters[m->session]++; c > 0; c--) {
+            for (int j = ROCCA_NONCE_SIZE - 1; j >= 0 && ++nonce[j] == 0;
+                 j--) {
+            }
+        }
+        bytes[m->session] += m->plaintext_len;
+
+        uint8_t want_ct[sizeof(ct[i])];
+        if (!m->ok || memcmp(m->nonce, nonce, sizeof(nonce)) != 0 ||
+            !rocca_seal(want_ct, m->dst_len, keys[m->session],
+                        ROCCA_KEY_SIZE, nonce, sizeof(nonce), m->plaintext,
+                        m->plaintext_len, m->additional_data,
+                        m->additional_data_len) ||
+            memcmp(m->dst, want_ct, m->dst_len) != 0) {
+            fprintf(stderr, "message %d: bad batched seal\n", i);
+            goto done;
+        }
+    }
+    for (int i = 0; i < nsessions; i++) {
+        uint64_t got_msgs  = 0;
+        uint64_t got_bytes = 0;
+        if (!rocca_session_stats(table, i, &got_msgs, &got_bytes) ||
+            got_msgs != counters[i] || got_bytes != bytes[i]) {
+            fprintf(stderr, "session %d: bad stats\n", i);
+            goto done;
+        }
+    }
+    result = TEST_PASS;
+
+done:
+    rocca_session_table_free(table);
+    return result;
+}
+
+static int test_seal_fanout(void) {
+    enum { max_recipients = 40, max_pt = 5000, max_ad = 2100 };
+    static const size_t counts[]  = {0, 1, 3, 4, 5, 17, max_recipients};
+    static const size_t pt_lens[] = {0, 1, 32, 100, 4097, max_pt};
+    static const size_t ad_lens[] = {0, 13, 64, max_ad};
+
+    static uint8_t keys[max_recipients][ROCCA_KEY_SIZE];
+    static uint8_t nonces[max_recipients][ROCCA_NONCE_SIZE];
+    static uint8_t pt[max_pt];
+    static uint8_t ad[max_ad];
+    static uint8_t ct[max_recipients][max_pt + ROCCA_OVERHEAD];
+    static uint8_t want[max_pt + ROCCA_OVERHEAD];
+
+    uint64_t seed = 13;
+    prng_bytes(&seed, (uint8_t*)keys, sizeof(keys));
+    prng_bytes(&seed, (uint8_t*)nonces, sizeof(nonces));
+    prng_bytes(&seed, pt, sizeof(pt));
+    prng_bytes(&seed, ad, sizeof(ad));
+
+    rocca_recipient recipients[max_recipients];
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        for (size_t p = 0; p < sizeof(pt_lens) / sizeof(pt_lens[0]); p++) {
+            for (size_t a = 0; a < sizeof(ad_lens) / sizeof(ad_lens[0]);
+                 a++) {
+                size_t n      = counts[c];
+                size_t pt_len = pt_lens[p];
+                size_t ad_len = ad_lens[a];
+                for (size_t j = 0; j < n; j++) {
+                    recipients[j] = (rocca_recipient){
+                        .key       = keys[j],
+                        .key_len   = ROCCA_KEY_SIZE,
+                        .nonce     = nonces[j],
+                        .nonce_len = ROCCA_NONCE_SIZE,
+                        .dst       = ct[j],
+                        .dst_len   = pt_len + ROCCA_OVERHEAD,
+                    };
+                }
+                if (!rocca_seal_fanout(recipients, n, pt_len ? pt : NULL,
+                                       pt_len, ad_len ? ad : NULL, ad_len)) {
+                    fprintf(stderr, "rocca_seal_fanout failed\n");
+                    return TEST_FAIL;
+                }
+                for (size_t j = 0; j < n; j++) {
+                    if (!rocca_seal(want, pt_len + ROCCA_OVERHEAD, keys[j],
+                                    ROCCA_KEY_SIZE, nonces[j],
+                                    ROCCA_NONCE_SIZE, pt_len ? pt : NULL,
+                                    pt_len, ad_len ? ad : NULL, ad_len) ||
+                        memcmp(ct[j], want, pt_len + ROCCA_OVERHEAD) != 0) {
+                        fprintf(stderr,
+                                "recipient %zu of %zu (pt=%zu ad=%zu): "
+                                "mismatch\n",
+                                j, n, pt_len, ad_len);
+                        return TEST_FAIL;
+                    }
+                }
+            }
+        }
+    }
+
+    // One bad recipient fails the whole call.
+    for (size_t j = 0; j < 5; j++) {
+        recipients[j].dst_len = 100 + ROCCA_OVERHEAD;
+    }
+    recipients[3].key_len = ROCCA_KEY_SIZE - 1;
+    if (rocca_seal_fanout(recipients, 5, pt, 100, NULL, 0)) {
+        fprintf(stderr, "rocca_seal_fanout: accepted a bad key\n");
+        return TEST_FAIL;
+    }
+    static const uint8_t zero[100 + ROCCA_OVERHEAD] = {0};
+    for (size_t j = 0; j < 5; j++) {
+        if (memcmp(ct[j], zero, sizeof(zero)) != 0) {
+            fprintf(stderr, "rocca_seal_fanout: dst not wiped\n");
+            return TEST_FAIL;
+        }
+    }
+    return TEST_PASS;
+}
+
+static int test_file(void) {
+    enum { file_len = 100000, segment_size = 1000 };
+    static const size_t cache_sizes[] = {0, 4};
+
+    static uint8_t pt[file_len];
+    static uint8_t got[file_len];
+    uint64_t seed                   = 17;
+    uint8_t key[ROCCA_KEY_SIZE]     = {0};
+    uint8_t nonce[ROCCA_NONCE_SIZE] = {0};
+    prng_bytes(&seed, key, sizeof(key));
+    prng_bytes(&seed, nonce, sizeof(nonce));
+    prng_bytes(&seed, pt, sizeof(pt));
+
+    FILE* fp = tmpfile();
+    if (fp == NULL) {
+        perror("tmpfile");
+        return TEST_FAIL;
+    }
+    int fd     = fileno(fp);
+    int result = TEST_FAIL;
+
+    rocca_file_writer* w = rocca_file_writer_new(
+        fd, key, sizeof(key), nonce, sizeof(nonce), segment_size);
+    if (w == NULL) {
+        fprintf(stderr, "rocca_file_writer_new failed\n");
+        goto done;
+    }
+    for (size_t off = 0; off < file_len;) {
+        size_t n = prng_uint(&seed, 3 * segment_size);
+        if (n > file_len - off) {
+            n = file_len - off;
+        }
+        if (!rocca_file_write(w, &pt[off], n)) {
+            fprintf(stderr, "rocca_file_write failed\n");
+            rocca_file_writer_free(w);
+            goto done;
+        }
+        off += n;
+    }
+    bool ok = rocca_file_writer_finish(w);
+    rocca_file_writer_free(w);
+    if (!ok) {
+        fprintf(stderr, "rocca_file_writer_finish failed\n");
+        goto done;
+    }
+
+    uint8_t bad_key[ROCCA_KEY_SIZE];
+    memcpy(bad_key, key, sizeof(key));
+    bad_key[0] ^= 1;
+    if (rocca_file_open(fd, bad_key, sizeof(bad_key), 0) != NULL) {
+        fprintf(stderr, "rocca_file_open: accepted the wrong key\n");
+        goto done;
+    }
+
+    for (size_t c = 0; c < sizeof(cache_sizes) / sizeof(cache_sizes[0]);
+         c++) {
+        rocca_file* f = rocca_file_open(fd, key, sizeof(key), cache_sizes[c]);
+        if (f == NULL || rocca_file_size(f) != file_len) {
+            fprintf(stderr, "rocca_file_open failed\n");
+            rocca_file_close(f);
+            goto done;
+        }
+        for (int i = 0; i < 500; i++) {
+            uint64_t off = prng_uint(&seed, file_len + 10);
+            size_t len   = prng_uint(&seed, 4 * segment_size);
+            size_t want  = 0;
+            if (off < file_len) {
+                want = len < file_len - off ? len : file_len - off;
+            }
+            size_t n = SIZE_MAX;
+            if (!rocca_file_pread(f, got, len, off, &n) || n != want ||
+                memcmp(got, &pt[off < file_len ? off : 0], n) != 0) {
+                fprintf(stderr, "rocca_file_pread(%zu, %" PRIu64 ") failed\n",
+                        len, off);
+                rocca_file_close(f);
+                goto done;
+            }
+        }
+        rocca_file_close(f);
+    }
+
+    // Corrupt segment 7.
+    uint8_t b;
+    off_t pos = ROCCA_FILE_HEADER_SIZE + 7 * (segment_size + ROCCA_OVERHEAD);
+    if (pread(fd, &b, 1, pos) != 1) {
+        goto done;
+    }
+    b ^= 1;
+    if (pwrite(fd, &b, 1, pos) != 1) {
+        goto done;
+    }
+    for (size_t c = 0; c < sizeof(cache_sizes) / sizeof(cache_sizes[0]);
+         c++) {
+        rocca_file* f = rocca_file_open(fd, key, sizeof(key), cache_sizes[c]);
+        if (f == NULL) {
+            goto done;
+        }
+        size_t n = 0;
+        memset(got, 0xff, 10);
+        ok = !rocca_file_pread(f, got, 10, 7 * segment_size + 5, &n) &&
+             n == 0 && got[0] == 0 &&
+             rocca_file_pread(f, got, 2000, 8 * segment_size, &n) &&
+             n == 2000 && memcmp(got, &pt[8 * segment_size], n) == 0;
+        rocca_file_close(f);
+        if (!ok) {
+            fprintf(stderr, "rocca_file_pread: read a corrupt segment\n");
+            goto done;
+        }
+    }
+    result = TEST_PASS;
+
+done:
+    fclose(fp);
+    return result;
+}
+
+static int test_page_cipher(void) {
+    enum { npages = 7, max_page = 16384 };
+    static const size_t page_sizes[]  = {1000, 4096, 8192, max_page};
+    static const size_t header_lens[] = {0, 24};
+
+    static uint8_t pages[npages][max_page];
+    static uint8_t orig[npages][max_page];
+    static uint8_t want[max_page];
+
+    uint64_t seed               = 19;
+    uint8_t key[ROCCA_KEY_SIZE] = {0};
+    prng_bytes(&seed, key, sizeof(key));
+
+    for (size_t ps = 0; ps < sizeof(page_sizes) / sizeof(page_sizes[0]);
+         ps++) {
+        for (size_t hl = 0; hl < sizeof(header_lens) / sizeof(header_lens[0]);
+             hl++) {
+            size_t page_size   = page_sizes[ps];
+            size_t header_len  = header_lens[hl];
+            size_t payload_len = page_size - header_len - ROCCA_TAG_SIZE;
+            rocca_page_cipher* c =
+                rocca_page_cipher_new(key, sizeof(key), page_size, header_len);
+            if (c == NULL) {
+                fprintf(stderr, "rocca_page_cipher_new failed\n");
+                return TEST_FAIL;
+            }
+
+            // Page 3 is missing.
+            rocca_page batch[npages];
+            prng_bytes(&seed, (uint8_t*)pages, sizeof(pages));
+            memcpy(orig, pages, sizeof(pages));
+            for (int i = 0; i < npages; i++) {
+                batch[i] = (rocca_page){
+                    .data    = i == 3 ? NULL : pages[i],
+                    .page_no = prng_uint(&seed, 1000),
+                    .lsn     = prng_uint(&seed, UINT64_MAX),
+                };
+            }
+
+            int result = TEST_FAIL;
+            if (rocca_page_seal_batch(c, batch, npages) != npages - 1 ||
+                batch[3].ok) {
+                fprintf(stderr, "rocca_page_seal_batch: wrong count\n");
+                goto next;
+            }
+            for (int i = 0; i < npages; i++) {
+                if (i == 3) {
+                    continue;
+                }
+                uint8_t nonce[ROCCA_NONCE_SIZE];
+                for (int j = 0; j < 8; j++) {
+                    nonce[j]     = (uint8_t)(batch[i].page_no >> (8 * j));
+                    nonce[8 + j] = (uint8_t)(batch[i].lsn >> (8 * j));
+                }
+                // The page is |rocca_seal| of the payload with the
+                // header as additional data.
+                if (!batch[i].ok ||
+                    memcmp(pages[i], orig[i], header_len) != 0 ||
+                    !rocca_seal(want, payload_len + ROCCA_OVERHEAD, key,
+                                sizeof(key), nonce, sizeof(nonce),
+                                payload_len ? &orig[i][header_len] : NULL,
+                                payload_len, header_len ? orig[i] : NULL,
+                                header_len) ||
+                    memcmp(&pages[i][header_len], want,
+                           payload_len + ROCCA_OVERHEAD) != 0) {
+                    fprintf(stderr, "page %d: bad seal\n", i);
+                    goto next;
+                }
+                if (!rocca_page_verify(c, pages[i], batch[i].page_no,
+                                       batch[i].lsn) ||
+                    rocca_page_verify(c, pages[i], batch[i].page_no,
+                                      batch[i].lsn + 1)) {
+                    fprintf(stderr, "page %d: bad verify\n", i);
+                    goto next;
+                }
+            }
+
+            pages[5][page_size - 1] ^= 1;
+            if (rocca_page_open_batch(c, batch, npages) != npages - 2) {
+                fprintf(stderr, "rocca_page_open_batch: wrong count\n");
+                goto next;
+            }
+            for (int i = 0; i < npages; i++) {
+                if (i == 3) {
+                    continue;
+                }
+                bool ok = false;
+                if (i == 5) {
+                    ok = !batch[i].ok && pages[i][0] == 0 &&
+                         pages[i][page_size - 1] == 0;
+                } else {
+                    ok = batch[i].ok &&
+                         memcmp(pages[i], orig[i],
+                                page_size - ROCCA_TAG_SIZE) == 0;
+                }
+                if (!ok) {
+                    fprintf(stderr, "page %d: bad open\n", i);
+                    goto next;
+                }
+            }
+            result = TEST_PASS;
+
+        next:
+            rocca_page_cipher_free(c);
+            if (result != TEST_PASS) {
+                fprintf(stderr, "page_size=%zu header_len=%zu\n", page_size,
+                        header_len);
+                return result;
+            }
+        }
+    }
+    return TEST_PASS;
+}
+
 enum {
     one_second   = 1000000000L,
     one_megabyte = 1024 * 1024,
@@ -307,53 +1302,434 @@ __attribute__((always_inline)) static inline uint64_t now() {
     return ts.tv_sec * (uint64_t)one_second + ts.tv_nsec;
 }
 
-static int benchmark_N(const uint8_t* plaintext, size_t plaintext_len) {
+// aead_func is the signature shared by the seal and open
+// functions of every AEAD in this package.
+typedef bool (*aead_func)(uint8_t* dst,
+                          size_t dst_len,
+                          const uint8_t* key,
+                          size_t key_len,
+                          const uint8_t* nonce,
+                          size_t nonce_len,
+                          const uint8_t* plaintext,
+                          size_t plaintext_len,
+                          const uint8_t* additional_data,
+                          size_t additional_data_len);
+
+typedef struct aead {
+    const char* name;
+    size_t key_len;
+    size_t nonce_len;
+    size_t overhead;
+    aead_func seal;
+} aead;
+
+static const aead aeads[] = {
+    {"rocca", ROCCA_KEY_SIZE, ROCCA_NONCE_SIZE, ROCCA_OVERHEAD, rocca_seal},
+    {"rocca-s", ROCCA_S_KEY_SIZE, ROCCA_S_NONCE_SIZE, ROCCA_S_OVERHEAD,
+     rocca_s_seal},
+    {"aegis128l", AEGIS128L_KEY_SIZE, AEGIS128L_NONCE_SIZE, AEGIS128L_OVERHEAD,
+     aegis128l_seal},
+    {"aegis256", AEGIS256_KEY_SIZE, AEGIS256_NONCE_SIZE, AEGIS256_OVERHEAD,
+     aegis256_seal},
+};
+
+static int benchmark_aead(const aead* a,
+                          const uint8_t* plaintext,
+                          size_t plaintext_len) {
     int result = TEST_FAIL;
 
-    const size_t ciphertext_len = plaintext_len + ROCCA_OVERHEAD;
-    uint8_t* ciphertext         = calloc(ciphertext_len, 1);
-    if (ciphertext == NULL) {
-        goto done;
+    const size_t ciphertext_len = plaintext_len + a->overhead;
+    uint8_t* ciphertext         = calloc(ciphertext_len, 1);
+    if (ciphertext == NULL) {
+        goto done;
+    }
+
+    static const uint8_t key[32]   = {0};
+    static const uint8_t nonce[32] = {0};
+
+    static const uint8_t additional_data[32] = {0};
+    static const size_t additional_data_len  = sizeof(additional_data);
+
+    int iters        = 0;
+    uint64_t elapsed = 0;
+    while (elapsed < one_second) {
+        uint64_t start = now();
+        bool ok = a->seal(ciphertext, ciphertext_len, key, a->key_len, nonce,
+                          a->nonce_len, plaintext, plaintext_len,
+                          additional_data, additional_data_len);
+        uint64_t stop = now();
+        if (!ok) {
+            fprintf(stderr, "%s: seal failed\n", a->name);
+            goto done;
+        }
+        if (stop > start) {
+            elapsed += stop - start;
+            iters++;
+        }
+    }
+
+    uint64_t total = (uint64_t)plaintext_len * iters;
+    fprintf(stderr, "%s: %0.2f MB/s\n", a->name,
+            (double)total / (double)one_megabyte);
+    fprintf(stderr, "%s: %" PRIu64 " ns/op\n", a->name, elapsed / iters);
+
+    result = TEST_PASS;
+
+done:
+    free(ciphertext);
+    return result;
+}
+
+static int benchmark_N(const uint8_t* plaintext, size_t plaintext_len) {
+    int naeads = sizeof(aeads) / sizeof(aeads[0]);
+    for (int i = 0; i < naeads; i++) {
+        if (benchmark_aead(&aeads[i], plaintext, plaintext_len) != TEST_PASS) {
+            return TEST_FAIL;
+        }
+    }
+    return TEST_PASS;
+}
+
+// aegis_vector is a test vector from draft-irtf-cfrg-aegis-aead.
+typedef struct aegis_vector {
+    const char* name;
+    uint8_t key[32];
+    uint8_t nonce[32];
+    uint8_t additional_data[8];
+    size_t additional_data_len;
+    uint8_t plaintext[32];
+    size_t plaintext_len;
+    uint8_t ciphertext[32 + 16];
+} aegis_vector;
+
+static int test_aegis_vectors(const aegis_vector* vectors,
+                              int nvecs,
+                              size_t key_len,
+                              size_t nonce_len,
+                              aead_func seal,
+                              aead_func open) {
+    for (int i = 0; i < nvecs; i++) {
+        const aegis_vector* v = &vectors[i];
+        const uint8_t* pt     = v->plaintext_len ? v->plaintext : NULL;
+        const uint8_t* ad = v->additional_data_len ? v->additional_data : NULL;
+        size_t ct_len     = v->plaintext_len + 16;
+
+        uint8_t gotCt[sizeof(v->ciphertext)] = {0};
+        bool ok = seal(gotCt, ct_len, v->key, key_len, v->nonce, nonce_len, pt,
+                       v->plaintext_len, ad, v->additional_data_len);
+        if (!ok) {
+            fprintf(stderr, "%s: seal failed\n", v->name);
+            return TEST_FAIL;
+        }
+        if (memcmp(v->ciphertext, gotCt, ct_len) != 0) {
+            fprintf(stderr, "%s: seal bad output\n", v->name);
+            dump_hex("W", (uint8_t*)v->ciphertext, ct_len);
+            dump_hex("G", gotCt, ct_len);
+            return TEST_FAIL;
+        }
+
+        uint8_t gotPt[sizeof(v->plaintext)] = {0};
+        ok = open(gotPt, v->plaintext_len, v->key, key_len, v->nonce,
+                  nonce_len, v->ciphertext, ct_len, ad,
+                  v->additional_data_len);
+        if (!ok || memcmp(gotPt, v->plaintext, v->plaintext_len) != 0) {
+            fprintf(stderr, "%s: open failed\n", v->name);
+            return TEST_FAIL;
+        }
+
+        gotCt[ct_len - 1] ^= 1;
+        if (open(gotPt, v->plaintext_len, v->key, key_len, v->nonce,
+                 nonce_len, gotCt, ct_len, ad, v->additional_data_len)) {
+            fprintf(stderr, "%s: open accepted a bad tag\n", v->name);
+            return TEST_FAIL;
+        }
     }
+    return TEST_PASS;
+}
 
-    const uint8_t key[ROCCA_KEY_SIZE] = {0};
-    static const size_t key_len       = sizeof(key);
+// test_sealer pushes messages of many lengths through
+// a |rocca_sealer|, one of them invalid, and checks that they
+// come back in order and match |rocca_seal|.
+static int test_sealer(void) {
+    enum { nmsgs = 40, max_len = 200 };
 
-    const uint8_t nonce[ROCCA_NONCE_SIZE] = {0};
-    static const size_t nonce_len         = sizeof(nonce);
+    static uint8_t plaintext[nmsgs][max_len];
+    static uint8_t additional_data[nmsgs][max_len];
+    static uint8_t ciphertext[nmsgs][max_len + ROCCA_OVERHEAD];
+    static uint8_t want[max_len + ROCCA_OVERHEAD];
+    static uint8_t nonces[nmsgs][ROCCA_NONCE_SIZE];
 
-    static const uint8_t additional_data[32] = {0};
-    static const size_t additional_data_len  = sizeof(additional_data);
+    uint64_t seed               = 23;
+    uint8_t key[ROCCA_KEY_SIZE] = {0};
+    prng_bytes(&seed, key, sizeof(key));
+    prng_bytes(&seed, (uint8_t*)plaintext, sizeof(plaintext));
+    prng_bytes(&seed, (uint8_t*)additional_data, sizeof(additional_data));
+    prng_bytes(&seed, (uint8_t*)nonces, sizeof(nonces));
 
-    int iters        = 0;
-    uint64_t elapsed = 0;
-    while (elapsed < one_second) {
-        uint64_t start = now();
-        bool ok = rocca_seal(ciphertext, ciphertext_len, key, key_len, nonce,
-                             nonce_len, plaintext, plaintext_len,
-                             additional_data, additional_data_len);
-        uint64_t stop = now();
-        if (!ok) {
-            fprintf(stderr, "rocca_seal failed\n");
-            goto done;
+    rocca_sealer* p = rocca_sealer_new(key, sizeof(key));
+    if (p == NULL) {
+        fprintf(stderr, "rocca_sealer_new failed\n");
+        return TEST_FAIL;
+    }
+
+    // Message 7 is invalid.
+    rocca_sealer_msg msgs[nmsgs];
+    size_t next = 0;
+    for (size_t i = 0; i <= nmsgs; i++) {
+        rocca_sealer_msg* done;
+        if (i < nmsgs) {
+            size_t pt_len = prng_uint(&seed, max_len);
+            size_t ad_len = prng_uint(&seed, max_len);
+            msgs[i]       = (rocca_sealer_msg){
+                .nonce               = nonces[i],
+                .nonce_len           = i == 7 ? 0 : ROCCA_NONCE_SIZE,
+                .dst                 = ciphertext[i],
+                .dst_len             = sizeof(ciphertext[i]),
+                .plaintext           = pt_len ? plaintext[i] : NULL,
+                .plaintext_len       = pt_len,
+                .additional_data     = ad_len ? additional_data[i] : NULL,
+                .additional_data_len = ad_len,
+            };
+            done = rocca_sealer_push(p, &msgs[i]);
+        } else {
+            done = rocca_sealer_flush(p);
         }
-        if (stop > start) {
-            elapsed += stop - start;
-            iters++;
+        if (i == 0) {
+            if (done != NULL) {
+                fprintf(stderr, "rocca_sealer_push: unexpected message\n");
+                goto fail;
+            }
+            continue;
+        }
+        if (done != &msgs[next]) {
+            fprintf(stderr, "message %zu: out of order\n", next);
+            goto fail;
         }
+        bool ok = rocca_seal(want, done->dst_len, key, sizeof(key),
+                             done->nonce, done->nonce_len, done->plaintext,
+                             done->plaintext_len, done->additional_data,
+                             done->additional_data_len);
+        size_t n = ok ? done->plaintext_len + ROCCA_OVERHEAD : done->dst_len;
+        if (done->ok != ok || done->ok != (next != 7) ||
+            memcmp(done->dst, want, n) != 0) {
+            fprintf(stderr, "message %zu: bad seal\n", next);
+            goto fail;
+        }
+        next++;
+    }
+    if (next != nmsgs || rocca_sealer_flush(p) != NULL) {
+        fprintf(stderr, "rocca_sealer_flush: unexpected message\n");
+        goto fail;
     }
+    rocca_sealer_free(p);
+    return TEST_PASS;
 
-    uint64_t total = (uint64_t)plaintext_len * iters;
-    fprintf(stderr, "%0.2f MB/s\n", (double)total / (double)one_megabyte);
-    fprintf(stderr, "%" PRIu64 " ns/op\n", elapsed / iters);
+fail:
+    rocca_sealer_free(p);
+    return TEST_FAIL;
+}
+
+// test_tuning runs the batch tests again under a tuning other
+// than the default, then checks that |rocca_autotune| adds this
+// host to its cache and reads it back.
+static int test_tuning(void) {
+    rocca_tuning orig;
+    rocca_tuning_get(&orig);
+    if (orig.backend == NULL || orig.lanes != ROCCA_TUNING_MAX_LANES ||
+        orig.sealer_interleave) {
+        fprintf(stderr, "rocca_tuning_get: bad defaults\n");
+        return TEST_FAIL;
+    }
+    rocca_tuning bad = orig;
+    bad.lanes        = ROCCA_TUNING_MAX_LANES + 1;
+    if (rocca_tuning_set(&bad)) {
+        fprintf(stderr, "rocca_tuning_set: accepted bad lanes\n");
+        return TEST_FAIL;
+    }
+    bad              = orig;
+    bad.fanout_chunk = ROCCA_TUNING_MIN_CHUNK + 1;
+    if (rocca_tuning_set(&bad)) {
+        fprintf(stderr, "rocca_tuning_set: accepted bad chunk\n");
+        return TEST_FAIL;
+    }
+
+    int result     = TEST_FAIL;
+    FILE* fp       = NULL;
+    char path[]    = "/tmp/rocca-tune-XXXXXX";
+    int fd         = -1;
+    rocca_tuning t = {
+        .lanes             = 3,
+        .fanout_chunk      = ROCCA_TUNING_MIN_CHUNK,
+        .sealer_interleave = true,
+    };
+    if (!rocca_tuning_set(&t) || test_session_table() != TEST_PASS ||
+        test_seal_fanout() != TEST_PASS || test_page_cipher() != TEST_PASS ||
+        test_sealer() != TEST_PASS) {
+        fprintf(stderr, "batch tests failed under tuning\n");
+        goto done;
+    }
+
+    // The cache starts with an entry for another host, which must
+    // be kept.
+    static const char other[] = "Other CPU\taes-ni\t2 4096 0\n";
+    fd                        = mkstemp(path);
+    if (fd < 0 || write(fd, other, strlen(other)) != (ssize_t)strlen(other)) {
+        perror("mkstemp");
+        goto done;
+    }
+    close(fd);
+    if (!rocca_autotune(path, &t) || strcmp(t.backend, orig.backend) != 0) {
+        fprintf(stderr, "rocca_autotune failed\n");
+        goto done;
+    }
 
+    // Replace the settings measured for this host, so that the
+    // next call can only get them from the cache.
+    char lines[3][256] = {{0}};
+    fp                 = fopen(path, "r");
+    for (int i = 0; fp != NULL && i < 3; i++) {
+        if (fgets(lines[i], sizeof(lines[i]), fp) == NULL) {
+            break;
+        }
+    }
+    char* ours = strrchr(lines[2], '\t');
+    if (fp == NULL || lines[0][0] != '#' || strcmp(lines[1], other) != 0 ||
+        ours == NULL) {
+        fprintf(stderr, "rocca_autotune: bad cache\n");
+        goto done;
+    }
+    fclose(fp);
+    fp = fopen(path, "w");
+    strcpy(ours, "\t1 2048 0\n");
+    if (fp == NULL || fputs(lines[0], fp) < 0 || fputs(lines[1], fp) < 0 ||
+        fputs(lines[2], fp) < 0 || fclose(fp) != 0) {
+        fp = NULL;
+        perror(path);
+        goto done;
+    }
+    fp = NULL;
+    if (!rocca_autotune(path, &t) || t.lanes != 1 || t.fanout_chunk != 2048 ||
+        t.sealer_interleave) {
+        fprintf(stderr, "rocca_autotune: cache not used\n");
+        goto done;
+    }
     result = TEST_PASS;
 
 done:
-    free(ciphertext);
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    if (fd >= 0) {
+        unlink(path);
+    }
+    rocca_tuning_set(&orig);
     return result;
 }
 
+static int test_aegis128l(void) {
+    static const aegis_vector vectors[] = {
+        {
+            .name          = "=== AEGIS-128L test vector #1===",
+            .key           = {0x10, 0x01},
+            .nonce         = {0x10, 0x00, 0x02},
+            .plaintext     = {0},
+            .plaintext_len = 16,
+            .ciphertext =
+                {
+                    0xc1, 0xc0, 0xe5, 0x8b, 0xd9, 0x13, 0x00, 0x6f, 0xeb, 0xa0,
+                    0x0f, 0x4b, 0x3c, 0xc3, 0x59, 0x4e, 0xab, 0xe0, 0xec, 0xe8,
+                    0x0c, 0x24, 0x86, 0x8a, 0x22, 0x6a, 0x35, 0xd1, 0x6b, 0xda,
+                    0xe3, 0x7a,
+                },
+        },
+        {
+            .name  = "=== AEGIS-128L test vector #2===",
+            .key   = {0x10, 0x01},
+            .nonce = {0x10, 0x00, 0x02},
+            .ciphertext =
+                {
+                    0xc2, 0xb8, 0x79, 0xa6, 0x7d, 0xef, 0x9d, 0x74, 0xe6, 0xc1,
+                    0x4f, 0x70, 0x8b, 0xbc, 0xc9, 0xb4,
+                },
+        },
+        {
+            .name                = "=== AEGIS-128L test vector #4===",
+            .key                 = {0x10, 0x01},
+            .nonce               = {0x10, 0x00, 0x02},
+            .additional_data     = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+                                    0x07},
+            .additional_data_len = 8,
+            .plaintext =
+                {
+                    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+                    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d,
+                },
+            .plaintext_len = 14,
+            .ciphertext =
+                {
+                    0x79, 0xd9, 0x45, 0x93, 0xd8, 0xc2, 0x11, 0x9d, 0x7e, 0x8f,
+                    0xd9, 0xb8, 0xfc, 0x77, 0x5c, 0x04, 0xb3, 0xdb, 0xa8, 0x49,
+                    0xb2, 0x70, 0x1e, 0xff, 0xbe, 0x32, 0xc7, 0xf0, 0xfa, 0xb7,
+                },
+        },
+    };
+    return test_aegis_vectors(vectors, sizeof(vectors) / sizeof(vectors[0]),
+                              AEGIS128L_KEY_SIZE, AEGIS128L_NONCE_SIZE,
+                              aegis128l_seal, aegis128l_open);
+}
+
+static int test_aegis256(void) {
+    static const aegis_vector vectors[] = {
+        {
+            .name          = "=== AEGIS-256 test vector #1===",
+            .key           = {0x10, 0x01},
+            .nonce         = {0x10, 0x00, 0x02},
+            .plaintext     = {0},
+            .plaintext_len = 16,
+            .ciphertext =
+                {
+                    0x75, 0x4f, 0xc3, 0xd8, 0xc9, 0x73, 0x24, 0x6d, 0xcc, 0x6d,
+                    0x74, 0x14, 0x12, 0xa4, 0xb2, 0x36, 0x3f, 0xe9, 0x19, 0x94,
+                    0x76, 0x8b, 0x33, 0x2e, 0xd7, 0xf5, 0x70, 0xa1, 0x9e, 0xc5,
+                    0x89, 0x6e,
+                },
+        },
+        {
+            .name  = "=== AEGIS-256 test vector #2===",
+            .key   = {0x10, 0x01},
+            .nonce = {0x10, 0x00, 0x02},
+            .ciphertext =
+                {
+                    0xe3, 0xde, 0xf9, 0x78, 0xa0, 0xf0, 0x54, 0xaf, 0xd1, 0xe7,
+                    0x61, 0xd7, 0x55, 0x3a, 0xfb, 0xa3,
+                },
+        },
+        {
+            .name                = "=== AEGIS-256 test vector #4===",
+            .key                 = {0x10, 0x01},
+            .nonce               = {0x10, 0x00, 0x02},
+            .additional_data     = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+                                    0x07},
+            .additional_data_len = 8,
+            .plaintext =
+                {
+                    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+                    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d,
+                },
+            .plaintext_len = 14,
+            .ciphertext =
+                {
+                    0xf3, 0x73, 0x07, 0x9e, 0xd8, 0x4b, 0x27, 0x09, 0xfa, 0xee,
+                    0x37, 0x35, 0x84, 0x58, 0xc6, 0x0b, 0x9c, 0x2d, 0x33, 0xce,
+                    0xb0, 0x58, 0xf9, 0x6e, 0x6d, 0xd0, 0x3c, 0x21, 0x56, 0x52,
+                },
+        },
+    };
+    return test_aegis_vectors(vectors, sizeof(vectors) / sizeof(vectors[0]),
+                              AEGIS256_KEY_SIZE, AEGIS256_NONCE_SIZE,
+                              aegis256_seal, aegis256_open);
+}
+
 static int benchmark_8(void) {
     static const uint8_t plaintext[8] = {0};
     return benchmark_N(plaintext, sizeof(plaintext));
@@ -384,6 +1760,443 @@ static int benchmark_1MB(void) {
     return benchmark_N(plaintext, sizeof(plaintext));
 }
 
+// benchmark_buf_pool_1024 is the Rocca half of |benchmark_1024|
+// with the destination taken from a |rocca_buf_pool| and wiped
+// on release, as a server would do per packet.
+static int benchmark_buf_pool_1024(void) {
+    static const uint8_t plaintext[1024]         = {0};
+    static const uint8_t key[ROCCA_KEY_SIZE]     = {0};
+    static const uint8_t nonce[ROCCA_NONCE_SIZE] = {0};
+    static const uint8_t additional_data[32]     = {0};
+
+    rocca_buf_pool* pool = rocca_buf_pool_new(sizeof(plaintext), 64, 0);
+    if (pool == NULL) {
+        return TEST_FAIL;
+    }
+
+    int iters        = 0;
+    uint64_t elapsed = 0;
+    while (elapsed < one_second) {
+        uint64_t start = now();
+        uint8_t* buf   = rocca_buf_get(pool);
+
+        bool ok = buf != NULL &&
+                  rocca_seal(buf, rocca_buf_pool_buf_size(pool), key,
+                             sizeof(key), nonce, sizeof(nonce), plaintext,
+                             sizeof(plaintext), additional_data,
+                             sizeof(additional_data)) &&
+                  rocca_buf_put(pool, buf);
+        uint64_t stop = now();
+        if (!ok) {
+            fprintf(stderr, "pooled seal failed\n");
+            rocca_buf_pool_free(pool);
+            return TEST_FAIL;
+        }
+        if (stop > start) {
+            elapsed += stop - start;
+            iters++;
+        }
+    }
+    rocca_buf_pool_free(pool);
+
+    uint64_t total = (uint64_t)sizeof(plaintext) * iters;
+    fprintf(stderr, "%0.2f MB/s\n", (double)total / (double)one_megabyte);
+    fprintf(stderr, "%" PRIu64 " ns/op\n", elapsed / iters);
+    return TEST_PASS;
+}
+
+// benchmark_session_batch_64 seals batches of 64 byte messages
+// for random sessions out of many, first with one heap-allocated
+// struct per session and |rocca_seal|, then with
+// a |rocca_session_table|.
+static int benchmark_session_batch_64(void) {
+    enum { nsessions = 200000, batch = 64, msg_len = 64 };
+
+    typedef struct session {
+        uint8_t key[ROCCA_KEY_SIZE];
+        uint8_t nonce[ROCCA_NONCE_SIZE];
+        uint64_t counter;
+        uint64_t messages;
+        uint64_t bytes;
+    } session;
+
+    static const uint8_t plaintext[msg_len] = {0};
+    static uint8_t ciphertext[batch][msg_len + ROCCA_OVERHEAD];
+
+    int result                 = TEST_FAIL;
+    uint64_t seed              = 1;
+    session** sessions         = calloc(nsessions, sizeof(session*));
+    rocca_session_table* table = rocca_session_table_new(nsessions);
+    if (sessions == NULL || table == NULL) {
+        goto done;
+    }
+    for (size_t i = 0; i < nsessions; i++) {
+        sessions[i] = calloc(1, sizeof(session));
+        if (sessions[i] == NULL) {
+            goto done;
+        }
+        prng_bytes(&seed, sessions[i]->key, ROCCA_KEY_SIZE);
+        prng_bytes(&seed, sessions[i]->nonce, ROCCA_NONCE_SIZE);
+        rocca_session_set(table, i, sessions[i]->key, ROCCA_KEY_SIZE,
+                          sessions[i]->nonce, ROCCA_NONCE_SIZE);
+    }
+
+    rocca_session_msg msgs[batch];
+    size_t ids[batch];
+    uint64_t elapsed[2] = {0};
+    uint64_t iters      = 0;
+    while (elapsed[1] < one_second) {
+        for (int i = 0; i < batch; i++) {
+            ids[i] = prng_uint(&seed, nsessions);
+        }
+
+        uint64_t start = now();
+        for (int i = 0; i < batch; i++) {
+            session* sess = sessions[ids[i]];
+            uint8_t nonce[ROCCA_NONCE_SIZE];
+            memcpy(nonce, sess->nonce, sizeof(nonce));
+            nonce[ROCCA_NONCE_SIZE - 1] ^= (uint8_t)sess->counter++;
+            if (!rocca_seal(ciphertext[i], sizeof(ciphertext[i]), sess->key,
+                            ROCCA_KEY_SIZE, nonce, sizeof(nonce), plaintext,
+                            sizeof(plaintext), NULL, 0)) {
+                goto done;
+            }
+            sess->messages++;
+            sess->bytes += sizeof(plaintext);
+        }
+        uint64_t mid = now();
+        for (int i = 0; i < batch; i++) {
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].session       = ids[i];
+            msgs[i].dst           = ciphertext[i];
+            msgs[i].dst_len       = sizeof(ciphertext[i]);
+            msgs[i].plaintext     = plaintext;
+            msgs[i].plaintext_len = sizeof(plaintext);
+        }
+        if (rocca_session_seal_batch(table, msgs, batch) != batch) {
+            goto done;
+        }
+        uint64_t stop = now();
+
+        elapsed[0] += mid - start;
+        elapsed[1] += stop - mid;
+        iters += batch;
+    }
+
+    fprintf(stderr, "scattered: %" PRIu64 " ns/msg\n", elapsed[0] / iters);
+    fprintf(stderr, "session table: %" PRIu64 " ns/msg\n",
+            elapsed[1] / iters);
+    result = TEST_PASS;
+
+done:
+    for (size_t i = 0; sessions != NULL && i < nsessions; i++) {
+        free(sessions[i]);
+    }
+    free(sessions);
+    rocca_session_table_free(table);
+    return result;
+}
+
+// benchmark_fanout_4MB seals a 4 MiB payload for 16
+// recipients, first with one |rocca_seal| per recipient and then
+// with |rocca_seal_fanout|.
+static int benchmark_fanout_4MB(void) {
+    enum { nrecipients = 16, pt_len = 4 * one_megabyte };
+
+    const size_t ct_len = pt_len + ROCCA_OVERHEAD;
+
+    int result    = TEST_FAIL;
+    uint64_t seed = 1;
+    uint8_t* pt   = malloc(pt_len);
+    uint8_t* ct   = malloc(nrecipients * ct_len);
+    uint8_t* keys = malloc(nrecipients * ROCCA_KEY_SIZE);
+    if (pt == NULL || ct == NULL || keys == NULL) {
+        goto done;
+    }
+    prng_bytes(&seed, pt, pt_len);
+    prng_bytes(&seed, keys, nrecipients * ROCCA_KEY_SIZE);
+
+    uint8_t nonce[ROCCA_NONCE_SIZE] = {0};
+    rocca_recipient recipients[nrecipients];
+    for (size_t j = 0; j < nrecipients; j++) {
+        recipients[j] = (rocca_recipient){
+            .key       = &keys[j * ROCCA_KEY_SIZE],
+            .key_len   = ROCCA_KEY_SIZE,
+            .nonce     = nonce,
+            .nonce_len = sizeof(nonce),
+            .dst       = &ct[j * ct_len],
+            .dst_len   = ct_len,
+        };
+    }
+
+    uint64_t elapsed[2] = {0};
+    uint64_t iters      = 0;
+    while (elapsed[1] < one_second) {
+        uint64_t start = now();
+        for (size_t j = 0; j < nrecipients; j++) {
+            if (!rocca_seal(recipients[j].dst, ct_len, recipients[j].key,
+                            ROCCA_KEY_SIZE, nonce, sizeof(nonce), pt, pt_len,
+                            NULL, 0)) {
+                goto done;
+            }
+        }
+        uint64_t mid = now();
+        if (!rocca_seal_fanout(recipients, nrecipients, pt, pt_len, NULL,
+                               0)) {
+            goto done;
+        }
+        uint64_t stop = now();
+
+        elapsed[0] += mid - start;
+        elapsed[1] += stop - mid;
+        iters++;
+    }
+
+    uint64_t total = (uint64_t)nrecipients * pt_len * iters;
+    fprintf(stderr, "rocca_seal: %0.2f MB/s\n",
+            (double)total / (double)one_megabyte /
+                ((double)elapsed[0] / one_second));
+    fprintf(stderr, "rocca_seal_fanout: %0.2f MB/s\n",
+            (double)total / (double)one_megabyte /
+                ((double)elapsed[1] / one_second));
+    result = TEST_PASS;
+
+done:
+    free(pt);
+    free(ct);
+    free(keys);
+    return result;
+}
+
+// benchmark_file_pread_4k reads random 4 KiB ranges from the
+// first and the last MiB of a 64 MiB encrypted file with 4 KiB
+// segments. Both should take the same time.
+static int benchmark_file_pread_4k(void) {
+    enum {
+        file_len     = 64 * one_megabyte,
+        segment_size = 4096,
+        read_len     = 4096,
+    };
+
+    static uint8_t buf[one_megabyte];
+    static const uint8_t key[ROCCA_KEY_SIZE]     = {0};
+    static const uint8_t nonce[ROCCA_NONCE_SIZE] = {0};
+
+    FILE* fp = tmpfile();
+    if (fp == NULL) {
+        return TEST_FAIL;
+    }
+    int fd               = fileno(fp);
+    int result           = TEST_FAIL;
+    rocca_file* f        = NULL;
+    rocca_file_writer* w = rocca_file_writer_new(
+        fd, key, sizeof(key), nonce, sizeof(nonce), segment_size);
+    if (w == NULL) {
+        goto done;
+    }
+    for (size_t off = 0; off < file_len; off += sizeof(buf)) {
+        if (!rocca_file_write(w, buf, sizeof(buf))) {
+            rocca_file_writer_free(w);
+            goto done;
+        }
+    }
+    bool ok = rocca_file_writer_finish(w);
+    rocca_file_writer_free(w);
+    if (!ok) {
+        goto done;
+    }
+    f = rocca_file_open(fd, key, sizeof(key), 64);
+    if (f == NULL) {
+        goto done;
+    }
+
+    static const char* names[]    = {"first MiB", "last MiB"};
+    static const uint64_t bases[] = {0, file_len - one_megabyte};
+
+    uint64_t seed = 1;
+    for (int r = 0; r < 2; r++) {
+        uint64_t elapsed = 0;
+        uint64_t iters   = 0;
+        while (elapsed < one_second / 2) {
+            uint64_t off = bases[r] +
+                           prng_uint(&seed, one_megabyte - read_len + 1);
+            size_t n       = 0;
+            uint64_t start = now();
+            if (!rocca_file_pread(f, buf, read_len, off, &n)) {
+                goto done;
+            }
+            elapsed += now() - start;
+            iters++;
+        }
+        fprintf(stderr, "%s: %" PRIu64 " ns/read\n", names[r],
+                elapsed / iters);
+    }
+    result = TEST_PASS;
+
+done:
+    rocca_file_close(f);
+    fclose(fp);
+    return result;
+}
+
+// benchmark_page_8k seals 64 8 KiB pages, first one at a time
+// and then as a batch, and opens them as a batch.
+static int benchmark_page_8k(void) {
+    enum { npages = 64, page_size = 8192 };
+
+    static uint8_t pages[npages][page_size];
+    static const uint8_t key[ROCCA_KEY_SIZE] = {0};
+
+    rocca_page_cipher* c =
+        rocca_page_cipher_new(key, sizeof(key), page_size, 32);
+    if (c == NULL) {
+        return TEST_FAIL;
+    }
+    rocca_page batch[npages];
+    for (int i = 0; i < npages; i++) {
+        batch[i] = (rocca_page){.data = pages[i], .page_no = i};
+    }
+
+    static const char* names[] = {"seal", "seal batch", "open batch"};
+    uint64_t elapsed[3]        = {0};
+    uint64_t iters             = 0;
+    uint64_t lsn               = 0;
+    while (elapsed[1] < one_second) {
+        lsn++;
+        uint64_t t0 = now();
+        for (int i = 0; i < npages; i++) {
+            rocca_page_seal(c, pages[i], i, lsn);
+        }
+        uint64_t t1 = now();
+        rocca_page_open_batch(c, batch, npages);
+        lsn++;
+        for (int i = 0; i < npages; i++) {
+            batch[i].lsn = lsn;
+        }
+        uint64_t t2 = now();
+        rocca_page_seal_batch(c, batch, npages);
+        uint64_t t3 = now();
+        if (rocca_page_open_batch(c, batch, npages) != npages) {
+            rocca_page_cipher_free(c);
+            return TEST_FAIL;
+        }
+        uint64_t t4 = now();
+
+        elapsed[0] += t1 - t0;
+        elapsed[1] += t3 - t2;
+        elapsed[2] += t4 - t3;
+        iters++;
+    }
+    for (int i = 0; i < 3; i++) {
+        uint64_t total = (uint64_t)npages * page_size * iters;
+        fprintf(stderr, "%s: %0.2f MB/s\n", names[i],
+                (double)total / (double)one_megabyte /
+                    ((double)elapsed[i] / one_second));
+    }
+    rocca_page_cipher_free(c);
+    return TEST_PASS;
+}
+
+// benchmark_sealer_64 seals a stream of 64 byte messages, first
+// with |rocca_seal| and then with a |rocca_sealer|.
+static int benchmark_sealer_64(void) {
+    enum { batch = 64, msg_len = 64 };
+
+    static const uint8_t plaintext[msg_len]  = {0};
+    static const uint8_t key[ROCCA_KEY_SIZE] = {0};
+    static uint8_t ciphertext[batch][msg_len + ROCCA_OVERHEAD];
+    static uint8_t nonces[batch][ROCCA_NONCE_SIZE];
+
+    rocca_sealer* p = rocca_sealer_new(key, sizeof(key));
+    if (p == NULL) {
+        return TEST_FAIL;
+    }
+
+    rocca_sealer_msg msgs[batch];
+    uint64_t elapsed[2] = {0};
+    uint64_t iters      = 0;
+    uint64_t counter    = 0;
+    while (elapsed[1] < one_second) {
+        for (int i = 0; i < batch; i++) {
+            memcpy(&nonces[i][8], &counter, sizeof(counter));
+            counter++;
+        }
+        uint64_t start = now();
+        for (int i = 0; i < batch; i++) {
+            rocca_seal(ciphertext[i], sizeof(ciphertext[i]), key, sizeof(key),
+                       nonces[i], ROCCA_NONCE_SIZE, plaintext,
+                       sizeof(plaintext), NULL, 0);
+        }
+        uint64_t mid = now();
+        for (int i = 0; i < batch; i++) {
+            msgs[i] = (rocca_sealer_msg){
+                .nonce         = nonces[i],
+                .nonce_len     = ROCCA_NONCE_SIZE,
+                .dst           = ciphertext[i],
+                .dst_len       = sizeof(ciphertext[i]),
+                .plaintext     = plaintext,
+                .plaintext_len = sizeof(plaintext),
+            };
+            rocca_sealer_push(p, &msgs[i]);
+        }
+        rocca_sealer_flush(p);
+        uint64_t stop = now();
+
+        elapsed[0] += mid - start;
+        elapsed[1] += stop - mid;
+        iters += batch;
+    }
+    rocca_sealer_free(p);
+
+    fprintf(stderr, "rocca_seal: %" PRIu64 " ns/msg\n", elapsed[0] / iters);
+    fprintf(stderr, "rocca_sealer: %" PRIu64 " ns/msg\n", elapsed[1] / iters);
+    return TEST_PASS;
+}
+
+// benchmark_state_pool_32 is |benchmark_32| with the states
+// precomputed outside of the timed region, as if during idle
+// cycles.
+static int benchmark_state_pool_32(void) {
+    static const uint8_t plaintext[32]           = {0};
+    static const uint8_t key[ROCCA_KEY_SIZE]     = {0};
+    static const uint8_t nonce[ROCCA_NONCE_SIZE] = {0};
+    static const uint8_t additional_data[32]     = {0};
+
+    rocca_state_pool* pool =
+        rocca_state_pool_new(key, sizeof(key), nonce, sizeof(nonce), 1024);
+    if (pool == NULL) {
+        return TEST_FAIL;
+    }
+
+    uint8_t ciphertext[sizeof(plaintext) + ROCCA_OVERHEAD];
+    uint8_t used[ROCCA_NONCE_SIZE];
+    int iters        = 0;
+    uint64_t elapsed = 0;
+    while (elapsed < one_second) {
+        rocca_state_pool_fill(pool, 1);
+        uint64_t start = now();
+        bool ok        = rocca_state_pool_seal(
+            pool, used, ciphertext, sizeof(ciphertext), plaintext,
+            sizeof(plaintext), additional_data, sizeof(additional_data));
+        uint64_t stop = now();
+        if (!ok) {
+            fprintf(stderr, "rocca_state_pool_seal failed\n");
+            rocca_state_pool_free(pool);
+            return TEST_FAIL;
+        }
+        if (stop > start) {
+            elapsed += stop - start;
+            iters++;
+        }
+    }
+    rocca_state_pool_free(pool);
+
+    uint64_t total = (uint64_t)sizeof(plaintext) * iters;
+    fprintf(stderr, "%0.2f MB/s\n", (double)total / (double)one_megabyte);
+    fprintf(stderr, "%" PRIu64 " ns/op\n", elapsed / iters);
+    return TEST_PASS;
+}
+
 int main(void) {
     typedef struct test {
         const char* name;
@@ -394,9 +2207,35 @@ int main(void) {
     { #name, name }
 
     static const test tests[] = {
-        TEST(test_zero),       TEST(test_vectors),   TEST(benchmark_8),
-        TEST(benchmark_32),    TEST(benchmark_1024), TEST(benchmark_8192),
-        TEST(benchmark_16384), TEST(benchmark_1MB),
+        TEST(test_zero),
+        TEST(test_vectors),
+        TEST(test_streaming),
+        TEST(test_ctx_export),
+        TEST(test_rocca_s),
+        TEST(test_state_pool),
+        TEST(test_state_pool_skip),
+        TEST(test_buf_pool),
+        TEST(test_session_table),
+        TEST(test_seal_fanout),
+        TEST(test_file),
+        TEST(test_page_cipher),
+        TEST(test_sealer),
+        TEST(test_tuning),
+        TEST(test_aegis128l),
+        TEST(test_aegis256),
+        TEST(benchmark_8),
+        TEST(benchmark_32),
+        TEST(benchmark_1024),
+        TEST(benchmark_8192),
+        TEST(benchmark_16384),
+        TEST(benchmark_1MB),
+        TEST(benchmark_buf_pool_1024),
+        TEST(benchmark_session_batch_64),
+        TEST(benchmark_fanout_4MB),
+        TEST(benchmark_file_pread_4k),
+        TEST(benchmark_page_8k),
+        TEST(benchmark_sealer_64),
+        TEST(benchmark_state_pool_32),
     };
     int ntests = sizeof(tests) / sizeof(tests[0]);
     for (int i = 0; i < ntests; i++) {
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Generates the single-header amalgamation of the library.
+
+The public headers come first. The sources follow inside an
+#ifdef ROCCA_IMPLEMENTATION block, with every quoted #include
+inlined exactly once so that the whole library is one
+translation unit in the including file.
+
+Usage: amalgamate.py OUTPUT
+"""
+
+import os
+import re
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SEARCH = [os.path.join(ROOT, "include"), os.path.join(ROOT, "src")]
+HEADERS = ["rocca.h", "aegis.h"]
+SOURCES = ["rocca.c", "rocca_s.c", "aegis.c", "rocca_pool.c", "rocca_buf.c",
+           "rocca_session.c", "rocca_fanout.c", "rocca_file.c",
+           "rocca_page.c", "rocca_sealer.c",
+           "rocca_tune.c"]
+
+INCLUDE = re.compile(r'^\s*#\s*include\s+"([^"]+)"')
+
+
+def find(name):
+    for d in SEARCH:
+        path = os.path.join(d, name)
+        if os.path.exists(path):
+            return path
+    raise SystemExit("amalgamate: cannot find %s" % name)
+
+
+def inline(name, seen, out):
+    if name in seen:
+        return
+    seen.add(name)
+    path = find(name)
+    out.append("// ---- %s ----\n" % os.path.relpath(path, ROOT))
+    with open(path) as f:
+        for line in f:
+            m = INCLUDE.match(line)
+            if m:
+                inline(m.group(1), seen, out)
+            else:
+                out.append(line)
+    out.append("\n")
+
+
+def main():
+    if len(sys.argv) != 2:
+        raise SystemExit(__doc__.strip().splitlines()[-1])
+
+    seen = set()
+    out = [
+        "// Code generated by tools/amalgamate.py. DO NOT EDIT.\n",
+        "//\n",
+        "// Single-header build of the Rocca library. Include it as\n",
+        "// a drop-in replacement for rocca.h and aegis.h. In exactly\n",
+        "// one translation unit, define ROCCA_IMPLEMENTATION before\n",
+        "// including it (and before any system header) to compile the\n",
+        "// implementation there. Also defining ROCCA_STATIC gives\n",
+        "// the API internal linkage so the compiler can specialize\n",
+        "// and inline calls into the including file.\n",
+        "\n",
+        "#if defined(ROCCA_IMPLEMENTATION) && !defined(__STDC_WANT_LIB_EXT1__)\n",
+        "#define __STDC_WANT_LIB_EXT1__ 1\n",
+        "#endif\n",
+        "\n",
+    ]
+    for name in HEADERS:
+        inline(name, seen, out)
+    out.append("#ifdef ROCCA_IMPLEMENTATION\n")
+    out.append("#ifndef ROCCA_IMPLEMENTATION_ONCE\n")
+    out.append("#define ROCCA_IMPLEMENTATION_ONCE\n\n")
+    for name in SOURCES:
+        inline(name, seen, out)
+    out.append("#endif // ROCCA_IMPLEMENTATION_ONCE\n")
+    out.append("#endif // ROCCA_IMPLEMENTATION\n")
+
+    tmp = sys.argv[1] + ".tmp"
+    with open(tmp, "w") as f:
+        f.writelines(out)
+    os.replace(tmp, sys.argv[1])
+
+
+if __name__ == "__main__":
+    main()
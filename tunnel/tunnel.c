@@ -0,0 +1,1070 @@
+// rocca-tunnel is a small encrypting tunnel used as an
+// end-to-end throughput testbed.
+//
+// A "seal" instance accepts plaintext TCP or Unix socket
+// connections and forwards each one to a peer "open" instance
+// as a stream of sealed records. The "open" instance forwards
+// the plaintext to its target. Both directions of every
+// connection are tunneled.
+//
+//    rocca-tunnel -k KEY seal unix:/tmp/in.sock tcp:127.0.0.1:9000
+//    rocca-tunnel -k KEY open tcp:127.0.0.1:9000 tcp:127.0.0.1:80
+//
+// "bench" runs a seal and an open instance over Unix sockets
+// together with a load generator and a sink, then reports
+// records/s, GB/s and latency percentiles. "-a aes-256-gcm"
+// runs the same pipeline with OpenSSL's AES-256-GCM for
+// comparison.
+//
+// Each instance is a single-threaded epoll loop. Every wakeup
+// drains as much as fits in the connection's buffer and seals
+// (or opens) all of the records in it in one pass before
+// writing them out together. The buffers come from
+// a |rocca_buf_pool| and are reused for the life of the
+// connection.
+//
+// Each direction of a connection starts with the sealer's
+// random nonce prefix, followed by records of the form
+//
+//    [ciphertext length: u32 big-endian][ciphertext || tag]
+//
+// The length is authenticated as additional data. The nonce for
+// the i-th record is the prefix with i XORed into its last eight
+// bytes.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/evp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+
+#include "aegis.h"
+#include "rocca.h"
+
+enum {
+    // RECORD_MAX is the largest plaintext carried by one record.
+    RECORD_MAX = 16384,
+    // RECORD_HEADER is the size of a record's length prefix.
+    RECORD_HEADER = 4,
+    // BUF_SIZE is the size of each per-direction buffer.
+    BUF_SIZE = 256 * 1024,
+    // MAX_CONNS is the number of concurrent connections that an
+    // instance accepts.
+    MAX_CONNS  = 64,
+    MAX_EVENTS = 64,
+    MAX_KEY    = 32,
+    MAX_NONCE  = 32,
+};
+
+// aead_func is the signature shared by the seal and open
+// functions in this package.
+typedef bool (*aead_func)(uint8_t* dst,
+                          size_t dst_len,
+                          const uint8_t* key,
+                          size_t key_len,
+                          const uint8_t* nonce,
+                          size_t nonce_len,
+                          const uint8_t* src,
+                          size_t src_len,
+                          const uint8_t* additional_data,
+                          size_t additional_data_len);
+
+// aead describes a record cipher. If |seal| is NULL, the cipher
+// is AES-256-GCM through OpenSSL.
+typedef struct aead {
+    const char* name;
+    size_t key_len;
+    size_t nonce_len;
+    size_t tag_len;
+    aead_func seal;
+    aead_func open;
+} aead;
+
+static const aead aeads[] = {
+    {"rocca", ROCCA_KEY_SIZE, ROCCA_NONCE_SIZE, ROCCA_TAG_SIZE, rocca_seal,
+     rocca_open},
+    {"aegis128l", AEGIS128L_KEY_SIZE, AEGIS128L_NONCE_SIZE,
+     AEGIS128L_TAG_SIZE, aegis128l_seal, aegis128l_open},
+    {"aegis256", AEGIS256_KEY_SIZE, AEGIS256_NONCE_SIZE, AEGIS256_TAG_SIZE,
+     aegis256_seal, aegis256_open},
+    {"aes-256-gcm", 32, 12, 16, NULL, NULL},
+};
+
+// cipher is the per-direction keyed state of an |aead|.
+typedef struct cipher {
+    const aead* aead;
+    uint8_t key[MAX_KEY];
+    EVP_CIPHER_CTX* evp;
+} cipher;
+
+static bool cipher_init(cipher* c,
+                        const aead* a,
+                        const uint8_t* key,
+                        bool seal) {
+    c->aead = a;
+    memcpy(c->key, key, a->key_len);
+    if (a->seal != NULL) {
+        return true;
+    }
+    c->evp = EVP_CIPHER_CTX_new();
+    return c->evp != NULL && EVP_CipherInit_ex(c->evp, EVP_aes_256_gcm(),
+                                               NULL, key, NULL, seal) == 1;
+}
+
+static void cipher_free(cipher* c) {
+    EVP_CIPHER_CTX_free(c->evp);
+    memset(c, 0, sizeof(*c));
+}
+
+// cipher_seal seals |pt_len| bytes from |pt| to |dst|, which
+// must have room for the tag.
+static bool cipher_seal(cipher* c,
+                        const uint8_t* nonce,
+                        uint8_t* dst,
+                        const uint8_t* pt,
+                        size_t pt_len,
+                        const uint8_t* ad,
+                        size_t ad_len) {
+    const aead* a = c->aead;
+    if (a->seal != NULL) {
+        return a->seal(dst, pt_len + a->tag_len, c->key, a->key_len, nonce,
+                       a->nonce_len, pt, pt_len, ad, ad_len);
+    }
+    int n = 0;
+    return EVP_EncryptInit_ex(c->evp, NULL, NULL, NULL, nonce) == 1 &&
+           EVP_EncryptUpdate(c->evp, NULL, &n, ad, (int)ad_len) == 1 &&
+           EVP_EncryptUpdate(c->evp, dst, &n, pt, (int)pt_len) == 1 &&
+           EVP_EncryptFinal_ex(c->evp, &dst[n], &n) == 1 &&
+           EVP_CIPHER_CTX_ctrl(c->evp, EVP_CTRL_GCM_GET_TAG, (int)a->tag_len,
+                               &dst[pt_len]) == 1;
+}
+
+// cipher_open opens |ct_len| bytes from |ct|, including the tag,
+// to |dst|.
+static bool cipher_open(cipher* c,
+                        const uint8_t* nonce,
+                        uint8_t* dst,
+                        const uint8_t* ct,
+                        size_t ct_len,
+                        const uint8_t* ad,
+                        size_t ad_len) {
+    const aead* a = c->aead;
+    size_t pt_len = ct_len - a->tag_len;
+    if (a->open != NULL) {
+        return a->open(dst, pt_len, c->key, a->key_len, nonce, a->nonce_len,
+                       ct, ct_len, ad, ad_len);
+    }
+    int n = 0;
+    return EVP_DecryptInit_ex(c->evp, NULL, NULL, NULL, nonce) == 1 &&
+           EVP_CIPHER_CTX_ctrl(c->evp, EVP_CTRL_GCM_SET_TAG, (int)a->tag_len,
+                               (void*)&ct[pt_len]) == 1 &&
+           EVP_DecryptUpdate(c->evp, NULL, &n, ad, (int)ad_len) == 1 &&
+           EVP_DecryptUpdate(c->evp, dst, &n, ct, (int)pt_len) == 1 &&
+           EVP_DecryptFinal_ex(c->evp, &dst[n], &n) == 1;
+}
+
+static uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+// stats counts the records handled by one instance in one
+// direction.
+typedef struct stats {
+    uint64_t records;
+    uint64_t bytes;
+    // batches is the number of wakeups that handled at least one
+    // record.
+    uint64_t batches;
+    uint64_t first;
+    uint64_t last;
+} stats;
+
+static void stats_add(stats* s, uint64_t records, uint64_t bytes) {
+    if (records == 0) {
+        return;
+    }
+    uint64_t t = now();
+    if (s->records == 0) {
+        s->first = t;
+    }
+    s->last = t;
+    s->records += records;
+    s->bytes += bytes;
+    s->batches++;
+}
+
+static void stats_print(const char* name, const stats* s) {
+    if (s->records == 0) {
+        return;
+    }
+    fprintf(stderr, "%s: %" PRIu64 " records, %.1f records/batch", name,
+            s->records, (double)s->records / (double)s->batches);
+    if (s->last > s->first) {
+        double secs = (double)(s->last - s->first) / 1e9;
+        fprintf(stderr, ", %.0f records/s, %.3f GB/s",
+                (double)s->records / secs, (double)s->bytes / secs / 1e9);
+    }
+    fprintf(stderr, "\n");
+}
+
+// addr is a parsed "tcp:HOST:PORT" or "unix:PATH" address.
+typedef struct addr {
+    struct sockaddr_storage ss;
+    socklen_t len;
+} addr;
+
+static bool addr_parse(addr* a, const char* s) {
+    memset(a, 0, sizeof(*a));
+    if (strncmp(s, "unix:", 5) == 0) {
+        struct sockaddr_un* sun = (struct sockaddr_un*)&a->ss;
+        if (strlen(&s[5]) >= sizeof(sun->sun_path)) {
+            return false;
+        }
+        sun->sun_family = AF_UNIX;
+        strcpy(sun->sun_path, &s[5]);
+        a->len = sizeof(*sun);
+        return true;
+    }
+    if (strncmp(s, "tcp:", 4) == 0) {
+        char host[64];
+        const char* colon = strrchr(&s[4], ':');
+        if (colon == NULL || (size_t)(colon - &s[4]) >= sizeof(host)) {
+            return false;
+        }
+        memcpy(host, &s[4], (size_t)(colon - &s[4]));
+        host[colon - &s[4]] = 0;
+
+        struct sockaddr_in* sin = (struct sockaddr_in*)&a->ss;
+        char* end               = NULL;
+        long port               = strtol(&colon[1], &end, 10);
+        if (*end != 0 || port <= 0 || port > 65535 ||
+            inet_pton(AF_INET, host, &sin->sin_addr) != 1) {
+            return false;
+        }
+        sin->sin_family = AF_INET;
+        sin->sin_port   = htons((uint16_t)port);
+        a->len          = sizeof(*sin);
+        return true;
+    }
+    return false;
+}
+
+static int addr_listen(const addr* a) {
+    int fd = socket(a->ss.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (a->ss.ss_family == AF_UNIX) {
+        unlink(((const struct sockaddr_un*)&a->ss)->sun_path);
+    } else {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    if (bind(fd, (const struct sockaddr*)&a->ss, a->len) != 0 ||
+        listen(fd, 128) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// addr_connect connects to |a|, blocking until the connection
+// is established.
+static int addr_connect(const addr* a) {
+    int fd = socket(a->ss.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (const struct sockaddr*)&a->ss, a->len) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (a->ss.ss_family == AF_INET) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+typedef enum mode {
+    MODE_SEAL,
+    MODE_OPEN,
+} mode;
+
+// config configures one tunnel instance.
+typedef struct config {
+    mode mode;
+    const aead* aead;
+    uint8_t key[MAX_KEY];
+    int listen_fd;
+    addr peer;
+} config;
+
+// flow is one direction of a tunneled connection: it reads from
+// |src|, seals or opens, and writes to |dst|.
+typedef struct flow {
+    int src;
+    int dst;
+    bool seal;
+    cipher cipher;
+    uint8_t nonce[MAX_NONCE];
+    // prefix_len is the number of bytes of the nonce prefix
+    // received so far. Only used when opening.
+    size_t prefix_len;
+    uint64_t seq;
+
+    uint8_t* in;
+    size_t in_len;
+    uint8_t* out;
+    size_t out_off;
+    size_t out_len;
+
+    // eof is set once |src| has been read to the end, and done
+    // once everything has been written and |dst| shut down.
+    bool eof;
+    bool done;
+} flow;
+
+typedef struct conn conn;
+
+// endpoint is the epoll registration for one socket of a conn.
+typedef struct endpoint {
+    conn* conn;
+    int idx;
+    uint32_t events;
+    bool registered;
+    // hup is set once the peer has closed the socket. It is then
+    // removed from epoll and drained directly.
+    bool hup;
+} endpoint;
+
+// conn is a tunneled connection. flows[0] carries fds[0] to
+// fds[1] and flows[1] carries fds[1] to fds[0], where fds[0] is
+// the accepted socket.
+struct conn {
+    int slot;
+    bool dead;
+    int fds[2];
+    flow flows[2];
+    endpoint eps[2];
+};
+
+// tunnel is a running instance.
+typedef struct tunnel {
+    const config* cfg;
+    int epfd;
+    rocca_buf_pool* pool;
+    size_t seal_limit;
+    conn* conns[MAX_CONNS];
+    stats seal;
+    stats open;
+} tunnel;
+
+static volatile sig_atomic_t stopping;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+static void flow_nonce(const flow* f, size_t nonce_len, uint8_t* dst) {
+    memcpy(dst, f->nonce, nonce_len);
+    for (int i = 0; i < 8; i++) {
+        dst[nonce_len - 1 - i] ^= (uint8_t)(f->seq >> (8 * i));
+    }
+}
+
+// flow_seal seals everything in |f->in| into records in
+// |f->out| in a single pass.
+static bool flow_seal(tunnel* t, flow* f) {
+    const aead* a = t->cfg->aead;
+    uint8_t nonce[MAX_NONCE];
+    size_t records = 0;
+    for (size_t off = 0; off < f->in_len;) {
+        size_t n = f->in_len - off;
+        if (n > RECORD_MAX) {
+            n = RECORD_MAX;
+        }
+        size_t ct_len = n + a->tag_len;
+        uint8_t* hdr  = &f->out[f->out_len];
+        hdr[0]        = (uint8_t)(ct_len >> 24);
+        hdr[1]        = (uint8_t)(ct_len >> 16);
+        hdr[2]        = (uint8_t)(ct_len >> 8);
+        hdr[3]        = (uint8_t)ct_len;
+        flow_nonce(f, a->nonce_len, nonce);
+        if (!cipher_seal(&f->cipher, nonce, &hdr[RECORD_HEADER], &f->in[off],
+                         n, hdr, RECORD_HEADER)) {
+            return false;
+        }
+        f->seq++;
+        f->out_len += RECORD_HEADER + ct_len;
+        off += n;
+        records++;
+    }
+    stats_add(&t->seal, records, f->in_len);
+    f->in_len = 0;
+    return true;
+}
+
+// flow_open opens every complete record in |f->in| into
+// |f->out| in a single pass, keeping any partial record.
+static bool flow_open(tunnel* t, flow* f) {
+    const aead* a = t->cfg->aead;
+    size_t off    = 0;
+    if (f->prefix_len < a->nonce_len) {
+        size_t n = a->nonce_len - f->prefix_len;
+        if (n > f->in_len) {
+            n = f->in_len;
+        }
+        memcpy(&f->nonce[f->prefix_len], f->in, n);
+        f->prefix_len += n;
+        off += n;
+    }
+
+    uint8_t nonce[MAX_NONCE];
+    size_t records = 0;
+    size_t bytes   = 0;
+    while (f->in_len - off >= RECORD_HEADER) {
+        const uint8_t* hdr = &f->in[off];
+        size_t ct_len      = (size_t)hdr[0] << 24 | (size_t)hdr[1] << 16 |
+                        (size_t)hdr[2] << 8 | (size_t)hdr[3];
+        if (ct_len <= a->tag_len || ct_len > RECORD_MAX + a->tag_len) {
+            return false;
+        }
+        if (f->in_len - off < RECORD_HEADER + ct_len) {
+            break;
+        }
+        flow_nonce(f, a->nonce_len, nonce);
+        if (!cipher_open(&f->cipher, nonce, &f->out[f->out_len],
+                         &hdr[RECORD_HEADER], ct_len, hdr, RECORD_HEADER)) {
+            return false;
+        }
+        f->seq++;
+        f->out_len += ct_len - a->tag_len;
+        bytes += ct_len - a->tag_len;
+        off += RECORD_HEADER + ct_len;
+        records++;
+    }
+    stats_add(&t->open, records, bytes);
+    memmove(f->in, &f->in[off], f->in_len - off);
+    f->in_len -= off;
+    return true;
+}
+
+// flow_flush writes as much pending output as |f->dst| accepts.
+static bool flow_flush(flow* f) {
+    while (f->out_off < f->out_len) {
+        ssize_t n = write(f->dst, &f->out[f->out_off], f->out_len - f->out_off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN;
+        }
+        f->out_off += (size_t)n;
+    }
+    f->out_off = 0;
+    f->out_len = 0;
+    if (f->eof && !f->done) {
+        shutdown(f->dst, SHUT_WR);
+        f->done = true;
+    }
+    return true;
+}
+
+// flow_read drains |f->src| into |f->in|, processes the batch
+// and starts writing it out.
+static bool flow_read(tunnel* t, flow* f) {
+    size_t limit = f->seal ? t->seal_limit : BUF_SIZE;
+    while (f->in_len < limit) {
+        ssize_t n = read(f->src, &f->in[f->in_len], limit - f->in_len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            return false;
+        }
+        if (n == 0) {
+            f->eof = true;
+            break;
+        }
+        f->in_len += (size_t)n;
+    }
+    bool ok = f->seal ? flow_seal(t, f) : flow_open(t, f);
+    if (!ok) {
+        return false;
+    }
+    // A truncated record or nonce prefix is an error.
+    if (f->eof && f->in_len != 0) {
+        return false;
+    }
+    return flow_flush(f);
+}
+
+// flow_wants_read reports whether |f| should read more input.
+// Input is only read once the previous batch has been written.
+static bool flow_wants_read(const flow* f) {
+    return !f->eof && f->out_len == 0;
+}
+
+static void conn_kill(conn* c) {
+    c->dead = true;
+}
+
+// conn_update re-arms the epoll interest of both sockets of |c|,
+// or marks it dead once both directions are done.
+static void conn_update(tunnel* t, conn* c) {
+    if (c->dead || (c->flows[0].done && c->flows[1].done)) {
+        conn_kill(c);
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        while (c->eps[i].hup && !c->dead && flow_wants_read(&c->flows[i])) {
+            if (!flow_read(t, &c->flows[i])) {
+                conn_kill(c);
+            }
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        endpoint* ep = &c->eps[i];
+        if (c->dead || !ep->registered) {
+            continue;
+        }
+        uint32_t events = 0;
+        if (flow_wants_read(&c->flows[i])) {
+            events |= EPOLLIN;
+        }
+        if (c->flows[1 - i].out_len != 0) {
+            events |= EPOLLOUT;
+        }
+        if (events != ep->events) {
+            struct epoll_event ev = {.events = events, .data.ptr = ep};
+            epoll_ctl(t->epfd, EPOLL_CTL_MOD, c->fds[i], &ev);
+            ep->events = events;
+        }
+    }
+    if (c->flows[0].done && c->flows[1].done) {
+        conn_kill(c);
+    }
+}
+
+static void conn_free(tunnel* t, conn* c) {
+    for (int i = 0; i < 2; i++) {
+        flow* f = &c->flows[i];
+        if (c->fds[i] >= 0) {
+            close(c->fds[i]);
+        }
+        rocca_buf_put(t->pool, f->in);
+        rocca_buf_put(t->pool, f->out);
+        cipher_free(&f->cipher);
+    }
+    t->conns[c->slot] = NULL;
+    memset(c, 0, sizeof(*c));
+    free(c);
+}
+
+// conn_new starts tunneling between |accepted| and |connected|.
+// It takes ownership of both sockets, even on failure.
+static bool conn_new(tunnel* t, int accepted, int connected) {
+    int slot = 0;
+    while (slot < MAX_CONNS && t->conns[slot] != NULL) {
+        slot++;
+    }
+    if (slot == MAX_CONNS) {
+        close(accepted);
+        close(connected);
+        return false;
+    }
+    conn* c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+        close(accepted);
+        close(connected);
+        return false;
+    }
+    t->conns[slot] = c;
+    c->slot        = slot;
+    c->fds[0]      = accepted;
+    c->fds[1]      = connected;
+
+    const config* cfg = t->cfg;
+    bool ok           = true;
+    for (int i = 0; i < 2; i++) {
+        flow* f = &c->flows[i];
+        f->src  = c->fds[i];
+        f->dst  = c->fds[1 - i];
+        // The seal instance seals what it accepts; the open
+        // instance opens what it accepts.
+        f->seal = (cfg->mode == MODE_SEAL) == (i == 0);
+        f->in   = rocca_buf_get(t->pool);
+        f->out  = rocca_buf_get(t->pool);
+        ok      = ok && f->in != NULL && f->out != NULL &&
+             cipher_init(&f->cipher, cfg->aead, cfg->key, f->seal);
+        if (ok && f->seal) {
+            size_t n = cfg->aead->nonce_len;
+            ok       = getrandom(f->nonce, n, 0) == (ssize_t)n;
+            memcpy(f->out, f->nonce, n);
+            f->out_len = n;
+        }
+    }
+    if (!ok) {
+        conn_free(t, c);
+        return false;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        endpoint* ep          = &c->eps[i];
+        ep->conn              = c;
+        ep->idx               = i;
+        struct epoll_event ev = {.events = 0, .data.ptr = ep};
+        ep->registered =
+            epoll_ctl(t->epfd, EPOLL_CTL_ADD, c->fds[i], &ev) == 0;
+        if (!ep->registered) {
+            conn_free(t, c);
+            return false;
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        if (!flow_flush(&c->flows[i])) {
+            conn_kill(c);
+        }
+    }
+    conn_update(t, c);
+    return true;
+}
+
+static void tunnel_accept(tunnel* t) {
+    for (;;) {
+        int fd = accept4(t->cfg->listen_fd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        int peer = addr_connect(&t->cfg->peer);
+        if (peer < 0 || !set_nonblocking(peer)) {
+            close(fd);
+            if (peer >= 0) {
+                close(peer);
+            }
+            fprintf(stderr, "rocca-tunnel: unable to connect to peer\n");
+            continue;
+        }
+        if (!conn_new(t, fd, peer)) {
+            fprintf(stderr, "rocca-tunnel: dropping connection\n");
+        }
+    }
+}
+
+// tunnel_event handles |events| on one socket of a conn.
+static void tunnel_event(tunnel* t, endpoint* ep, uint32_t events) {
+    conn* c = ep->conn;
+    if (c->dead) {
+        return;
+    }
+    int i = ep->idx;
+    if ((events & EPOLLOUT) != 0 && !flow_flush(&c->flows[1 - i])) {
+        conn_kill(c);
+        return;
+    }
+    if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0 &&
+        flow_wants_read(&c->flows[i]) && !flow_read(t, &c->flows[i])) {
+        conn_kill(c);
+        return;
+    }
+    if ((events & (EPOLLHUP | EPOLLERR)) != 0) {
+        // The peer closed the socket, so nothing more can be
+        // written to it. Whatever it sent before closing is still
+        // buffered, but level-triggered epoll would report the
+        // hangup on every wait, so conn_update drains it directly.
+        flow* back    = &c->flows[1 - i];
+        back->eof     = true;
+        back->done    = true;
+        back->out_off = 0;
+        back->out_len = 0;
+        epoll_ctl(t->epfd, EPOLL_CTL_DEL, c->fds[i], NULL);
+        ep->registered = false;
+        ep->hup        = true;
+    }
+    conn_update(t, c);
+}
+
+// tunnel_run runs a tunnel instance until SIGINT or SIGTERM and
+// then prints its statistics.
+static int tunnel_run(const config* cfg) {
+    tunnel t          = {.cfg = cfg};
+    size_t per_record = RECORD_MAX + RECORD_HEADER + cfg->aead->tag_len;
+    // Leave room in the output buffer for the nonce prefix and
+    // the record headers and tags.
+    t.seal_limit = (BUF_SIZE - MAX_NONCE) / per_record * RECORD_MAX;
+
+    struct sigaction sa = {.sa_handler = on_signal};
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    t.epfd = epoll_create1(EPOLL_CLOEXEC);
+    t.pool = rocca_buf_pool_new(BUF_SIZE, 4 * MAX_CONNS, ROCCA_BUF_HUGETLB);
+    if (t.epfd < 0 || t.pool == NULL || !set_nonblocking(cfg->listen_fd)) {
+        perror("rocca-tunnel");
+        return EXIT_FAILURE;
+    }
+    struct epoll_event lev = {.events = EPOLLIN, .data.ptr = NULL};
+    epoll_ctl(t.epfd, EPOLL_CTL_ADD, cfg->listen_fd, &lev);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!stopping) {
+        int n = epoll_wait(t.epfd, events, MAX_EVENTS, 200);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) {
+                tunnel_accept(&t);
+            } else {
+                tunnel_event(&t, events[i].data.ptr, events[i].events);
+            }
+        }
+        // Conns are only freed once no pending event can refer
+        // to them.
+        for (int i = 0; i < MAX_CONNS; i++) {
+            if (t.conns[i] != NULL && t.conns[i]->dead) {
+                conn_free(&t, t.conns[i]);
+            }
+        }
+    }
+
+    for (int i = 0; i < MAX_CONNS; i++) {
+        if (t.conns[i] != NULL) {
+            conn_free(&t, t.conns[i]);
+        }
+    }
+    rocca_buf_pool_free(t.pool);
+    close(t.epfd);
+    close(cfg->listen_fd);
+    stats_print("seal", &t.seal);
+    stats_print("open", &t.open);
+    return EXIT_SUCCESS;
+}
+
+static bool write_full(int fd, const uint8_t* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool read_full(int fd, uint8_t* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// bench_state is shared by the load generator and the sink.
+typedef struct bench_state {
+    int fd;
+    size_t msg_size;
+    size_t count;
+    size_t window;
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+    size_t received;
+    bool failed;
+} bench_state;
+
+// bench_generate writes |count| messages, each starting with its
+// send time, keeping at most |window| of them in flight.
+static void* bench_generate(void* arg) {
+    bench_state* b = arg;
+    uint8_t* msg   = calloc(1, b->msg_size);
+    for (size_t i = 0; msg != NULL && i < b->count; i++) {
+        pthread_mutex_lock(&b->mu);
+        while (!b->failed && i - b->received >= b->window) {
+            pthread_cond_wait(&b->cond, &b->mu);
+        }
+        bool failed = b->failed;
+        pthread_mutex_unlock(&b->mu);
+        if (failed) {
+            break;
+        }
+        uint64_t t = now();
+        memcpy(msg, &t, sizeof(t));
+        if (!write_full(b->fd, msg, b->msg_size)) {
+            break;
+        }
+    }
+    free(msg);
+    shutdown(b->fd, SHUT_WR);
+    return NULL;
+}
+
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static pid_t bench_spawn(config* cfg) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(tunnel_run(cfg));
+    }
+    return pid;
+}
+
+// bench runs a seal and an open instance over Unix sockets and
+// pushes |count| messages of |msg_size| bytes through them.
+static int bench(const aead* a, size_t msg_size, size_t count, size_t window) {
+    char dir[] = "/tmp/rocca-tunnel.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    char path[3][sizeof(dir) + 16];
+    addr addrs[3];
+    int lfds[3];
+    static const char* names[3] = {"seal.sock", "open.sock", "sink.sock"};
+    for (int i = 0; i < 3; i++) {
+        snprintf(path[i], sizeof(path[i]), "unix:%s/%s", dir, names[i]);
+        if (!addr_parse(&addrs[i], path[i]) ||
+            (lfds[i] = addr_listen(&addrs[i])) < 0) {
+            perror("listen");
+            return EXIT_FAILURE;
+        }
+    }
+
+    config open_cfg = {.mode      = MODE_OPEN,
+                       .aead      = a,
+                       .listen_fd = lfds[1],
+                       .peer      = addrs[2]};
+    if (getrandom(open_cfg.key, a->key_len, 0) != (ssize_t)a->key_len) {
+        perror("getrandom");
+        return EXIT_FAILURE;
+    }
+    config seal_cfg    = open_cfg;
+    seal_cfg.mode      = MODE_SEAL;
+    seal_cfg.listen_fd = lfds[0];
+    seal_cfg.peer      = addrs[1];
+
+    pid_t open_pid = bench_spawn(&open_cfg);
+    pid_t seal_pid = bench_spawn(&seal_cfg);
+    memset(open_cfg.key, 0, sizeof(open_cfg.key));
+    memset(seal_cfg.key, 0, sizeof(seal_cfg.key));
+    close(lfds[0]);
+    close(lfds[1]);
+
+    int result       = EXIT_FAILURE;
+    uint8_t* msg     = malloc(msg_size);
+    uint64_t* lat    = malloc(count * sizeof(uint64_t));
+    bench_state b    = {.msg_size = msg_size, .count = count, .window = window};
+    b.fd             = addr_connect(&addrs[0]);
+    int sink         = b.fd < 0 ? -1 : accept(lfds[2], NULL, NULL);
+    pthread_t thread = 0;
+    pthread_mutex_init(&b.mu, NULL);
+    pthread_cond_init(&b.cond, NULL);
+    if (open_pid < 0 || seal_pid < 0 || msg == NULL || lat == NULL ||
+        sink < 0 || pthread_create(&thread, NULL, bench_generate, &b) != 0) {
+        perror("bench");
+        goto done;
+    }
+
+    uint64_t start = now();
+    size_t i       = 0;
+    for (; i < count && read_full(sink, msg, msg_size); i++) {
+        uint64_t t;
+        memcpy(&t, msg, sizeof(t));
+        lat[i] = now() - t;
+        pthread_mutex_lock(&b.mu);
+        b.received++;
+        pthread_cond_signal(&b.cond);
+        pthread_mutex_unlock(&b.mu);
+    }
+    uint64_t elapsed = now() - start;
+    pthread_mutex_lock(&b.mu);
+    b.failed = true;
+    pthread_cond_signal(&b.cond);
+    pthread_mutex_unlock(&b.mu);
+    pthread_join(thread, NULL);
+    if (i != count) {
+        fprintf(stderr, "bench: received %zu of %zu messages\n", i, count);
+        goto done;
+    }
+
+    qsort(lat, count, sizeof(uint64_t), cmp_u64);
+    double secs = (double)elapsed / 1e9;
+    fprintf(stderr, "%s: %zu x %zu bytes, window %zu\n", a->name, count,
+            msg_size, window);
+    fprintf(stderr, "%s: %.0f msgs/s, %.3f GB/s\n", a->name,
+            (double)count / secs,
+            (double)count * (double)msg_size / secs / 1e9);
+    fprintf(stderr,
+            "%s: latency p50 %.1f us, p90 %.1f us, p99 %.1f us, "
+            "p99.9 %.1f us\n",
+            a->name, (double)lat[count / 2] / 1e3,
+            (double)lat[count * 9 / 10] / 1e3,
+            (double)lat[count * 99 / 100] / 1e3,
+            (double)lat[count * 999 / 1000] / 1e3);
+    result = EXIT_SUCCESS;
+
+done:
+    if (sink >= 0) {
+        close(sink);
+    }
+    if (b.fd >= 0) {
+        close(b.fd);
+    }
+    close(lfds[2]);
+    free(msg);
+    free(lat);
+    // Stop the sealer first so that its statistics are printed
+    // before the opener's.
+    pid_t pids[2] = {seal_pid, open_pid};
+    for (int j = 0; j < 2; j++) {
+        if (pids[j] > 0) {
+            kill(pids[j], SIGTERM);
+            waitpid(pids[j], NULL, 0);
+        }
+    }
+    for (int j = 0; j < 3; j++) {
+        unlink(&path[j][5]);
+    }
+    rmdir(dir);
+    return result;
+}
+
+static bool parse_key(uint8_t* dst, size_t len, const char* hex) {
+    if (strlen(hex) != 2 * len) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        unsigned v;
+        if (sscanf(&hex[2 * i], "%2x", &v) != 1) {
+            return false;
+        }
+        dst[i] = (uint8_t)v;
+    }
+    return true;
+}
+
+static int usage(void) {
+    fprintf(stderr,
+            "usage: rocca-tunnel [-a aead] -k hexkey seal LISTEN PEER\n"
+            "       rocca-tunnel [-a aead] -k hexkey open LISTEN TARGET\n"
+            "       rocca-tunnel [-a aead] [-s size] [-n count] [-w window] "
+            "bench\n"
+            "\n"
+            "Addresses are tcp:IPV4:PORT or unix:PATH. aead is one of\n"
+            "rocca (the default), aegis128l, aegis256 or aes-256-gcm.\n");
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char** argv) {
+    const aead* a   = &aeads[0];
+    const char* key = NULL;
+    size_t msg_size = 16384;
+    size_t count    = 100000;
+    size_t window   = 16;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:k:s:n:w:")) != -1) {
+        switch (opt) {
+        case 'a':
+            a = NULL;
+            for (size_t i = 0; i < sizeof(aeads) / sizeof(aeads[0]); i++) {
+                if (strcmp(optarg, aeads[i].name) == 0) {
+                    a = &aeads[i];
+                }
+            }
+            if (a == NULL) {
+                return usage();
+            }
+            break;
+        case 'k':
+            key = optarg;
+            break;
+        case 's':
+            msg_size = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            count = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            window = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            return usage();
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
+    if (argc == 1 && strcmp(argv[0], "bench") == 0) {
+        if (msg_size < sizeof(uint64_t) || count == 0 || window == 0) {
+            return usage();
+        }
+        return bench(a, msg_size, count, window);
+    }
+    if (argc != 3 || key == NULL) {
+        return usage();
+    }
+
+    config cfg = {.aead = a};
+    if (strcmp(argv[0], "seal") == 0) {
+        cfg.mode = MODE_SEAL;
+    } else if (strcmp(argv[0], "open") == 0) {
+        cfg.mode = MODE_OPEN;
+    } else {
+        return usage();
+    }
+    addr listen_addr;
+    if (!parse_key(cfg.key, a->key_len, key) ||
+        !addr_parse(&listen_addr, argv[1]) || !addr_parse(&cfg.peer, argv[2])) {
+        return usage();
+    }
+    cfg.listen_fd = addr_listen(&listen_addr);
+    if (cfg.listen_fd < 0) {
+        perror("rocca-tunnel: listen");
+        return EXIT_FAILURE;
+    }
+    return tunnel_run(&cfg);
+}